@@ -0,0 +1,93 @@
+#!/bin/bash
+# Compile large generated programs with one or more j0 builds.
+# usage: ./bench_runner.sh [j0 binaries...]     (default: ./j0)
+# STMTS sets the program size and FLAGS is passed to each j0, e.g.
+# FLAGS=-phasetimes to also report the time of each phase. Cache traffic
+# is measured with perf stat when perf is installed, otherwise only
+# wall-clock time is reported.
+#
+# usage: ./bench_runner.sh latency
+# Compiles a small program RUNS times with a cold ./j0 and with
+# ./j0client talking to a warm ./j0 --server, and compares the two.
+
+STMTS=${STMTS:-1000000}
+FLAGS=${FLAGS:-}
+RUNS=${RUNS:-200}
+OUT=$(pwd)/bench_runner.out
+WORK=$(mktemp -d)
+BINS=("$@")
+
+# microseconds per compile over RUNS runs of the given command
+per_run() {
+	local start=$(date +%s%N)
+	for ((i = 0; i < RUNS; i++)); do "$@" > /dev/null 2>&1; done
+	echo $(( ($(date +%s%N) - start) / 1000 / RUNS ))
+}
+
+if [ "$1" = "latency" ]; then
+	J0=$(realpath ./j0)
+	CLIENT=$(realpath ./j0client)
+	export J0_SOCKET=$WORK/j0.sock
+	rm -f $OUT
+
+	{
+		echo "public class hello { public static void main(String argv[]) {"
+		echo "int x;"
+		echo "x = 1 + 2 * 3;"
+		echo "System.out.println(\"hello, jzero!\");"
+		echo "} }"
+	} > $WORK/hello.java
+
+	cd $WORK
+	$J0 --server > /dev/null &
+	SERVER=$!
+	while [ ! -S $J0_SOCKET ]; do sleep 0.1; done
+
+	echo "cold j0:        $(per_run $J0 hello.java) us/compile" | tee -a $OUT
+	echo "warm j0client:  $(per_run $CLIENT hello.java) us/compile" | tee -a $OUT
+
+	kill $SERVER
+	wait $SERVER 2> /dev/null
+	rm -rf $WORK
+	exit 0
+fi
+
+if [ ${#BINS[@]} -eq 0 ]; then
+	BINS=(./j0)
+fi
+
+rm -f $OUT
+
+# straight-line code: one long BlockStmts chain
+{
+	echo "public class stmts { public static void main(String argv[]) {"
+	echo "int x;"
+	for ((i = 0; i < STMTS; i++)); do echo "x = x + $((i % 7 + 1));"; done
+	echo "} }"
+} > $WORK/stmts.java
+
+# branches: exercises first/follow/onTrue/onFalse on every statement
+{
+	echo "public class conds { public static void main(String argv[]) {"
+	echo "int x; int y;"
+	for ((i = 0; i < STMTS / 5; i++)); do
+		echo "if (x < $i && y > 1) { x = x + 1; y = y * 2; }"
+	done
+	echo "} }"
+} > $WORK/conds.java
+
+for bin in "${BINS[@]}"; do
+	bin=$(realpath $bin)
+	for f in $WORK/stmts.java $WORK/conds.java; do
+		echo "== $bin $(basename $f) ($STMTS statements)" | tee -a $OUT
+		if command -v perf > /dev/null; then
+			(cd $WORK && perf stat -e task-clock,cache-references,cache-misses \
+				$bin $FLAGS $f 2>&1 > /dev/null) | tee -a $OUT
+		else
+			(cd $WORK && TIMEFORMAT="real %3R s" && time $bin $FLAGS $f > /dev/null) \
+				2>&1 | tee -a $OUT
+		fi
+	done
+done
+
+rm -rf $WORK
@@ -0,0 +1,388 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+/*
+ * The compile cache keeps the .icn of every successful compile in one
+ * directory ($J0_CACHE_DIR, default /tmp/j0-cache-<uid>), named by a
+ * hash of the compiler version, the flags and the source bytes. A hit
+ * hardlinks (or copies) the stored .icn into place without lexing or
+ * parsing. A miss can still reuse the code of unchanged methods, kept in
+ * .tac entries (see incremental.c). Using an entry touches it, and
+ * stores evict the entries used least recently once the directory is
+ * over $J0_CACHE_SIZE bytes.
+ *
+ * Hit and miss counts live in a stats file in the same directory,
+ * updated under flock() since parallel builds share the cache.
+ */
+
+/* counters in the stats file */
+enum { FILE_HITS, FILE_MISSES, METHOD_HITS, METHOD_MISSES, NSTATS };
+
+struct cache_entry {
+	char name[32];
+	off_t size;
+	time_t used;
+};
+
+/* fnv1a - 64 bit FNV-1a hash of data, continuing from h */
+uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+
+	const unsigned char *p = data;
+
+	while (len-- > 0) {
+		h ^= *p++;
+		h *= FNV_PRIME;
+	}
+
+	return h;
+}
+
+/*
+ * cache_key - the key of a compile. flags holds every option that can
+ * change the output; the version and flags are hashed with their NULs so
+ * that no two (version, flags, source) triples run together the same way.
+ */
+uint64_t cache_key(const char *source, size_t len, const char *flags) {
+
+	uint64_t h = FNV_OFFSET;
+
+	h = fnv1a(h, J0_VERSION, strlen(J0_VERSION) + 1);
+	h = fnv1a(h, flags, strlen(flags) + 1);
+	return fnv1a(h, source, len);
+}
+
+/*
+ * cache_dir - the cache directory, created on first use. NULL if it can't
+ * be, or if what is there is not a directory only its user can use: in
+ * /tmp anyone could have made it first, to see or plant .icn files.
+ */
+char *cache_dir() {
+
+	static char path[4096];
+	static int refused;
+	char *env = getenv(J0_CACHE_DIR_ENV);
+	struct stat st;
+
+	if (refused) return NULL;
+
+	if (path[0] == '\0') {
+		if (env != NULL && *env != '\0') {
+			snprintf(path, sizeof(path), "%s", env);
+		} else {
+			snprintf(path, sizeof(path), "/tmp/j0-cache-%d", (int) getuid());
+		}
+	}
+
+	if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+		return NULL;
+	}
+
+	if (lstat(path, &st) < 0 || !S_ISDIR(st.st_mode) ||
+		st.st_uid != getuid() || (st.st_mode & 0777) != 0700) {
+		fprintf(stderr, "j0: not using the compile cache %s, "
+			"it is not a directory of yours with mode 0700\n", path);
+		refused = 1;
+		return NULL;
+	}
+
+	return path;
+}
+
+static long cache_size() {
+
+	char *env = getenv(J0_CACHE_SIZE_ENV);
+
+	if (env != NULL && atol(env) > 0) {
+		return atol(env);
+	}
+
+	return J0_CACHE_SIZE;
+}
+
+static void entry_path(char *buf, size_t size, uint64_t key, char *suffix) {
+	snprintf(buf, size, "%s/%016llx%s", cache_dir(),
+		(unsigned long long) key, suffix);
+}
+
+static int copy_file(char *src, char *dest) {
+
+	char buf[8192];
+	size_t n;
+	FILE *in, *out;
+
+	if ((in = fopen(src, "r")) == NULL) return -1;
+	if ((out = fopen(dest, "w")) == NULL) {
+		fclose(in);
+		return -1;
+	}
+
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		fwrite(buf, 1, n, out);
+	}
+
+	fclose(in);
+	return fclose(out);
+}
+
+/*
+ * place - make dest a copy of src, as a hardlink when both are on the
+ * same file system. j0 unlinks an .icn before writing it, so an output
+ * linked to a cache entry is never written through.
+ */
+static int place(char *src, char *dest) {
+
+	unlink(dest);
+	if (link(src, dest) == 0) {
+		return 0;
+	}
+	return copy_file(src, dest);
+}
+
+/*
+ * update_stats - add delta to the counts kept in the stats file and
+ * return the new totals in total, or just read them when delta is NULL.
+ * Returns -1 if there is no stats file to be had.
+ */
+static int update_stats(long *delta, long *total) {
+
+	char path[4096], buf[128];
+	ssize_t n;
+	int fd, i;
+
+	memset(total, 0, NSTATS * sizeof(long));
+	if (cache_dir() == NULL) return -1;
+
+	snprintf(path, sizeof(path), "%s/stats", cache_dir());
+	if ((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0) return -1;
+	flock(fd, LOCK_EX);
+
+	if ((n = read(fd, buf, sizeof(buf) - 1)) > 0) {
+		buf[n] = '\0';
+		sscanf(buf, "%ld %ld %ld %ld", &total[FILE_HITS], &total[FILE_MISSES],
+			&total[METHOD_HITS], &total[METHOD_MISSES]);
+	}
+
+	if (delta != NULL) {
+		for (i = 0; i < NSTATS; i++) {
+			total[i] += delta[i];
+		}
+		n = snprintf(buf, sizeof(buf), "%ld %ld %ld %ld\n", total[FILE_HITS],
+			total[FILE_MISSES], total[METHOD_HITS], total[METHOD_MISSES]);
+		lseek(fd, 0, SEEK_SET);
+		if (ftruncate(fd, 0) < 0 || write(fd, buf, n) != n) {
+			perror("j0: cache stats");
+		}
+	}
+
+	close(fd);
+	return 0;
+}
+
+static void add_stat(int stat, long n) {
+
+	long delta[NSTATS] = { 0 }, total[NSTATS];
+
+	delta[stat] = n;
+	update_stats(delta, total);
+}
+
+/*
+ * cache_fetch - if the compile with this key is cached, put its .icn at
+ * dest and return 1. Every lookup counts as a hit or a miss.
+ */
+int cache_fetch(uint64_t key, char *dest) {
+
+	char path[4096];
+
+	if (cache_dir() == NULL) return 0;
+	entry_path(path, sizeof(path), key, ".icn");
+
+	if (access(path, R_OK) < 0 || place(path, dest) < 0) {
+		add_stat(FILE_MISSES, 1);
+		return 0;
+	}
+
+	/* the mtime is when the entry was last used, see evict() */
+	utime(path, NULL);
+	add_stat(FILE_HITS, 1);
+	return 1;
+}
+
+/*
+ * cache_open - open the entry with this key and suffix for reading,
+ * NULL if there is none. Entries other than .icn files are read by the
+ * compiler itself, see incremental.c.
+ */
+FILE *cache_open(uint64_t key, char *suffix) {
+
+	char path[4096];
+	FILE *f;
+
+	if (cache_dir() == NULL) return NULL;
+	entry_path(path, sizeof(path), key, suffix);
+
+	if ((f = fopen(path, "r")) != NULL) {
+		utime(path, NULL);
+	}
+	return f;
+}
+
+void cache_count_methods(int hits, int misses) {
+
+	long delta[NSTATS] = { 0 }, total[NSTATS];
+
+	delta[METHOD_HITS] = hits;
+	delta[METHOD_MISSES] = misses;
+	update_stats(delta, total);
+}
+
+static int compare_entries(const void *a, const void *b) {
+
+	const struct cache_entry *x = a, *y = b;
+
+	if (x->used != y->used) return x->used < y->used ? -1 : 1;
+	return strcmp(x->name, y->name);
+}
+
+/* scan - the entries in the cache and their total size, oldest first */
+static struct cache_entry *scan(int *count, long *total) {
+
+	DIR *d = opendir(cache_dir());
+	struct dirent *e;
+	struct stat st;
+	struct cache_entry *entries = NULL;
+	char path[4096];
+	int size = 0;
+
+	*count = 0;
+	*total = 0;
+	if (d == NULL) return NULL;
+
+	while ((e = readdir(d)) != NULL) {
+		size_t len = strlen(e->d_name);
+
+		if (len != 20 || (strcmp(e->d_name + 16, ".icn") != 0 &&
+			strcmp(e->d_name + 16, ".tac") != 0)) continue;
+		snprintf(path, sizeof(path), "%s/%s", cache_dir(), e->d_name);
+		if (stat(path, &st) < 0) continue;
+
+		if (*count == size) {
+			size = size ? size * 2 : 64;
+			entries = realloc(entries, size * sizeof(struct cache_entry));
+		}
+		strcpy(entries[*count].name, e->d_name);
+		entries[*count].size = st.st_size;
+		entries[*count].used = st.st_mtime;
+		*total += st.st_size;
+		(*count)++;
+	}
+
+	closedir(d);
+	qsort(entries, *count, sizeof(struct cache_entry), compare_entries);
+	return entries;
+}
+
+/* evict - remove least recently used entries until under the size cap */
+static void evict() {
+
+	struct cache_entry *entries;
+	char path[4096];
+	long total, cap = cache_size();
+	int count, i;
+
+	entries = scan(&count, &total);
+	for (i = 0; i < count && total > cap; i++) {
+		snprintf(path, sizeof(path), "%s/%s", cache_dir(), entries[i].name);
+		if (unlink(path) == 0) {
+			total -= entries[i].size;
+		}
+	}
+
+	free(entries);
+}
+
+/* commit - rename tmp into place as path, then make room for it */
+static void commit(char *tmp, char *path) {
+
+	if (rename(tmp, path) < 0) {
+		unlink(tmp);
+		return;
+	}
+
+	evict();
+}
+
+/*
+ * cache_store - keep the .icn at src under key. It is put in place under
+ * a temporary name first so a concurrent j0 never sees half an entry.
+ */
+void cache_store(uint64_t key, char *src) {
+
+	char path[4096], tmp[4200];
+
+	if (cache_dir() == NULL) return;
+	entry_path(path, sizeof(path), key, ".icn");
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+
+	if (place(src, tmp) < 0) {
+		unlink(tmp);
+		return;
+	}
+
+	commit(tmp, path);
+}
+
+/* cache_put - keep len bytes of data as the entry with this key and suffix */
+void cache_put(uint64_t key, char *suffix, char *data, size_t len) {
+
+	char path[4096], tmp[4200];
+	FILE *f;
+
+	if (cache_dir() == NULL) return;
+	entry_path(path, sizeof(path), key, suffix);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+
+	if ((f = fopen(tmp, "w")) == NULL) return;
+	if (fwrite(data, 1, len, f) != len || fclose(f) != 0) {
+		unlink(tmp);
+		return;
+	}
+
+	commit(tmp, path);
+}
+
+static double rate(long hits, long misses) {
+	return hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0;
+}
+
+void cache_print_stats(FILE *f) {
+
+	long total[NSTATS], bytes;
+	int count;
+
+	if (update_stats(NULL, total) < 0) {
+		fprintf(f, "\nno compile cache\n\n");
+		return;
+	}
+
+	free(scan(&count, &bytes));
+
+	fprintf(f, "\ncompile cache %s\n", cache_dir());
+	fprintf(f, "files: %ld hits, %ld misses, %.1f%% hit rate\n",
+		total[FILE_HITS], total[FILE_MISSES],
+		rate(total[FILE_HITS], total[FILE_MISSES]));
+	fprintf(f, "methods: %ld reused, %ld compiled, %.1f%% hit rate\n",
+		total[METHOD_HITS], total[METHOD_MISSES],
+		rate(total[METHOD_HITS], total[METHOD_MISSES]));
+	fprintf(f, "%d entries, %ld of %ld bytes\n\n", count, bytes,
+		cache_size());
+}
@@ -0,0 +1,34 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * part of every cache key. The makefile sets it from a checksum of the
+ * compiler's sources, so a j0 built from other sources never reads what
+ * this one stored. Built any other way, it changes with every build.
+ */
+#ifndef J0_VERSION
+#define J0_VERSION "j0 " __DATE__ " " __TIME__
+#endif
+
+#define J0_CACHE_DIR_ENV  "J0_CACHE_DIR"
+#define J0_CACHE_SIZE_ENV "J0_CACHE_SIZE"
+#define J0_CACHE_SIZE     (64L * 1024 * 1024)	/* default cap, in bytes */
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+uint64_t fnv1a(uint64_t h, const void *data, size_t len);
+uint64_t cache_key(const char *source, size_t len, const char *flags);
+
+char *cache_dir();
+int cache_fetch(uint64_t key, char *dest);
+void cache_store(uint64_t key, char *src);
+FILE *cache_open(uint64_t key, char *suffix);
+void cache_put(uint64_t key, char *suffix, char *data, size_t len);
+void cache_count_methods(int hits, int misses);
+void cache_print_stats(FILE *f);
+
+#endif
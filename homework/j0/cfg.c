@@ -0,0 +1,876 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "symboltable.h"
+
+static void *xrealloc(void *p, size_t size) {
+
+	p = realloc(p, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static void *xcalloc(size_t n, size_t size) {
+
+	void *p = calloc(n, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+/*
+ * The offsets of the fields of every class, which the TAC addresses as
+ * R_LOCAL slots just like a method's own. A slot at one of them could be
+ * either, so it is treated as a field.
+ */
+static unsigned char *field_slots;
+static int nfield_slots = -1;
+
+static void find_fields() {
+
+	SymbolTableEntry c, e;
+	int i, j, max = 0;
+
+	nfield_slots = 0;
+	if (globals == NULL) return;
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (i = 0; i < globals->nBuckets; i++) {
+			for (c = globals->tbl[i]; c != NULL; c = c->next) {
+				SymbolTable st;
+
+				if (c->type == NULL || c->type->basetype != CLASS_TYPE) continue;
+				st = c->type->type_sym_table;
+
+				for (j = 0; j < st->nBuckets; j++) {
+					for (e = st->tbl[j]; e != NULL; e = e->next) {
+						int off = e->address->u.offset / 8;
+
+						if (e->type != NULL && (e->type->basetype == FUNC_TYPE ||
+							e->type->basetype == CLASS_TYPE ||
+							e->type->basetype == CONSTRUCT_TYPE)) continue;
+						if (pass == 0) {
+							if (off + 1 > max) max = off + 1;
+						} else {
+							field_slots[off] = 1;
+						}
+					}
+				}
+			}
+		}
+		if (pass == 0) {
+			field_slots = xcalloc(max + 1, 1);
+			nfield_slots = max;
+		}
+	}
+}
+
+static int is_field_slot(int offset) {
+
+	if (nfield_slots < 0) find_fields();
+	return offset >= 0 && offset / 8 < nfield_slots && field_slots[offset / 8];
+}
+
+int addr_equal(struct addr a, struct addr b) {
+
+	if (a.region != b.region || a.tag != b.tag) return 0;
+
+	switch (a.tag) {
+		case OFFSET: return a.u.offset == b.u.offset;
+		case DVAL: return a.u.dval == b.u.dval;
+		case NAME: return a.u.name == b.u.name ||
+			(a.u.name && b.u.name && strcmp(a.u.name, b.u.name) == 0);
+	}
+	return 0;
+}
+
+static unsigned int addr_hash(struct addr *a) {
+
+	unsigned int h = a->region * 31 + a->tag;
+
+	if (a->tag == NAME) {
+		h = h * 37 + hash_name(a->u.name ? a->u.name : "");
+	} else {
+		h = h * 37 + (unsigned int) a->u.offset;
+	}
+	return h;
+}
+
+static int is_variable(struct addr *a) {
+	return a->region == R_LOCAL || a->region == R_GLOBAL || a->region == R_CLASS ||
+		a->region == R_SSA;
+}
+
+/* is_private - a is a variable only its own procedure can see, see cfg.h */
+int is_private(struct addr *a) {
+	return a->region == R_SSA || (a->region == R_LOCAL && a->tag == OFFSET &&
+		a->u.offset % 8 == 0 && !is_field_slot(a->u.offset));
+}
+
+/* cfg_var - the number of the variable at a, -1 if a is not one */
+int cfg_var(struct cfg *g, struct addr *a) {
+
+	int i;
+
+	if (!is_variable(a)) return -1;
+
+	if (2 * (g->nvars + 1) > g->var_hash_size) {
+		int size = g->var_hash_size ? 2 * g->var_hash_size : 64;
+
+		free(g->var_hash);
+		g->var_hash = xcalloc(size, sizeof(int));
+		g->var_hash_size = size;
+		memset(g->var_hash, -1, size * sizeof(int));
+		for (int v = 0; v < g->nvars; v++) {
+			i = addr_hash(&g->vars[v].a) & (size - 1);
+			while (g->var_hash[i] >= 0) i = (i + 1) & (size - 1);
+			g->var_hash[i] = v;
+		}
+	}
+
+	i = addr_hash(a) & (g->var_hash_size - 1);
+	for (; g->var_hash[i] >= 0; i = (i + 1) & (g->var_hash_size - 1)) {
+		if (addr_equal(g->vars[g->var_hash[i]].a, *a)) return g->var_hash[i];
+	}
+
+	if (g->nvars == g->vars_size) {
+		g->vars_size = g->vars_size ? 2 * g->vars_size : 64;
+		g->vars = xrealloc(g->vars, g->vars_size * sizeof(struct var));
+	}
+	memset(&g->vars[g->nvars], 0, sizeof(struct var));
+	g->vars[g->nvars].a = *a;
+	g->vars[g->nvars].private = is_private(a);
+	g->var_hash[i] = g->nvars;
+
+	return g->nvars++;
+}
+
+/* instr_def - the location in writes, NULL if it writes none */
+struct addr *instr_def(struct instr *in) {
+
+	if (in->code_type == DECLARATION) return NULL;
+
+	switch (in->opcode) {
+		case O_ADD: case O_SUB: case O_MUL: case O_DIV: case O_MOD:
+		case O_NEG: case O_NOT: case O_ASN: case O_ADDR: case O_LCONT:
+		case O_CALL:
+			return &in->dest;
+	}
+	return NULL;
+}
+
+/* instr_uses - the locations in reads, into uses[2]; returns how many */
+int instr_uses(struct instr *in, struct addr **uses) {
+
+	int n = 0;
+
+	if (in->code_type == DECLARATION) return 0;
+
+	switch (in->opcode) {
+		case O_ADD: case O_SUB: case O_MUL: case O_DIV: case O_MOD:
+		case O_BLT: case O_BLE: case O_BGT: case O_BGE: case O_BEQ: case O_BNE:
+			uses[n++] = &in->src1;
+			uses[n++] = &in->src2;
+			break;
+		case O_NEG: case O_NOT: case O_ASN: case O_LCONT:
+		case O_BIF: case O_BNIF:
+			uses[n++] = &in->src1;
+			break;
+		case O_SCONT:
+			uses[n++] = &in->dest;
+			uses[n++] = &in->src1;
+			break;
+		case O_PARM: case O_RET:
+			uses[n++] = &in->dest;
+			break;
+	}
+	return n;
+}
+
+/* is_branch - in ends a block */
+int is_branch(struct instr *in) {
+
+	if (in->code_type == DECLARATION) return 0;
+	return (in->opcode >= O_GOTO && in->opcode <= O_BNIF) || in->opcode == O_RET;
+}
+
+/*
+ * has_side_effects - in does something besides setting its dest, so it
+ *  must stay even when nothing reads the dest. A division may trap, and a
+ *  CALL does whatever its procedure does.
+ */
+int has_side_effects(struct instr *in) {
+
+	if (in->code_type == DECLARATION || instr_def(in) == NULL || in->opcode == O_CALL) return 1;
+	if (in->opcode == O_DIV || in->opcode == O_MOD) {
+		return !(in->src2.region == R_CONST && in->src2.tag == OFFSET &&
+			in->src2.u.offset != 0);
+	}
+	return in->opcode == O_ADDR || in->opcode == O_LCONT;
+}
+
+void block_insert(struct block *b, int at, struct instr *in) {
+
+	if (b->ncode == b->code_size) {
+		b->code_size = b->code_size ? 2 * b->code_size : 8;
+		b->code = xrealloc(b->code, b->code_size * sizeof(struct instr *));
+	}
+	memmove(&b->code[at + 1], &b->code[at], (b->ncode - at) * sizeof(struct instr *));
+	b->code[at] = in;
+	b->ncode++;
+}
+
+void block_remove(struct block *b, int at) {
+	memmove(&b->code[at], &b->code[at + 1], (b->ncode - at - 1) * sizeof(struct instr *));
+	b->ncode--;
+}
+
+/* block_start - where b's code starts after its label */
+int block_start(struct block *b) {
+	return b->ncode > 0 && b->code[0]->opcode == D_LABEL;
+}
+
+/* block_end - where code goes at the end of b, before its branch */
+int block_end(struct block *b) {
+	return b->ncode > 0 && is_branch(b->code[b->ncode - 1]) ? b->ncode - 1 : b->ncode;
+}
+
+static void past(int *end, struct addr *a) {
+	if (a->region == R_LOCAL && a->tag == OFFSET && a->u.offset >= *end) {
+		*end = (a->u.offset / 8 + 1) * 8;
+	}
+}
+
+/* frame_start - the first slot past the frame proc declares, and its parameters */
+static int frame_start(struct instr *proc) {
+	return proc->block_bytes > 8 * proc->nparams ? proc->block_bytes : 8 * proc->nparams;
+}
+
+/*
+ * frame_end - the first slot past everything the procedure at proc uses:
+ *  its frame, its parameters, and every slot its list of code names
+ */
+int frame_end(struct instr *proc) {
+
+	int end = frame_start(proc);
+
+	for (struct instr *in = proc->next; in != NULL; in = in->next) {
+		if (in->code_type == DECLARATION && in->opcode == D_PROC) break;
+		past(&end, &in->dest);
+		past(&end, &in->src1);
+		past(&end, &in->src2);
+	}
+	return end;
+}
+
+/* grow_frame - make the frame proc declares reach end */
+static void grow_frame(struct instr *proc, int end) {
+	if (end > proc->block_bytes) proc->block_bytes = end;
+}
+
+/*
+ * new_frame_slot - frame_slot(next) for the procedure at proc, whose
+ *  frame grows to hold it. *next starts at frame_end(proc).
+ */
+struct addr new_frame_slot(struct instr *proc, int *next) {
+
+	struct addr a = frame_slot(next);
+
+	grow_frame(proc, *next);
+	return a;
+}
+
+/*
+ * cfg_new_slot - a frame slot the procedure does not use yet, and that
+ *  no field could be mistaken for. The first is past the frame and its
+ *  parameters, and past every slot the code or its variables use: in SSA
+ *  form the code names none of its private slots, only their values.
+ */
+struct addr cfg_new_slot(struct cfg *g) {
+
+	if (g->next_slot == 0) {
+		g->next_slot = frame_start(g->proc);
+		for (int i = 0; i < g->nblocks; i++) {
+			for (int j = 0; j < g->blocks[i]->ncode; j++) {
+				struct instr *in = g->blocks[i]->code[j];
+
+				past(&g->next_slot, &in->dest);
+				past(&g->next_slot, &in->src1);
+				past(&g->next_slot, &in->src2);
+			}
+		}
+		for (int i = 0; i < g->nvars; i++) past(&g->next_slot, &g->vars[i].a);
+		for (int i = 0; i < g->nssa; i++) past(&g->next_slot, &g->ssa_var[i]);
+	}
+	return new_frame_slot(g->proc, &g->next_slot);
+}
+
+/*
+ * cfg_new_slots - the first of n frame slots in a row the procedure does
+ *  not use yet, none of which a field could be mistaken for
+ */
+struct addr cfg_new_slots(struct cfg *g, int n) {
+
+	for (;;) {
+		struct addr first = cfg_new_slot(g);
+		int i;
+
+		for (i = 1; i < n && !is_field_slot(g->next_slot); i++) g->next_slot += 8;
+		if (i >= n) {
+			grow_frame(g->proc, g->next_slot);
+			return first;
+		}
+	}
+}
+
+/*
+ * frame_slot - the slot at *next, or the first one after it that no field
+ *  could be mistaken for. *next moves past it.
+ */
+struct addr frame_slot(int *next) {
+
+	struct addr a;
+
+	while (is_field_slot(*next)) *next += 8;
+
+	memset(&a, 0, sizeof(a));
+	a.region = R_LOCAL;
+	a.tag = OFFSET;
+	a.u.offset = *next;
+	*next += 8;
+	return a;
+}
+
+static struct block *new_block(struct cfg *g) {
+
+	struct block *b = xcalloc(1, sizeof(struct block));
+
+	if (g->nblocks == g->blocks_size) {
+		g->blocks_size = g->blocks_size ? 2 * g->blocks_size : 16;
+		g->blocks = xrealloc(g->blocks, g->blocks_size * sizeof(struct block *));
+	}
+	b->id = g->nblocks;
+	b->rpo = -1;
+	g->blocks[g->nblocks++] = b;
+	return b;
+}
+
+static void add_edge(struct block *from, struct block *to) {
+
+	if (to == NULL || (from->nsucc == 1 && from->succ[0] == to)) return;
+
+	from->succ[from->nsucc++] = to;
+	if (to->npred == to->pred_size) {
+		to->pred_size = to->pred_size ? 2 * to->pred_size : 4;
+		to->pred = xrealloc(to->pred, to->pred_size * sizeof(struct block *));
+	}
+	to->pred[to->npred++] = from;
+}
+
+/* cfg_remove_edge - the edge from from to to is gone, and its phi args with it */
+void cfg_remove_edge(struct block *from, struct block *to) {
+
+	int i, j, k;
+
+	for (i = 0; i < from->nsucc && from->succ[i] != to; i++);
+	if (i == from->nsucc) return;
+	for (; i + 1 < from->nsucc; i++) from->succ[i] = from->succ[i + 1];
+	from->nsucc--;
+
+	for (j = 0; j < to->npred && to->pred[j] != from; j++);
+	for (i = j; i + 1 < to->npred; i++) {
+		to->pred[i] = to->pred[i + 1];
+		for (k = 0; k < to->nphis; k++) to->phis[k].args[i] = to->phis[k].args[i + 1];
+	}
+	to->npred--;
+}
+
+/*
+ * cfg_remove_unreachable - empty the blocks cfg_dominators() found no
+ *  path to, and drop their edges. Returns how many instructions went.
+ */
+int cfg_remove_unreachable(struct cfg *g) {
+
+	int removed = 0;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		if (b->rpo >= 0) continue;
+		removed += b->ncode;
+		b->ncode = 0;
+		while (b->nsucc > 0) cfg_remove_edge(b, b->succ[0]);
+		for (int j = 0; j < b->nphis; j++) free(b->phis[j].args);
+		b->nphis = 0;
+	}
+	return removed;
+}
+
+/*
+ * build_cfg - the graph of the procedure declared by proc, whose body is
+ *  the list from body up to the next D_PROC. A branch to a label the
+ *  procedure does not have leaves it.
+ */
+struct cfg *build_cfg(struct instr *proc, struct instr *body) {
+
+	struct cfg *g = xcalloc(1, sizeof(struct cfg));
+	struct block *b = NULL, **by_label;
+	struct instr *in;
+	int min_label = 0, max_label = -1, i;
+
+	g->proc = proc;
+
+	/* the entry must not be a branch target, give it a block of its own */
+	if (body != NULL && body->opcode == D_LABEL) b = new_block(g);
+
+	for (in = body; in != NULL && in->opcode != D_PROC; in = in->next) {
+		if (in->opcode == D_LABEL) {
+			if (max_label < min_label) {
+				min_label = max_label = in->dest.u.offset;
+			}
+			if (in->dest.u.offset < min_label) min_label = in->dest.u.offset;
+			if (in->dest.u.offset > max_label) max_label = in->dest.u.offset;
+		}
+
+		if (b == NULL || in->opcode == D_LABEL ||
+			(b->ncode > 0 && is_branch(b->code[b->ncode - 1]))) {
+			b = new_block(g);
+		}
+		block_insert(b, b->ncode, in);
+	}
+	if (g->nblocks == 0) new_block(g);
+
+	by_label = xcalloc(max_label - min_label + 1, sizeof(struct block *));
+	for (i = 0; i < g->nblocks; i++) {
+		b = g->blocks[i];
+		if (b->ncode > 0 && b->code[0]->opcode == D_LABEL) {
+			by_label[b->code[0]->dest.u.offset - min_label] = b;
+		}
+	}
+
+	for (i = 0; i < g->nblocks; i++) {
+		struct block *next = i + 1 < g->nblocks ? g->blocks[i + 1] : NULL;
+		struct block *target = NULL;
+
+		b = g->blocks[i];
+		in = b->ncode > 0 ? b->code[b->ncode - 1] : NULL;
+
+		if (in == NULL || !is_branch(in)) {
+			add_edge(b, next);
+			continue;
+		}
+		if (in->opcode == O_RET) continue;
+
+		if (in->dest.u.offset >= min_label && in->dest.u.offset <= max_label) {
+			target = by_label[in->dest.u.offset - min_label];
+		}
+		if (in->opcode != O_GOTO) add_edge(b, next);
+		add_edge(b, target);
+	}
+
+	free(by_label);
+	return g;
+}
+
+/* linearize_cfg - relink the blocks into one list, D_PROC first */
+struct instr *linearize_cfg(struct cfg *g, struct instr **tail) {
+
+	struct instr *last = g->proc;
+	int i, j;
+
+	for (i = 0; i < g->nblocks; i++) {
+		for (j = 0; j < g->blocks[i]->ncode; j++) {
+			last->next = g->blocks[i]->code[j];
+			last = last->next;
+		}
+	}
+	last->next = NULL;
+	*tail = last;
+
+	return g->proc;
+}
+
+static void free_loops(struct cfg *g) {
+
+	for (int i = 0; i < g->nloops; i++) {
+		free(g->loops[i]->body);
+		free(g->loops[i]);
+	}
+	free(g->loops);
+	g->loops = NULL;
+	g->nloops = 0;
+}
+
+void free_cfg(struct cfg *g) {
+
+	for (int i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		free(b->code);
+		free(b->pred);
+		free(b->dom_kids);
+		free(b->live_in);
+		free(b->live_out);
+		for (int j = 0; j < b->nphis; j++) free(b->phis[j].args);
+		free(b->phis);
+		free(b->frontier);
+		free(b);
+	}
+	free(g->blocks);
+	free(g->rpo_order);
+	free(g->vars);
+	free(g->var_hash);
+	free(g->ssa_var);
+	free_loops(g);
+	free(g);
+}
+
+/* number the reachable blocks in reverse postorder, without recursion */
+static void number_rpo(struct cfg *g) {
+
+	struct block **stack = xcalloc(g->nblocks + 1, sizeof(struct block *));
+	int *next_succ = xcalloc(g->nblocks, sizeof(int));
+	char *seen = xcalloc(g->nblocks, 1);
+	int top = 0, n = 0, i;
+
+	free(g->rpo_order);
+	g->rpo_order = xcalloc(g->nblocks, sizeof(struct block *));
+	for (i = 0; i < g->nblocks; i++) g->blocks[i]->rpo = -1;
+
+	stack[top++] = g->blocks[0];
+	seen[0] = 1;
+	while (top > 0) {
+		struct block *b = stack[top - 1];
+
+		if (next_succ[b->id] < b->nsucc) {
+			struct block *s = b->succ[next_succ[b->id]++];
+
+			if (!seen[s->id]) {
+				seen[s->id] = 1;
+				stack[top++] = s;
+			}
+		} else {
+			g->rpo_order[n++] = b;
+			top--;
+		}
+	}
+
+	/* that was postorder */
+	for (i = 0; i < n / 2; i++) {
+		struct block *t = g->rpo_order[i];
+		g->rpo_order[i] = g->rpo_order[n - 1 - i];
+		g->rpo_order[n - 1 - i] = t;
+	}
+	for (i = 0; i < n; i++) g->rpo_order[i]->rpo = i;
+	g->nrpo = n;
+
+	free(stack);
+	free(next_succ);
+	free(seen);
+}
+
+static struct block *intersect(struct block *a, struct block *b) {
+
+	while (a != b) {
+		while (a->rpo > b->rpo) a = a->idom;
+		while (b->rpo > a->rpo) b = b->idom;
+	}
+	return a;
+}
+
+/*
+ * cfg_dominators - the dominator tree of the reachable blocks, by the
+ *  iterative algorithm of Cooper, Harvey and Kennedy. Unreachable blocks
+ *  get no idom and dominate nothing.
+ */
+void cfg_dominators(struct cfg *g) {
+
+	struct block *entry, **stack;
+	int changed = 1, i, j, top = 0, counter = 0;
+
+	number_rpo(g);
+	entry = g->rpo_order[0];
+
+	for (i = 0; i < g->nblocks; i++) {
+		g->blocks[i]->idom = NULL;
+		g->blocks[i]->ndom_kids = 0;
+	}
+	entry->idom = entry;
+
+	while (changed) {
+		changed = 0;
+		for (i = 1; i < g->nrpo; i++) {
+			struct block *b = g->rpo_order[i], *idom = NULL;
+
+			for (j = 0; j < b->npred; j++) {
+				struct block *p = b->pred[j];
+
+				if (p->rpo < 0 || p->idom == NULL) continue;
+				idom = idom == NULL ? p : intersect(p, idom);
+			}
+			if (idom != b->idom) {
+				b->idom = idom;
+				changed = 1;
+			}
+		}
+	}
+	entry->idom = NULL;
+
+	for (i = 1; i < g->nrpo; i++) {
+		struct block *b = g->rpo_order[i], *d = b->idom;
+
+		d->dom_kids = xrealloc(d->dom_kids, (d->ndom_kids + 1) * sizeof(struct block *));
+		d->dom_kids[d->ndom_kids++] = b;
+	}
+
+	/* preorder and postorder numbers of the tree, for dominates() */
+	stack = xcalloc(g->nrpo + 1, sizeof(struct block *));
+	int *next_kid = xcalloc(g->nblocks, sizeof(int));
+
+	for (i = 0; i < g->nblocks; i++) {
+		g->blocks[i]->dom_pre = g->blocks[i]->dom_post = -1;
+	}
+	stack[top++] = entry;
+	entry->dom_pre = counter++;
+	while (top > 0) {
+		struct block *b = stack[top - 1];
+
+		if (next_kid[b->id] < b->ndom_kids) {
+			struct block *k = b->dom_kids[next_kid[b->id]++];
+
+			k->dom_pre = counter++;
+			stack[top++] = k;
+		} else {
+			b->dom_post = counter++;
+			top--;
+		}
+	}
+
+	free(next_kid);
+	free(stack);
+}
+
+/* dominates - every path from the entry to b goes through a */
+int dominates(struct block *a, struct block *b) {
+	return a->dom_pre >= 0 && b->dom_pre >= 0 &&
+		a->dom_pre <= b->dom_pre && b->dom_post <= a->dom_post;
+}
+
+/*
+ * cfg_count_defs - number every variable the procedure uses, and count
+ *  how often each is written, and where if only once.
+ */
+void cfg_count_defs(struct cfg *g) {
+
+	int i, j, k, v;
+
+	for (v = 0; v < g->nvars; v++) g->vars[v].ndefs = 0;
+
+	for (i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		for (j = 0; j < b->ncode; j++) {
+			struct addr *uses[2], *d = instr_def(b->code[j]);
+			int n = instr_uses(b->code[j], uses);
+
+			for (k = 0; k < n; k++) cfg_var(g, uses[k]);
+			if (d == NULL || (v = cfg_var(g, d)) < 0) continue;
+			if (g->vars[v].ndefs++ == 0) {
+				g->vars[v].def_block = b;
+				g->vars[v].def_index = j;
+			}
+		}
+	}
+}
+
+/*
+ * cfg_liveness - the private variables live into and out of each block.
+ *  Memory is always live, so it is not tracked. Counts the defs too.
+ */
+void cfg_liveness(struct cfg *g) {
+
+	unsigned long *use, *def;
+	int changed = 1, words, i, j, k, w;
+
+	cfg_count_defs(g);
+	words = (g->nvars + 8 * sizeof(long) - 1) / (8 * sizeof(long));
+	if (words == 0) words = 1;
+	g->live_words = words;
+	use = xcalloc((size_t) words * g->nblocks, sizeof(long));
+	def = xcalloc((size_t) words * g->nblocks, sizeof(long));
+
+	for (i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+		unsigned long *u = use + (size_t) i * words, *d = def + (size_t) i * words;
+
+		free(b->live_in);
+		free(b->live_out);
+		b->live_in = xcalloc(words, sizeof(long));
+		b->live_out = xcalloc(words, sizeof(long));
+
+		for (j = 0; j < b->ncode; j++) {
+			struct addr *uses[2], *dst;
+			int n = instr_uses(b->code[j], uses), v;
+
+			for (k = 0; k < n; k++) {
+				if ((v = cfg_var(g, uses[k])) < 0 || !g->vars[v].private) continue;
+				if (!live_test(d, v)) u[v / (8 * sizeof(long))] |= 1UL << (v % (8 * sizeof(long)));
+			}
+			if ((dst = instr_def(b->code[j])) != NULL && (v = cfg_var(g, dst)) >= 0 &&
+				g->vars[v].private) {
+				d[v / (8 * sizeof(long))] |= 1UL << (v % (8 * sizeof(long)));
+			}
+		}
+	}
+
+	while (changed) {
+		changed = 0;
+		for (i = g->nblocks - 1; i >= 0; i--) {
+			struct block *b = g->blocks[i];
+			unsigned long *u = use + (size_t) i * words, *d = def + (size_t) i * words;
+
+			for (w = 0; w < words; w++) {
+				unsigned long out = 0, in;
+
+				for (k = 0; k < b->nsucc; k++) out |= b->succ[k]->live_in[w];
+				in = u[w] | (out & ~d[w]);
+				if (out != b->live_out[w] || in != b->live_in[w]) {
+					b->live_out[w] = out;
+					b->live_in[w] = in;
+					changed = 1;
+				}
+			}
+		}
+	}
+
+	free(use);
+	free(def);
+}
+
+static struct loop *loop_at(struct cfg *g, struct block *header) {
+
+	struct loop *l;
+
+	for (int i = 0; i < g->nloops; i++) {
+		if (g->loops[i]->header == header) return g->loops[i];
+	}
+
+	l = xcalloc(1, sizeof(struct loop));
+	l->header = header;
+	l->body = xcalloc(g->nblocks, 1);
+	l->body[header->id] = 1;
+	l->nblocks = 1;
+	g->loops = xrealloc(g->loops, (g->nloops + 1) * sizeof(struct loop *));
+	g->loops[g->nloops++] = l;
+	return l;
+}
+
+static int smaller_loop(const void *a, const void *b) {
+	return (*(struct loop **) a)->nblocks - (*(struct loop **) b)->nblocks;
+}
+
+/*
+ * find_loops - the natural loops, from the back edges: an edge into a
+ *  block that dominates where it comes from. Sets each block's innermost
+ *  loop, and each loop's nesting and preheader.
+ */
+void find_loops(struct cfg *g) {
+
+	struct block **work = xcalloc(g->nblocks + 1, sizeof(struct block *));
+	int i, j, k, top;
+
+	free_loops(g);
+	cfg_dominators(g);
+
+	for (i = 0; i < g->nrpo; i++) {
+		struct block *b = g->rpo_order[i];
+
+		for (j = 0; j < b->nsucc; j++) {
+			struct block *h = b->succ[j];
+			struct loop *l;
+
+			if (!dominates(h, b)) continue;
+
+			/* walk back from the latch to the header */
+			l = loop_at(g, h);
+			top = 0;
+			if (!l->body[b->id]) {
+				l->body[b->id] = 1;
+				l->nblocks++;
+				work[top++] = b;
+			}
+			while (top > 0) {
+				struct block *m = work[--top];
+
+				for (k = 0; k < m->npred; k++) {
+					struct block *p = m->pred[k];
+
+					if (p->rpo < 0 || l->body[p->id]) continue;
+					l->body[p->id] = 1;
+					l->nblocks++;
+					work[top++] = p;
+				}
+			}
+		}
+	}
+	free(work);
+
+	if (g->nloops > 1) qsort(g->loops, g->nloops, sizeof(struct loop *), smaller_loop);
+
+	for (i = 0; i < g->nblocks; i++) g->blocks[i]->loop = NULL;
+	for (i = 0; i < g->nloops; i++) {
+		struct loop *l = g->loops[i];
+		struct block *in = NULL;
+		int outside = 0;
+
+		for (j = 0; j < g->nblocks; j++) {
+			if (l->body[j] && g->blocks[j]->loop == NULL) g->blocks[j]->loop = l;
+		}
+		for (j = i + 1; j < g->nloops && l->parent == NULL; j++) {
+			if (g->loops[j]->body[l->header->id]) l->parent = g->loops[j];
+		}
+
+		for (j = 0; j < l->header->npred; j++) {
+			if (!l->body[l->header->pred[j]->id]) {
+				in = l->header->pred[j];
+				outside++;
+			}
+		}
+		l->preheader = outside == 1 && in->nsucc == 1 ? in : NULL;
+	}
+	for (i = g->nloops - 1; i >= 0; i--) {
+		struct loop *l = g->loops[i];
+
+		l->depth = l->parent ? l->parent->depth + 1 : 1;
+	}
+}
+
+/*
+ * cfg_weighted_size - the instructions of the procedure, each counted ten
+ *  times over for every loop it is in: a rough measure of how many of
+ *  them run, for the optimizer's report.
+ */
+long cfg_weighted_size(struct cfg *g) {
+
+	long size = 0;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+		long weight = 1;
+
+		for (int d = b->loop ? b->loop->depth : 0; d > 0 && weight < 1000000; d--) {
+			weight *= 10;
+		}
+		for (int j = 0; j < b->ncode; j++) {
+			if (b->code[j]->code_type != DECLARATION) size += weight;
+		}
+	}
+	return size;
+}
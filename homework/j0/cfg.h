@@ -0,0 +1,137 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "tac.h"
+
+/*
+ * The control flow graph of one procedure, for the optimizer.
+ *
+ * A block is a run of instructions entered only at the top: it starts at
+ * a label or after a branch, and ends at a branch, a RETURN, or before
+ * the next label. blocks[0] is the entry. The blocks are kept in their
+ * original layout order, so a block without a branch at its end falls
+ * through to blocks[id + 1].
+ *
+ * Every location an instruction reads or writes is a variable, numbered
+ * per procedure. A variable is private when it is a slot of the frame
+ * that nothing outside the procedure can see. The rest, the fields (a
+ * field is an R_LOCAL slot of its class, indistinguishable in the TAC
+ * from a local at the same offset) and anything global, are memory: a
+ * CALL may change them and they are live when the procedure returns.
+ *
+ * In SSA form (see ssa.c) every def of a private variable writes a new
+ * R_SSA value instead, and a block starts with a phi for each variable
+ * that reaches it with different values from its predecessors.
+ */
+
+struct phi {
+	struct addr dest;
+	struct addr *args;		/* one per predecessor, in the order of pred */
+	int var;			/* the variable it merges */
+};
+
+struct loop;
+
+struct block {
+	int id;
+	struct instr **code;
+	int ncode, code_size;
+
+	struct block *succ[2];		/* fall through first, then the branch target */
+	int nsucc;
+	struct block **pred;
+	int npred, pred_size;
+
+	struct block *idom;		/* immediate dominator, NULL for the entry */
+	struct block **dom_kids;
+	int ndom_kids;
+	int dom_pre, dom_post;		/* dominator tree numbering */
+	int rpo;			/* reverse postorder number, -1 if unreachable */
+
+	unsigned long *live_in, *live_out;	/* private variables, see cfg_liveness() */
+
+	struct phi *phis;
+	int nphis, phis_size;
+	struct block **frontier;	/* dominance frontier */
+	int nfrontier;
+
+	struct loop *loop;		/* the innermost loop it is in, see find_loops() */
+};
+
+/*
+ * A natural loop: the blocks that reach a back edge into header without
+ * going through it. Loops with the same header are one loop.
+ */
+struct loop {
+	struct block *header;
+	struct block *preheader;	/* the one way in, NULL if there is none */
+	char *body;			/* per block id, whether it is in the loop */
+	int nblocks;
+	int depth;			/* 1 for an outermost loop */
+	struct loop *parent;
+};
+
+struct var {
+	struct addr a;
+	int private;
+	int ndefs;
+	struct block *def_block;	/* of its only def, when ndefs == 1 */
+	int def_index;
+};
+
+struct cfg {
+	struct instr *proc;		/* its D_PROC */
+	struct block **blocks;
+	int nblocks, blocks_size;
+	struct block **rpo_order;	/* the reachable blocks, in reverse postorder */
+	int nrpo;
+
+	struct var *vars;
+	int nvars, vars_size;
+	int *var_hash;			/* open addressing, -1 for empty */
+	int var_hash_size;
+	int live_words;			/* of a live set */
+
+	struct addr *ssa_var;		/* the variable each R_SSA value renames */
+	int nssa, ssa_size;
+	int next_slot;			/* offset of the next new frame slot, see cfg_new_slot() */
+
+	struct loop **loops;		/* innermost first */
+	int nloops;
+};
+
+struct cfg *build_cfg(struct instr *proc, struct instr *body);
+struct instr *linearize_cfg(struct cfg *g, struct instr **tail);
+void free_cfg(struct cfg *g);
+
+void cfg_dominators(struct cfg *g);
+int dominates(struct block *a, struct block *b);
+void cfg_count_defs(struct cfg *g);
+void cfg_liveness(struct cfg *g);
+void find_loops(struct cfg *g);
+long cfg_weighted_size(struct cfg *g);
+
+void cfg_remove_edge(struct block *from, struct block *to);
+int cfg_remove_unreachable(struct cfg *g);
+struct addr cfg_new_slot(struct cfg *g);
+struct addr cfg_new_slots(struct cfg *g, int n);
+struct addr frame_slot(int *next);
+int frame_end(struct instr *proc);
+struct addr new_frame_slot(struct instr *proc, int *next);
+
+void block_insert(struct block *b, int at, struct instr *in);
+void block_remove(struct block *b, int at);
+int block_start(struct block *b);
+int block_end(struct block *b);
+
+int addr_equal(struct addr a, struct addr b);
+int is_private(struct addr *a);
+int cfg_var(struct cfg *g, struct addr *a);
+struct addr *instr_def(struct instr *in);
+int instr_uses(struct instr *in, struct addr **uses);
+int is_branch(struct instr *in);
+int has_side_effects(struct instr *in);
+
+#define live_test(set, v) ((set)[(v) / (8 * sizeof(long))] & (1UL << ((v) % (8 * sizeof(long)))))
+
+#endif
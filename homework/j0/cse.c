@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * Common subexpression elimination.
+ *
+ * Within a block, local value numbering: every value a block computes
+ * or reads gets a number, and an operation on numbers already seen
+ * together is the value some variable still holds, so it becomes a copy
+ * of that variable. Operands are rewritten to the variable that first
+ * held their value, or to the constant it is, so the copies themselves
+ * usually die and are removed at the end.
+ *
+ * Across blocks, a computation is reused in the blocks its block
+ * dominates, walking the dominator tree with a scoped table. That is only
+ * sound for values that cannot change in between, so the operands and
+ * the variable holding the result must be stable: constants, or private
+ * variables written at most once in the procedure, by a def that comes
+ * before the computation on every path. (Temporaries are, and at -O2
+ * the SSA form makes most locals so too.) A CALL may change
+ * any memory, so memory is never stable, and its local value numbers are
+ * dropped at every CALL.
+ */
+
+struct expr {
+	int op, a, b;		/* operands: value numbers, or variables and constants */
+	int value;		/* a value number, or the variable holding it */
+	int next;		/* in its bucket */
+};
+
+/* a hash table of expressions whose entries are removed newest first */
+struct exprtab {
+	struct expr *e;
+	int n, size;
+	int *bucket;
+	int nbuckets;
+};
+
+struct lvn {
+	struct cfg *g;
+	struct exprtab local, global;
+
+	/* per variable: its value number in the current block */
+	int *var_vn, *var_stamp, *var_epoch;
+	int stamp, epoch;
+
+	/* per value number: who holds it, and which constant it is */
+	int *holder;
+	struct addr *konst;
+	char *is_const;
+	int nvalues, values_size;
+
+	/* constants, numbered as operands -2, -3, ... */
+	struct addr *consts;
+	int *const_vn;
+	int nconsts, consts_size;
+
+	struct opt_stats *stats;
+};
+
+static void *xrealloc(void *p, size_t size) {
+
+	p = realloc(p, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static unsigned int expr_hash(int op, int a, int b) {
+	return ((unsigned int) op * 31 + (unsigned int) a) * 1000003u + (unsigned int) b;
+}
+
+static int expr_find(struct exprtab *t, int op, int a, int b) {
+
+	int i;
+
+	if (t->nbuckets == 0) return -1;
+
+	for (i = t->bucket[expr_hash(op, a, b) & (t->nbuckets - 1)]; i >= 0; i = t->e[i].next) {
+		if (t->e[i].op == op && t->e[i].a == a && t->e[i].b == b) return t->e[i].value;
+	}
+	return -1;
+}
+
+static void expr_add(struct exprtab *t, int op, int a, int b, int value) {
+
+	int h;
+
+	if (t->n == t->size) {
+		t->size = t->size ? 2 * t->size : 64;
+		t->e = xrealloc(t->e, t->size * sizeof(struct expr));
+	}
+	if (t->nbuckets == 0) {
+		t->nbuckets = 1024;
+		t->bucket = xrealloc(NULL, t->nbuckets * sizeof(int));
+		memset(t->bucket, -1, t->nbuckets * sizeof(int));
+	}
+
+	h = expr_hash(op, a, b) & (t->nbuckets - 1);
+	t->e[t->n].op = op;
+	t->e[t->n].a = a;
+	t->e[t->n].b = b;
+	t->e[t->n].value = value;
+	t->e[t->n].next = t->bucket[h];
+	t->bucket[h] = t->n++;
+}
+
+/* expr_undo - remove the entries added since the table had mark of them */
+static void expr_undo(struct exprtab *t, int mark) {
+
+	while (t->n > mark) {
+		struct expr *e = &t->e[--t->n];
+		t->bucket[expr_hash(e->op, e->a, e->b) & (t->nbuckets - 1)] = e->next;
+	}
+}
+
+static int commutative(int op) {
+	return op == O_ADD || op == O_MUL;
+}
+
+static int new_value(struct lvn *l, int holder) {
+
+	if (l->nvalues == l->values_size) {
+		l->values_size = l->values_size ? 2 * l->values_size : 256;
+		l->holder = xrealloc(l->holder, l->values_size * sizeof(int));
+		l->is_const = xrealloc(l->is_const, l->values_size);
+		l->konst = xrealloc(l->konst, l->values_size * sizeof(struct addr));
+	}
+	l->holder[l->nvalues] = holder;
+	l->is_const[l->nvalues] = 0;
+	return l->nvalues++;
+}
+
+/* const_id - the operand number of the constant at a */
+static int const_id(struct lvn *l, struct addr *a) {
+
+	int i, vn;
+
+	for (i = 0; i < l->nconsts; i++) {
+		if (addr_equal(l->consts[i], *a)) return -2 - i;
+	}
+
+	if (l->nconsts == l->consts_size) {
+		l->consts_size = l->consts_size ? 2 * l->consts_size : 32;
+		l->consts = xrealloc(l->consts, l->consts_size * sizeof(struct addr));
+		l->const_vn = xrealloc(l->const_vn, l->consts_size * sizeof(int));
+	}
+	vn = new_value(l, -1);
+	l->is_const[vn] = 1;
+	l->konst[vn] = *a;
+	l->consts[l->nconsts] = *a;
+	l->const_vn[l->nconsts] = vn;
+
+	return -2 - l->nconsts++;
+}
+
+/* current - v holds its value number of this block, since the last CALL if memory */
+static int current(struct lvn *l, int v) {
+	return l->var_stamp[v] == l->stamp &&
+		(l->g->vars[v].private || l->var_epoch[v] == l->epoch);
+}
+
+static void set_vn(struct lvn *l, int v, int vn) {
+
+	l->var_vn[v] = vn;
+	l->var_stamp[v] = l->stamp;
+	l->var_epoch[v] = l->epoch;
+	if (l->holder[vn] < 0 || !current(l, l->holder[vn]) ||
+		l->var_vn[l->holder[vn]] != vn) {
+		l->holder[vn] = v;
+	}
+}
+
+/* operand_vn - the value number of what an operand holds, -1 for none */
+static int operand_vn(struct lvn *l, struct addr *a) {
+
+	int v = cfg_var(l->g, a);
+
+	if (v >= 0) {
+		if (!current(l, v)) set_vn(l, v, new_value(l, v));
+		return l->var_vn[v];
+	}
+	if (a->region == R_CONST) {
+		int c = const_id(l, a);
+		return l->const_vn[-2 - c];
+	}
+	return -1;
+}
+
+/* holds - v still has value number vn */
+static int holds(struct lvn *l, int v, int vn) {
+	return v >= 0 && current(l, v) && l->var_vn[v] == vn;
+}
+
+/*
+ * stable_operand - the operand number of a, if its value at instruction
+ *  j of b is the same wherever b's dominators computed it; -1 if not.
+ */
+static int stable_operand(struct lvn *l, struct addr *a, struct block *b, int j) {
+
+	int v = cfg_var(l->g, a);
+	struct var *var;
+
+	if (v < 0) return a->region == R_CONST ? const_id(l, a) : -1;
+
+	var = &l->g->vars[v];
+	if (!var->private || var->ndefs > 1) return -1;
+	if (var->ndefs == 1 && !(var->def_block == b ? var->def_index < j :
+		dominates(var->def_block, b))) return -1;
+	return v;
+}
+
+/* propagate - rewrite operand a to the oldest holder of its value, or its constant */
+static void propagate(struct lvn *l, struct addr *a) {
+
+	int vn = operand_vn(l, a), h;
+
+	if (vn < 0) return;
+
+	if (l->is_const[vn]) {
+		if (!addr_equal(*a, l->konst[vn])) {
+			*a = l->konst[vn];
+			l->stats->copies++;
+		}
+	} else if ((h = l->holder[vn]) >= 0 && holds(l, h, vn) &&
+		!addr_equal(*a, l->g->vars[h].a)) {
+		*a = l->g->vars[h].a;
+		l->stats->copies++;
+	}
+}
+
+static void kill_memory(struct lvn *l) {
+	l->epoch++;
+}
+
+static void number_block(struct lvn *l, struct block *b) {
+
+	int j, k;
+
+	l->stamp++;
+	kill_memory(l);
+
+	for (j = 0; j < b->ncode; j++) {
+		struct instr *in = b->code[j];
+		struct addr *uses[2], *d;
+		int n = instr_uses(in, uses), dv, vn1, vn2, vn, h;
+
+		for (k = 0; k < n; k++) propagate(l, uses[k]);
+
+		/* a CALL may change any memory, and its result gets a new value below */
+		if (in->code_type != DECLARATION && in->opcode == O_CALL) kill_memory(l);
+
+		if ((d = instr_def(in)) == NULL) continue;
+		dv = cfg_var(l->g, d);
+
+		if (in->opcode == O_ASN) {
+			vn = operand_vn(l, &in->src1);
+			if (vn >= 0 && holds(l, dv, vn)) {
+				/* it already has that value */
+				block_remove(b, j--);
+				l->stats->removed++;
+				continue;
+			}
+			if (dv >= 0) set_vn(l, dv, vn >= 0 ? vn : new_value(l, dv));
+			continue;
+		}
+
+		if (has_side_effects(in) || (in->opcode != O_NEG && in->opcode != O_NOT &&
+			in->opcode != O_ADD && in->opcode != O_SUB && in->opcode != O_MUL &&
+			in->opcode != O_DIV && in->opcode != O_MOD)) {
+			if (dv >= 0) set_vn(l, dv, new_value(l, dv));
+			continue;
+		}
+
+		vn1 = operand_vn(l, &in->src1);
+		vn2 = n > 1 ? operand_vn(l, &in->src2) : -1;
+		if (commutative(in->opcode) && vn1 > vn2) {
+			int t = vn1; vn1 = vn2; vn2 = t;
+		}
+
+		/* computed in this block */
+		vn = vn1 >= 0 && (n == 1 || vn2 >= 0) ?
+			expr_find(&l->local, in->opcode, vn1, vn2) : -1;
+		if (vn >= 0 && (h = l->holder[vn]) >= 0 && holds(l, h, vn)) {
+			if (h == dv) {
+				block_remove(b, j--);
+				l->stats->removed++;
+				continue;
+			}
+			in->opcode = O_ASN;
+			in->src1 = l->g->vars[h].a;
+			in->src2.region = R_NONE;
+			l->stats->cse_local++;
+			if (dv >= 0) set_vn(l, dv, vn);
+			continue;
+		}
+
+		/* computed in a dominator */
+		int s1 = stable_operand(l, &in->src1, b, j);
+		int s2 = n > 1 ? stable_operand(l, &in->src2, b, j) : -1;
+
+		if (commutative(in->opcode) && s1 > s2) {
+			int t = s1; s1 = s2; s2 = t;
+		}
+		if (s1 != -1 && (n == 1 || s2 != -1)) {
+			h = expr_find(&l->global, in->opcode, s1, s2);
+			if (h >= 0 && h != dv) {
+				in->opcode = O_ASN;
+				in->src1 = l->g->vars[h].a;
+				in->src2.region = R_NONE;
+				l->stats->cse_global++;
+				if (dv >= 0) set_vn(l, dv, operand_vn(l, &in->src1));
+				continue;
+			}
+		}
+
+		vn = new_value(l, dv);
+		if (dv >= 0) set_vn(l, dv, vn);
+		if (vn1 >= 0 && (n == 1 || vn2 >= 0)) {
+			expr_add(&l->local, in->opcode, vn1, vn2, vn);
+		}
+		if (s1 != -1 && (n == 1 || s2 != -1) && dv >= 0 &&
+			l->g->vars[dv].private && l->g->vars[dv].ndefs == 1) {
+			expr_add(&l->global, in->opcode, s1, s2, dv);
+		}
+	}
+
+	expr_undo(&l->local, 0);
+}
+
+/*
+ * cse - value number each block, and reuse what dominating blocks
+ *  computed, walking the dominator tree.
+ */
+int cse(struct cfg *g, struct opt_stats *stats) {
+
+	struct lvn l;
+	struct block **stack;
+	int *next_kid, *mark, top = 0, before = stats->cse_local + stats->cse_global;
+
+	memset(&l, 0, sizeof(l));
+	l.g = g;
+	l.stats = stats;
+
+	cfg_dominators(g);
+	cfg_count_defs(g);
+	l.var_vn = calloc(g->nvars + 1, sizeof(int));
+	l.var_stamp = calloc(g->nvars + 1, sizeof(int));
+	l.var_epoch = calloc(g->nvars + 1, sizeof(int));
+	stack = calloc(g->nblocks + 1, sizeof(struct block *));
+	next_kid = calloc(g->nblocks + 1, sizeof(int));
+	mark = calloc(g->nblocks + 1, sizeof(int));
+	if (!l.var_vn || !l.var_stamp || !l.var_epoch || !stack || !next_kid || !mark) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+
+	stack[top++] = g->rpo_order[0];
+	mark[g->rpo_order[0]->id] = 0;
+	number_block(&l, g->rpo_order[0]);
+
+	while (top > 0) {
+		struct block *b = stack[top - 1];
+
+		if (next_kid[b->id] < b->ndom_kids) {
+			struct block *k = b->dom_kids[next_kid[b->id]++];
+
+			mark[k->id] = l.global.n;
+			number_block(&l, k);
+			stack[top++] = k;
+		} else {
+			expr_undo(&l.global, mark[b->id]);
+			top--;
+		}
+	}
+
+	free(l.var_vn);
+	free(l.var_stamp);
+	free(l.var_epoch);
+	free(l.holder);
+	free(l.konst);
+	free(l.is_const);
+	free(l.consts);
+	free(l.const_vn);
+	free(l.local.e);
+	free(l.local.bucket);
+	free(l.global.e);
+	free(l.global.bucket);
+	free(stack);
+	free(next_kid);
+	free(mark);
+
+	return stats->cse_local + stats->cse_global - before;
+}
+
+/*
+ * dead_code - remove the instructions that only set a private variable
+ *  nobody reads afterwards, until there are none.
+ */
+int dead_code(struct cfg *g, struct opt_stats *stats) {
+
+	int removed = 0, changed = 1;
+
+	while (changed) {
+		unsigned long *live;
+		int i, j, k;
+
+		changed = 0;
+		cfg_liveness(g);
+		live = malloc(g->live_words * sizeof(long));
+
+		for (i = 0; i < g->nblocks; i++) {
+			struct block *b = g->blocks[i];
+
+			memcpy(live, b->live_out, g->live_words * sizeof(long));
+			for (j = b->ncode - 1; j >= 0; j--) {
+				struct instr *in = b->code[j];
+				struct addr *uses[2], *d = instr_def(in);
+				int n, v = d ? cfg_var(g, d) : -1;
+
+				if (v >= 0 && g->vars[v].private && !live_test(live, v) &&
+					!has_side_effects(in)) {
+					block_remove(b, j);
+					removed++;
+					changed = 1;
+					continue;
+				}
+
+				if (v >= 0 && g->vars[v].private) {
+					live[v / (8 * sizeof(long))] &= ~(1UL << (v % (8 * sizeof(long))));
+				}
+				n = instr_uses(in, uses);
+				for (k = 0; k < n; k++) {
+					int u = cfg_var(g, uses[k]);
+
+					if (u >= 0 && g->vars[u].private) {
+						live[u / (8 * sizeof(long))] |= 1UL << (u % (8 * sizeof(long)));
+					}
+				}
+			}
+		}
+		free(live);
+	}
+
+	stats->removed += removed;
+	return removed;
+}
@@ -12,6 +12,7 @@ extern int yylex();
 extern int yyparse();
 extern int yyerror(const char *s);
 extern int yylineno;
+extern int yycolno;
 extern char *yytext;
 extern char *filename;
 
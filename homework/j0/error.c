@@ -1,34 +1,190 @@
+#include <pthread.h>
+
 #include "error.h"
+#include "tree.h"
+
+/*
+ * Errors are not fatal as they are found: each one is appended to the
+ * diagnostics buffer and the compiler keeps going, so a single run can
+ * report every mistake in a file. flush_diagnostics() prints them at the
+ * end, sorted by position with duplicates removed.
+ *
+ * With -jobs, methods are checked on several threads at once, so the
+ * buffer is appended to under a lock. Sorting makes the order they got
+ * there in irrelevant.
+ */
+static pthread_mutex_t diagnostics_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct diagnostic *diagnostics = NULL;
+static int ndiagnostics = 0;
+static int diagnostics_size = 0;
+static int max_errors = 100;
+
+/*
+ * add_diagnostic - append one error to the buffer. The message is stored
+ * already formatted, minus any trailing newlines the caller left on it.
+ */
+static void add_diagnostic(int kind, char *file, int line, int col,
+	char *fmt, ...) {
+
+	char msg[512];
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
 
-void print_error(char *errorMsg) {
-	printf("\n%s:%d: error: '%s' %s\n\n", filename, yylineno, yytext, errorMsg);
+	len = strlen(msg);
+	while (len > 0 && (msg[len - 1] == '\n' || msg[len - 1] == ' ')) {
+		msg[--len] = '\0';
+	}
+
+	pthread_mutex_lock(&diagnostics_lock);
+
+	if (ndiagnostics == diagnostics_size) {
+		diagnostics_size = diagnostics_size ? diagnostics_size * 2 : 16;
+		diagnostics = realloc(diagnostics,
+			diagnostics_size * sizeof(struct diagnostic));
+		if (diagnostics == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(4);
+		}
+	}
+
+	diagnostics[ndiagnostics].kind = kind;
+	diagnostics[ndiagnostics].filename = file ? file : filename;
+	diagnostics[ndiagnostics].lineno = line;
+	diagnostics[ndiagnostics].colno = col;
+	diagnostics[ndiagnostics].msg = strdup(msg);
+	diagnostics[ndiagnostics].seq = ndiagnostics;
+	ndiagnostics++;
+
+	pthread_mutex_unlock(&diagnostics_lock);
+}
+
+/*
+ * first_token - leftmost token under n, used as the position of an error
+ * reported against a whole subtree.
+ */
+static struct token *first_token(struct tree *n) {
+
+	while (n != NULL && n->leaf == NULL) {
+		struct tree *kid = NULL;
+		for (int i = 0; i < n->nkids && kid == NULL; i++) {
+			kid = n->kids[i];
+		}
+		n = kid;
+	}
+
+	return n ? n->leaf : NULL;
 }
 
 int yyerror(const char *s) {
-   fprintf(stderr, "\n%s:%d: error: %s with token: %s \n\n", filename,
-	  yylineno, s, yytext);
-	  exit(2);
+
+	if (strcmp(s, "syntax error") == 0 && *yytext == '\0') {
+		add_diagnostic(SYNTAX_ERROR, filename, yylineno, yycolno,
+			"error: syntax error at end of file");
+	} else {
+		add_diagnostic(SYNTAX_ERROR, filename, yylineno, yycolno,
+			"error: %s with token: %s", s, yytext);
+	}
+	return 0;
 }
 
-void throw_semantic_error(char *errorMsg, int line) {
-	fprintf(stderr, "\n%s:%d: semantic error: %s\n\n", filename,
-	   line, errorMsg);
-	   exit(3);
+void throw_semantic_error_at(char *errorMsg, struct token *t) {
+
+	if (t != NULL) {
+		add_diagnostic(SEMANTIC_ERROR, t->filename, t->lineno, t->colno,
+			"semantic error: %s", errorMsg);
+	} else {
+		add_diagnostic(SEMANTIC_ERROR, filename, yylineno, yycolno,
+			"semantic error: %s", errorMsg);
+	}
+}
+
+void throw_semantic_error(char *errorMsg, struct tree *n) {
+	throw_semantic_error_at(errorMsg, first_token(n));
 }
 
 void throw_lexical_error(char *errorMsg) {
-	fprintf(stderr, "\n%s:%d: lexical error: '%s' %s\n\n", filename,
-	   yylineno, yytext, errorMsg);
-	   exit(1);
+	add_diagnostic(LEXICAL_ERROR, filename, yylineno, yycolno,
+		"lexical error: '%s' %s", yytext, errorMsg);
 }
 
 void throw_syntax_error(char *errorMsg) {
-	fprintf(stderr, "\n%s:%d: syntax error: %s with: %s \n\n", filename,
-	   yylineno, errorMsg, yytext);
-	   exit(2);
+	add_diagnostic(SYNTAX_ERROR, filename, yylineno, yycolno,
+		"syntax error: %s with: %s", errorMsg, yytext);
 }
 
 void throw_error(char *errorMsg) {
 	fprintf(stderr, "\nerror: %s\n\n", errorMsg);
 	   exit(-1);
 }
+
+void set_max_errors(int n) {
+	max_errors = n;
+}
+
+/* error_count - errors of the given kind found so far, 0 counts all kinds */
+int error_count(int kind) {
+
+	int n = 0;
+
+	for (int i = 0; i < ndiagnostics; i++) {
+		if (kind == 0 || diagnostics[i].kind == kind) n++;
+	}
+
+	return n;
+}
+
+static int compare_diagnostics(const void *a, const void *b) {
+
+	const struct diagnostic *x = a, *y = b;
+	int c;
+
+	if ((c = strcmp(x->filename, y->filename)) != 0) return c;
+	if (x->lineno != y->lineno) return x->lineno - y->lineno;
+	if (x->colno != y->colno) return x->colno - y->colno;
+	return x->seq - y->seq;
+}
+
+/*
+ * flush_diagnostics - print the buffered errors in source order, dropping
+ * repeats and stopping after max_errors of them. Returns the exit code of
+ * the first error that was found (0 if there were none), which is what
+ * the compiler used to exit with when it stopped at that error.
+ */
+int flush_diagnostics(FILE *f) {
+
+	int exit_code, shown = 0, i;
+
+	if (ndiagnostics == 0) return 0;
+	exit_code = diagnostics[0].kind;
+
+	qsort(diagnostics, ndiagnostics, sizeof(struct diagnostic),
+		compare_diagnostics);
+
+	for (i = 0; i < ndiagnostics; i++) {
+		struct diagnostic *d = &diagnostics[i];
+
+		if (i > 0 && d->lineno == d[-1].lineno && d->colno == d[-1].colno
+			&& strcmp(d->filename, d[-1].filename) == 0
+			&& strcmp(d->msg, d[-1].msg) == 0) {
+			continue;
+		}
+		if (max_errors > 0 && shown == max_errors) {
+			fprintf(f, "\ntoo many errors, stopping after %d\n\n", max_errors);
+			break;
+		}
+		fprintf(f, "\n%s:%d:%d: %s\n\n", d->filename, d->lineno, d->colno,
+			d->msg);
+		shown++;
+	}
+
+	for (i = 0; i < ndiagnostics; i++) {
+		free(diagnostics[i].msg);
+	}
+	ndiagnostics = 0;
+
+	return exit_code;
+}
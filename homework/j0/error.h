@@ -2,11 +2,33 @@
 #define ERROR_H
 
 #include "defs.h"
+
+/* kinds of error, numbered by the exit code each one causes */
+#define LEXICAL_ERROR  1
+#define SYNTAX_ERROR   2
+#define SEMANTIC_ERROR 3
+
+struct diagnostic {
+	int kind;
+	char *filename;
+	int lineno;
+	int colno;
+	char *msg;      /* formatted message, including the kind of error */
+	int seq;        /* order found in, keeps the sort stable */
+};
+
+struct tree;
+struct token;
+
 int yyerror(const char *s);
-void print_error(char *errorMsg);
-void throw_semantic_error(char *errorMsg, int line);
+void throw_semantic_error(char *errorMsg, struct tree *n);
+void throw_semantic_error_at(char *errorMsg, struct token *t);
 void throw_lexical_error(char *errorMsg);
 void throw_syntax_error(char *errorMsg);
 void throw_error(char *errorMsg);
 
+void set_max_errors(int n);
+int error_count(int kind);
+int flush_diagnostics(FILE *f);
+
 #endif
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * Escape analysis, and stack allocation. An array is made by
+ *
+ *	PARM k; CALL new,1,t
+ *
+ * which asks the runtime for k zeroed words. When k is a small constant,
+ * the allocation is in no loop, and the array cannot outlive the call of
+ * the procedure that makes it, it gets k slots of that procedure's frame
+ * instead:
+ *
+ *	ADDR t,slot; SCONT t,0; ADD p,t,8; SCONT p,0; ...
+ *
+ * The array can outlive the call when its address, or anything computed
+ * from it, is passed to a call, returned, stored through a pointer, or
+ * copied to anything but a private variable. Which variables may hold it
+ * is worked out for the whole procedure at once, regardless of order. An
+ * allocation in a loop would have every trip around share the slots, so
+ * it is left to the runtime.
+ */
+
+#define ESCAPE_MAX_WORDS 16	/* the biggest array put in a frame */
+
+static void *xcalloc(size_t n, size_t size) {
+
+	void *p = calloc(n, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static int is_op(struct instr *in, int opcode) {
+	return in->code_type != DECLARATION && in->opcode == opcode;
+}
+
+/* allocation - the number of words in makes room for, if it is a candidate, else 0 */
+static int allocation(struct block *b, int j) {
+
+	struct instr *in = b->code[j], *parm = j > 0 ? b->code[j - 1] : NULL;
+
+	if (!is_op(in, O_CALL) || in->name == NULL || strcmp(in->name, "new") != 0 ||
+		in->nparams != 1 || parm == NULL || !is_op(parm, O_PARM)) return 0;
+	if (parm->dest.region != R_CONST || parm->dest.tag != OFFSET) return 0;
+	if (parm->dest.u.offset <= 0 || parm->dest.u.offset > ESCAPE_MAX_WORDS) return 0;
+	return parm->dest.u.offset;
+}
+
+/* number_vars - give every variable of the procedure its number */
+static void number_vars(struct cfg *g) {
+
+	for (int i = 0; i < g->nblocks; i++) {
+		for (int j = 0; j < g->blocks[i]->ncode; j++) {
+			struct instr *in = g->blocks[i]->code[j];
+			struct addr *uses[2], *d = instr_def(in);
+			int n = instr_uses(in, uses);
+
+			if (d != NULL) cfg_var(g, d);
+			while (n-- > 0) cfg_var(g, uses[n]);
+		}
+	}
+}
+
+/*
+ * flow - what in does with the variables holds says may hold the array,
+ *  or something made from it: -1 if it lets it escape, 1 if it gives it
+ *  to one more variable, else 0
+ */
+static int flow(struct cfg *g, struct instr *in, char *holds) {
+
+	struct addr *uses[2], *d;
+	int n = instr_uses(in, uses), tainted = 0, v;
+
+	for (int k = 0; k < n; k++) {
+		int u = cfg_var(g, uses[k]);
+
+		if (u < 0 || !holds[u]) continue;
+		/* loading or storing through it is using it as a pointer */
+		if (is_op(in, O_LCONT) || (is_op(in, O_SCONT) && uses[k] == &in->dest)) continue;
+		if (is_op(in, O_PARM) || is_op(in, O_RET) || is_op(in, O_SCONT)) return -1;
+		tainted = 1;
+	}
+	if (!tainted || (d = instr_def(in)) == NULL) return 0;
+
+	v = cfg_var(g, d);
+	if (v < 0 || !g->vars[v].private) return -1;
+	if (holds[v]) return 0;
+	holds[v] = 1;
+	return 1;
+}
+
+/* escapes - whether the array alloc makes may outlive the call, see above */
+static int escapes(struct cfg *g, struct instr *alloc) {
+
+	char *holds;
+	int v, r = 1, changed = 1;
+
+	number_vars(g);
+	v = cfg_var(g, &alloc->dest);
+	if (v < 0 || !g->vars[v].private) return 1;
+	holds = xcalloc(g->nvars + 1, 1);
+	holds[v] = 1;
+
+	while (changed && r >= 0) {
+		changed = 0;
+		for (int i = 0; i < g->nblocks && r >= 0; i++) {
+			struct block *b = g->blocks[i];
+
+			for (int j = 0; j < b->ncode && r >= 0; j++) {
+				r = flow(g, b->code[j], holds);
+				if (r > 0) changed = 1;
+			}
+		}
+	}
+
+	free(holds);
+	return r < 0;
+}
+
+/* to_frame - make the allocation at b->code[j] one of k slots of the frame */
+static void to_frame(struct cfg *g, struct block *b, int j, int k) {
+
+	struct instr *alloc = b->code[j];
+	struct addr t = alloc->dest, p, none, value;
+
+	memset(&none, 0, sizeof(none));
+	none.region = R_NONE;
+	p = value = none;
+	value.region = R_CONST;
+
+	/* the PARM becomes the ADDR, and the CALL the stores of 0 */
+	block_remove(b, j - 1);
+	block_remove(b, j - 1);
+	block_insert(b, j - 1, gen(O_ADDR, t, cfg_new_slots(g, k), none));
+
+	value.u.offset = 0;
+	block_insert(b, j++, gen(O_SCONT, t, value, none));
+	if (k > 1) p = cfg_new_slot(g);
+	for (int i = 1; i < k; i++) {
+		struct addr offset = value;
+
+		offset.u.offset = 8 * i;
+		block_insert(b, j++, gen(O_ADD, p, t, offset));
+		block_insert(b, j++, gen(O_SCONT, p, value, none));
+	}
+}
+
+/*
+ * stack_allocate - put the arrays the procedure makes that cannot outlive
+ *  it in its frame, see above. Returns how many.
+ */
+int stack_allocate(struct cfg *g, struct opt_stats *stats) {
+
+	int moved = 0;
+
+	find_loops(g);
+
+	for (int i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		if (b->rpo < 0 || b->loop != NULL) continue;
+		for (int j = 0; j < b->ncode; j++) {
+			int k = allocation(b, j);
+
+			if (k == 0 || escapes(g, b->code[j])) continue;
+			to_frame(g, b, j, k);
+			moved++;
+		}
+	}
+
+	stats->stack_allocated += moved;
+	return moved;
+}
@@ -0,0 +1,120 @@
+#define _GNU_SOURCE	/* for struct ucred */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "frame.h"
+
+/*
+ * default_socket_path - $J0_SOCKET, or a per-user socket in /tmp so that
+ * two people on one machine don't share a server.
+ */
+char *default_socket_path() {
+
+	static char path[108];
+	char *env = getenv(J0_SOCKET_ENV);
+
+	if (env != NULL && *env != '\0') {
+		return env;
+	}
+
+	snprintf(path, sizeof(path), "/tmp/j0-%d.sock", (int) getuid());
+	return path;
+}
+
+/*
+ * peer_is_owner - whether the process at the other end of the socket fd
+ * runs as this one's user. Anyone can make a socket in /tmp, or connect
+ * to one they can write, so neither end talks to anyone else: the client
+ * writes the files the server names, and the server compiles as its user.
+ */
+int peer_is_owner(int fd) {
+
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) return 0;
+	return cred.uid == getuid();
+#else
+	uid_t uid;
+	gid_t gid;
+
+	if (getpeereid(fd, &uid, &gid) < 0) return 0;
+	return uid == getuid();
+#endif
+}
+
+int write_all(int fd, const char *buf, size_t len) {
+
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int read_all(int fd, char *buf, size_t len) {
+
+	while (len > 0) {
+		ssize_t n = read(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (n == 0) return -1;
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * put_frame - append one frame to f. Requests and responses are built
+ * up in a memory stream and sent with one write_all(), so the other end
+ * wakes up once per message rather than once per frame.
+ */
+int put_frame(FILE *f, char tag, const char *data, uint32_t len) {
+
+	uint32_t nlen = htonl(len);
+
+	if (fputc(tag, f) == EOF || fwrite(&nlen, 4, 1, f) != 1) return -1;
+	if (len > 0 && fwrite(data, 1, len, f) != len) return -1;
+	return 0;
+}
+
+/*
+ * read_frame - read one frame. The data is malloc'ed and NUL terminated
+ * (the NUL is not counted in len), the caller frees it.
+ */
+int read_frame(int fd, char *tag, char **data, uint32_t *len) {
+
+	char header[5];
+	uint32_t nlen;
+
+	if (read_all(fd, header, 5) < 0) return -1;
+
+	*tag = header[0];
+	memcpy(&nlen, header + 1, 4);
+	*len = ntohl(nlen);
+
+	if ((*data = malloc(*len + 1)) == NULL) return -1;
+	if (read_all(fd, *data, *len) < 0) {
+		free(*data);
+		return -1;
+	}
+	(*data)[*len] = '\0';
+
+	return 0;
+}
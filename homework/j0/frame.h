@@ -0,0 +1,32 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Messages between j0client and a j0 --server are a sequence of frames:
+ * a one byte tag, a 4 byte length in network order, then the data.
+ */
+
+/* request frames, client to server */
+#define FRAME_CWD    'd'	/* working directory to compile in */
+#define FRAME_ARG    'a'	/* one command line argument, in order */
+#define FRAME_SOURCE 's'	/* contents to compile instead of reading the file */
+#define FRAME_END    'g'	/* end of request */
+
+/* response frames, server to client */
+#define FRAME_STDOUT 'o'	/* what j0 printed on stdout */
+#define FRAME_STDERR 'e'	/* what j0 printed on stderr */
+#define FRAME_ICN    'i'	/* an output file: name, a NUL, then contents */
+#define FRAME_EXIT   'x'	/* exit code, as decimal text; always last */
+
+#define J0_SOCKET_ENV "J0_SOCKET"
+
+char *default_socket_path();
+int peer_is_owner(int fd);
+int put_frame(FILE *f, char tag, const char *data, uint32_t len);
+int write_all(int fd, const char *buf, size_t len);
+int read_frame(int fd, char *tag, char **data, uint32_t *len);
+
+#endif
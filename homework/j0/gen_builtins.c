@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * gen_builtins - compile the builtin class table (builtins.def, on stdin)
+ * into builtins.c, a symbol table image made of nothing but initialized
+ * const data. init_globals() chains the global scope to it instead of
+ * building the builtins with calloc and insert_symbol at every startup.
+ *
+ * Every table in the image has one bucket. They hold a handful of names
+ * each, one chain is as quick to search as a hash, and lookup_st() needs
+ * no change to read them since any hash modulo 1 is 0. The chains are
+ * in the order insert_symbol() would have left them, newest first.
+ */
+
+#define MAXITEMS 256
+
+struct scope {
+	char *name;
+	int parent;		/* -1 for the builtin scope */
+	int class_entry;	/* the entry that declares it, -1 for the builtin scope */
+	int last;		/* newest entry, the head of the chain, -1 if none */
+	int nentries;
+};
+
+struct entry {
+	char *name;
+	int scope;		/* where it is declared */
+	int offset;		/* in words */
+	int prev;		/* next in the chain: the entry declared before it */
+	int class_scope;	/* for a class, its scope, otherwise -1 */
+	char *returns;
+	int nparams;
+};
+
+static struct scope scopes[MAXITEMS];
+static struct entry entries[MAXITEMS];
+static int nscopes, nentries, lineno;
+
+static void fail(char *msg, char *what) {
+	fprintf(stderr, "builtins.def:%d: %s%s\n", lineno, msg, what ? what : "");
+	exit(1);
+}
+
+static int find_scope(char *name) {
+
+	for (int i = 1; i < nscopes; i++) {
+		if (strcmp(scopes[i].name, name) == 0) return i;
+	}
+
+	fail("no such class: ", name);
+	return -1;
+}
+
+static int declare(int scope, char *name) {
+
+	struct entry *e = &entries[nentries];
+
+	if (nentries == MAXITEMS) fail("too many names", NULL);
+
+	e->name = strdup(name);
+	e->scope = scope;
+	e->offset = scopes[scope].nentries++;
+	e->prev = scopes[scope].last;
+	e->class_scope = -1;
+	scopes[scope].last = nentries;
+
+	return nentries++;
+}
+
+static void read_table(FILE *f) {
+
+	char line[256], kind[32], a[64], b[64], c[64], d[64];
+	int n;
+
+	scopes[0].name = "builtin";
+	scopes[0].parent = -1;
+	scopes[0].class_entry = -1;
+	scopes[0].last = -1;
+	nscopes = 1;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+		if (line[0] == '#' || (n = sscanf(line, "%31s %63s %63s %63s %63s",
+			kind, a, b, c, d)) <= 0) continue;
+
+		if (strcmp(kind, "class") == 0 && (n == 2 || (n == 4 &&
+			strcmp(b, "in") == 0))) {
+
+			struct scope *s = &scopes[nscopes];
+			int parent = n == 4 ? find_scope(c) : 0;
+
+			if (nscopes == MAXITEMS) fail("too many classes", NULL);
+			s->name = strdup(a);
+			s->parent = parent;
+			s->last = -1;
+			s->class_entry = declare(parent, a);
+			entries[s->class_entry].class_scope = nscopes++;
+
+		} else if (strcmp(kind, "method") == 0 && n == 5) {
+
+			int e = declare(find_scope(a), b);
+
+			entries[e].returns = strdup(c);
+			entries[e].nparams = atoi(d);
+
+		} else {
+			fail("can't read: ", strtok(line, "\n"));
+		}
+	}
+}
+
+/* return_type - the typeinfo a method returns, as alctype() would give it */
+static char *return_type(char *returns) {
+
+	if (strcmp(returns, "int") == 0) return "&integer_type";
+	if (strcmp(returns, "char") == 0) return "&char_type";
+	if (strcmp(returns, "boolean") == 0) return "(typeptr) &bt_boolean";
+	if (strcmp(returns, "String") == 0) return "(typeptr) &bt_String";
+	if (strcmp(returns, "-") == 0) return "NULL";
+
+	fail("unknown return type: ", returns);
+	return NULL;
+}
+
+static char *scope_name(int i) {
+
+	static char buf[2][32];
+	static int which;
+
+	which = !which;
+	if (i == 0) return "builtin_scope";
+	snprintf(buf[which], sizeof(buf[which]), "bt_scope_%d", i);
+	return buf[which];
+}
+
+static void write_image(FILE *f) {
+
+	int i;
+
+	fprintf(f, "/* builtins.c - generated by gen_builtins from builtins.def, do not edit */\n\n");
+	fprintf(f, "#include \"symboltable.h\"\n\n");
+	fprintf(f, "extern struct typeinfo char_type;\n\n");
+	fprintf(f, "static const struct typeinfo bt_boolean = { BOOL_TYPE };\n");
+	fprintf(f, "static const struct typeinfo bt_String = { STRING_TYPE };\n\n");
+
+	for (i = 1; i < nscopes; i++) {
+		fprintf(f, "static const struct sym_table %s;\n", scope_name(i));
+	}
+	for (i = 0; i < nentries; i++) {
+		fprintf(f, "static const struct sym_entry bt_entry_%d;\n", i);
+	}
+	fprintf(f, "\n");
+
+	for (i = 0; i < nentries; i++) {
+		struct entry *e = &entries[i];
+
+		if (e->class_scope >= 0) {
+			fprintf(f, "static const struct typeinfo bt_type_%d = { CLASS_TYPE,\n"
+				"\t.type_sym_table = (SymbolTable) &%s,\n"
+				"\t.u.c = { \"%s\", (SymbolTable) &%s } };\n", i,
+				scope_name(e->class_scope), e->name, scope_name(e->class_scope));
+		} else {
+			fprintf(f, "static const struct typeinfo bt_type_%d = { FUNC_TYPE,\n"
+				"\t.u.f = { .name = \"%s\", .returntype = %s, .nparams = %d } };\n",
+				i, e->name, return_type(e->returns), e->nparams);
+		}
+
+		fprintf(f, "static const struct addr bt_addr_%d = { R_LOCAL, OFFSET, { %d } };\n",
+			i, e->offset * 8);
+
+		fprintf(f, "static const struct sym_entry bt_entry_%d = {\n"
+			"\t(SymbolTable) &%s, \"%s\", (typeptr) &bt_type_%d,\n"
+			"\t(struct addr *) &bt_addr_%d, ", i, scope_name(e->scope), e->name, i, i);
+		if (e->prev >= 0) {
+			fprintf(f, "(SymbolTableEntry) &bt_entry_%d };\n\n", e->prev);
+		} else {
+			fprintf(f, "NULL };\n\n");
+		}
+	}
+
+	for (i = 0; i < nscopes; i++) {
+		struct scope *s = &scopes[i];
+
+		fprintf(f, "static SymbolTableEntry const bt_tbl_%d[1] = { ", i);
+		if (s->last >= 0) {
+			fprintf(f, "(SymbolTableEntry) &bt_entry_%d };\n", s->last);
+		} else {
+			fprintf(f, "NULL };\n");
+		}
+
+		fprintf(f, "%sconst struct sym_table %s = {\n", i ? "static " : "",
+			scope_name(i));
+		fprintf(f, "\t\"%s\", 1, %d, %d,\n", s->name, s->nentries, s->nentries);
+		fprintf(f, "\t%s%s, ", s->parent >= 0 ? "(SymbolTable) &" : "NULL",
+			s->parent >= 0 ? scope_name(s->parent) : "");
+		if (s->class_entry >= 0) {
+			fprintf(f, "(typeptr) &bt_type_%d,\n", s->class_entry);
+		} else {
+			fprintf(f, "NULL,\n");
+		}
+		fprintf(f, "\t(SymbolTableEntry *) bt_tbl_%d };\n\n", i);
+	}
+}
+
+int main(int argc, char *argv[]) {
+
+	read_table(stdin);
+	write_image(stdout);
+
+	return 0;
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "peephole.h"
+
+/*
+ * gen_peephole - compile the peephole rules (peephole.def, on stdin) into
+ * peephole_rules.c, the table peephole.c matches against the code. The
+ * rules are checked here, so a mistake in one is found when j0 is built
+ * rather than when some program happens to match it.
+ */
+
+static char *opnames[] = {
+	"ADD", "SUB", "MUL", "DIV", "NEG", "ASN", "ADDR", "LCONT", "SCONT", "GOTO",
+	"BLT", "BLE", "BGT", "BGE", "BEQ", "BNE", "BIF", "BNIF", "PARM", "CALL",
+	"RET", "MOD", "NOT"
+};
+
+struct rule {
+	char name[64];
+	char text[256];
+	int nmatch, nreplace;
+	struct peep_instr match[PEEP_WINDOW], replace[PEEP_WINDOW];
+	char *vars[PEEP_VARS];
+	int nvars;
+	unsigned int dead;
+};
+
+static struct rule rules[PEEP_MAX_RULES];
+static int nrules, lineno;
+
+static void fail(char *msg, char *what) {
+	fprintf(stderr, "peephole.def:%d: %s%s\n", lineno, msg, what ? what : "");
+	exit(1);
+}
+
+static char *trim(char *s) {
+
+	char *e;
+
+	while (isspace((unsigned char) *s)) s++;
+	e = s + strlen(s);
+	while (e > s && isspace((unsigned char) e[-1])) *--e = '\0';
+	return s;
+}
+
+/* opcode_macro - the tac.h name of an opcode */
+static char *opcode_macro(int op) {
+
+	static char buf[32];
+
+	if (op == PEEP_ANY_OP) return "PEEP_ANY_OP";
+	if (op == D_LABEL) return "D_LABEL";
+	snprintf(buf, sizeof(buf), "O_%s", opnames[op - O_ADD]);
+	return buf;
+}
+
+static int opcode(char *name) {
+
+	if (strcmp(name, "*") == 0) return PEEP_ANY_OP;
+	if (strcmp(name, "LABEL") == 0) return D_LABEL;
+	for (int i = 0; i < sizeof(opnames) / sizeof(opnames[0]); i++) {
+		if (strcmp(opnames[i], name) == 0) return O_ADD + i;
+	}
+
+	fail("no such opcode: ", name);
+	return -1;
+}
+
+/* variable - the number of a pattern variable, new ones only in a pattern */
+static int variable(struct rule *r, char *name, int in_pattern) {
+
+	for (int i = 0; i < r->nvars; i++) {
+		if (strcmp(r->vars[i], name) == 0) return i;
+	}
+
+	if (!in_pattern) fail("not in the pattern: ", name);
+	if (r->nvars == PEEP_VARS) fail("too many variables", NULL);
+	r->vars[r->nvars] = strdup(name);
+	return r->nvars++;
+}
+
+static void operand(struct rule *r, char *s, struct peep_operand *o, int in_pattern) {
+
+	char *end;
+
+	s = trim(s);
+	if (strcmp(s, "_") == 0) {
+		if (!in_pattern) fail("_ in a replacement", NULL);
+		o->kind = P_ANY;
+	} else if (isdigit((unsigned char) s[0]) || s[0] == '-') {
+		o->kind = P_INT;
+		o->n = strtol(s, &end, 10);
+		if (*end != '\0') fail("bad constant: ", s);
+	} else if (isalpha((unsigned char) s[0])) {
+		o->kind = P_VAR;
+		o->n = variable(r, s, in_pattern);
+	} else {
+		fail("bad operand: ", s);
+	}
+}
+
+/* instrs - read a pattern or a replacement, instructions separated by ; */
+static int instrs(struct rule *r, char *s, struct peep_instr *in, int in_pattern) {
+
+	int n = 0;
+	char *next;
+
+	if (*trim(s) == '\0') return 0;
+
+	for (; s != NULL; s = next) {
+		char *op, *opnds;
+		int k = 0;
+
+		if ((next = strchr(s, ';')) != NULL) *next++ = '\0';
+		if (n == PEEP_WINDOW) fail("too many instructions", NULL);
+
+		op = strtok(trim(s), " \t");
+		opnds = strtok(NULL, "");
+		if (op == NULL) fail("empty instruction", NULL);
+
+		memset(&in[n], 0, sizeof(in[n]));
+		in[n].opcode = opcode(op);
+		if (in[n].opcode == PEEP_ANY_OP && !in_pattern) fail("* in a replacement", NULL);
+		for (k = 0; k < 3; k++) {
+			in[n].opnd[k].kind = in_pattern ? P_ANY : P_NONE;
+		}
+		k = 0;
+		if (opnds != NULL && in[n].opcode == PEEP_ANY_OP) fail("operands of *", NULL);
+		for (char *o = opnds ? strtok(opnds, ",") : NULL; o != NULL; o = strtok(NULL, ",")) {
+			if (k == 3) fail("too many operands", NULL);
+			operand(r, o, &in[n].opnd[k++], in_pattern);
+		}
+		n++;
+	}
+	return n;
+}
+
+static void read_rules(FILE *f) {
+
+	char line[256];
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		struct rule *r = &rules[nrules];
+		char *s = trim(line), *arrow, *where, *name;
+
+		lineno++;
+		if (s[0] == '#' || s[0] == '\0') continue;
+		if (strncmp(s, "rule", 4) != 0 || !isspace((unsigned char) s[4])) {
+			fail("can't read: ", s);
+		}
+		if (nrules == PEEP_MAX_RULES) fail("too many rules", NULL);
+
+		s = trim(s + 4);
+		name = s;
+		while (*s != '\0' && !isspace((unsigned char) *s)) s++;
+		if (*s != '\0') *s++ = '\0';
+		if (strlen(name) >= sizeof(r->name)) fail("name too long: ", name);
+		strcpy(r->name, name);
+		snprintf(r->text, sizeof(r->text), "%s", trim(s));
+
+		if ((arrow = strstr(s, "=>")) == NULL) fail("no =>", NULL);
+		*arrow = '\0';
+		arrow += 2;
+		if ((where = strstr(arrow, "where")) != NULL) *where = '\0';
+
+		r->nmatch = instrs(r, s, r->match, 1);
+		if (r->nmatch == 0) fail("empty pattern", NULL);
+		r->nreplace = instrs(r, arrow, r->replace, 0);
+
+		if (where != NULL) {
+			char *w = strtok(where + 5, " \t");
+
+			if (w == NULL || strcmp(w, "dead") != 0) fail("where what?", NULL);
+			while ((w = strtok(NULL, " \t")) != NULL) {
+				r->dead |= 1u << variable(r, w, 0);
+			}
+		}
+		nrules++;
+	}
+}
+
+static char *kind_name(enum peep_kind k) {
+
+	switch (k) {
+		case P_ANY: return "P_ANY";
+		case P_VAR: return "P_VAR";
+		case P_INT: return "P_INT";
+		default: return "P_NONE";
+	}
+}
+
+static void write_instrs(FILE *f, struct peep_instr *in, int n) {
+
+	if (n == 0) {
+		fprintf(f, "{ { 0 } }");
+		return;
+	}
+
+	fprintf(f, "{");
+	for (int i = 0; i < n; i++) {
+		fprintf(f, "%s\n\t\t{ %s, {", i ? "," : "", opcode_macro(in[i].opcode));
+		for (int k = 0; k < 3; k++) {
+			fprintf(f, "%s { %s, %d }", k ? "," : "", kind_name(in[i].opnd[k].kind),
+				in[i].opnd[k].n);
+		}
+		fprintf(f, " } }");
+	}
+	fprintf(f, " }");
+}
+
+static void write_table(FILE *f) {
+
+	fprintf(f, "/* peephole_rules.c - generated by gen_peephole from peephole.def, do not edit */\n\n");
+	fprintf(f, "#include \"peephole.h\"\n\n");
+	fprintf(f, "const struct peep_rule peep_rules[] = {\n");
+
+	for (int i = 0; i < nrules; i++) {
+		struct rule *r = &rules[i];
+
+		fprintf(f, "\t{ \"%s\", \"%s\",\n\t  %d, ", r->name, r->text, r->nmatch);
+		write_instrs(f, r->match, r->nmatch);
+		fprintf(f, ",\n\t  %d, ", r->nreplace);
+		write_instrs(f, r->replace, r->nreplace);
+		fprintf(f, ",\n\t  0x%x },\n", r->dead);
+	}
+
+	fprintf(f, "};\n\n");
+	fprintf(f, "const int npeep_rules = %d;\n", nrules);
+}
+
+int main(int argc, char *argv[]) {
+
+	read_rules(stdin);
+	write_table(stdout);
+
+	return 0;
+}
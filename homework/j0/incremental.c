@@ -0,0 +1,413 @@
+#include "incremental.h"
+#include "cache.h"
+
+/*
+ * Incremental compilation, one method at a time.
+ *
+ * When a file misses in the compile cache it is still parsed and its
+ * symbol tables built in full, since every method sees the signatures
+ * and fields of the whole class. What can be skipped is type checking
+ * and code generation for methods that did not change. The code of a
+ * method depends on its own tokens and on the class outline (everything
+ * outside method bodies: fields, signatures and their order, which fix
+ * the addresses it refers to), so the key of a method's .tac entry is a
+ * hash of the two. Editing one body changes only that method's key;
+ * editing a signature or a field changes them all.
+ *
+ * Labels are numbered across the whole file, so a method's code is kept
+ * with labels relative to the first one it used and moved to where the
+ * numbering has got to when it is spliced back in. String literals are
+ * kept with it and added to the .string section in the same order the
+ * full compile would have added them.
+ */
+
+/* in source order */
+static struct method_unit *units = NULL;
+static struct method_unit **units_end = &units;
+
+struct leaf_hash {
+	uint64_t h;
+	int first_line, last_line;
+};
+
+static int hash_leaf(struct tree *n, int depth, void *arg) {
+
+	struct leaf_hash *lh = arg;
+
+	if (n->nkids == 0 && n->leaf != NULL) {
+		lh->h = fnv1a(lh->h, &n->leaf->category, sizeof(int));
+		lh->h = fnv1a(lh->h, n->leaf->text, strlen(n->leaf->text) + 1);
+
+		if (lh->first_line == 0) lh->first_line = n->leaf->lineno;
+		lh->last_line = n->leaf->lineno;
+	}
+
+	return 1;
+}
+
+static struct method_unit *new_unit(struct tree *n) {
+
+	struct method_unit *u = calloc(1, sizeof(struct method_unit));
+
+	u->decl = n;
+	n->unit = u;
+	*units_end = u;
+	units_end = &u->next;
+
+	return u;
+}
+
+/*
+ * outline_leaf - hash the leaves outside method bodies into the outline
+ *  and make a unit for each method on the way.
+ */
+static int outline_leaf(struct tree *n, int depth, void *arg) {
+
+	struct leaf_hash *outline = arg;
+	struct leaf_hash method = { FNV_OFFSET, 0, 0 };
+	struct method_unit *u;
+
+	if (n->prodrule != prodR_MethodDecl) {
+		return hash_leaf(n, depth, arg);
+	}
+
+	walk_tree(n->kids[0], hash_leaf, NULL, outline);
+	walk_tree(n, hash_leaf, NULL, &method);
+
+	u = new_unit(n);
+	u->key = method.h;
+	u->first_line = method.first_line;
+	u->last_line = method.last_line;
+
+	return 0;
+}
+
+static int find_unit(struct tree *n, int depth, void *arg) {
+
+	if (n->prodrule != prodR_MethodDecl) {
+		return 1;
+	}
+
+	new_unit(n);
+	return 0;
+}
+
+/*
+ * A .tac entry is the method's code as fixed size records followed by
+ * the names they use, so loading one is a single read. Only the j0 that
+ * wrote an entry reads it back (the key includes the version), so the
+ * records are in native layout; the magic number has their size in it.
+ */
+#define TAC_MAGIC (0x6a300000 | sizeof(struct tac_record))
+
+struct tac_header {
+	uint32_t magic;
+	int32_t nlabels, ninstrs, nstrings;
+	int32_t names_len;	/* bytes of NUL terminated names after the records */
+};
+
+struct tac_addr {
+	int32_t region, tag;
+	int32_t offset;
+	int32_t name;		/* offset into the names, -1 for none */
+	double dval;
+};
+
+/* one instruction, or one string literal (name is its text, a[0] its address) */
+struct tac_record {
+	int32_t opcode, code_type, nparams, block_bytes;
+	int32_t name;
+	struct tac_addr a[3];
+};
+
+static int32_t put_name(FILE *names, char *s) {
+
+	int32_t at;
+
+	if (s == NULL) return -1;
+
+	at = ftell(names);
+	fwrite(s, 1, strlen(s) + 1, names);
+	return at;
+}
+
+/* put_addr - labels are kept relative to base */
+static void put_addr(struct tac_addr *t, struct addr a, int base, FILE *names) {
+
+	memset(t, 0, sizeof(struct tac_addr));
+	t->region = a.region;
+	t->tag = a.tag;
+	t->name = -1;
+
+	switch (a.tag) {
+		case OFFSET:
+			t->offset = a.region == R_LABEL ? a.u.offset - base : a.u.offset;
+			break;
+		case DVAL:
+			t->dval = a.u.dval;
+			break;
+		case NAME:
+			t->name = put_name(names, a.u.name);
+			break;
+	}
+}
+
+static char *get_name(int32_t at, char *names) {
+	return at < 0 ? NULL : names + at;
+}
+
+static void get_addr(struct addr *a, struct tac_addr *t, char *names) {
+
+	a->region = t->region;
+	a->tag = t->tag;
+
+	switch (a->tag) {
+		case OFFSET: a->u.offset = t->offset; break;
+		case DVAL: a->u.dval = t->dval; break;
+		case NAME: a->u.name = get_name(t->name, names); break;
+	}
+}
+
+/* load_unit - read a .tac entry into u, labels still relative */
+static int load_unit(struct method_unit *u, FILE *f) {
+
+	struct tac_header h;
+	struct tac_record *r;
+	struct instr *code;
+	char *names;
+	long size;
+	int i;
+
+	if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != TAC_MAGIC) return 0;
+
+	size = (long) (h.ninstrs + h.nstrings) * sizeof(struct tac_record) +
+		h.names_len;
+	r = malloc(size + 1);
+	if (r == NULL || fread(r, 1, size, f) != (size_t) size) return 0;
+	names = (char *) (r + h.ninstrs + h.nstrings);
+
+	code = calloc(h.ninstrs + 1, sizeof(struct instr));
+	for (i = 0; i < h.ninstrs; i++, r++) {
+		code[i].opcode = r->opcode;
+		code[i].code_type = r->code_type;
+		code[i].nparams = r->nparams;
+		code[i].block_bytes = r->block_bytes;
+		code[i].name = get_name(r->name, names);
+		get_addr(&code[i].dest, &r->a[0], names);
+		get_addr(&code[i].src1, &r->a[1], names);
+		get_addr(&code[i].src2, &r->a[2], names);
+		code[i].next = i + 1 < h.ninstrs ? &code[i + 1] : NULL;
+	}
+	u->code = h.ninstrs > 0 ? code : NULL;
+	u->code_tail = h.ninstrs > 0 ? &code[h.ninstrs - 1] : NULL;
+
+	u->nlabels = h.nlabels;
+	u->nstrings = h.nstrings;
+	u->string_text = malloc((h.nstrings + 1) * sizeof(char *));
+	u->string_addr = malloc((h.nstrings + 1) * sizeof(struct addr *));
+	for (i = 0; i < h.nstrings; i++, r++) {
+		u->string_text[i] = get_name(r->name, names);
+		u->string_addr[i] = calloc(1, sizeof(struct addr));
+		get_addr(u->string_addr[i], &r->a[0], names);
+	}
+
+	return 1;
+}
+
+/*
+ * plan_methods - hash the outline and each method of the tree just
+ * populated, and pick up the code of every method found in the cache.
+ * Those are skipped by check_types and code generation.
+ */
+void plan_methods(struct tree *root, const char *flags) {
+
+	struct leaf_hash outline = { FNV_OFFSET, 0, 0 };
+	struct method_unit *u;
+	int hits = 0, misses = 0;
+
+	units = NULL;
+	units_end = &units;
+	walk_tree(root, outline_leaf, NULL, &outline);
+
+	for (u = units; u != NULL; u = u->next) {
+		uint64_t parts[2] = { outline.h, u->key };
+		FILE *f;
+
+		u->key = cache_key((char *) parts, sizeof(parts), flags);
+
+		if ((f = cache_open(u->key, ".tac")) != NULL) {
+			u->reused = u->ready = load_unit(u, f);
+			fclose(f);
+		}
+
+		if (u->reused) {
+			hits++;
+		} else {
+			misses++;
+		}
+	}
+
+	cache_count_methods(hits, misses);
+}
+
+/* save_methods - keep the code of every method that was compiled this time */
+void save_methods() {
+
+	struct method_unit *u;
+
+	for (u = units; u != NULL; u = u->next) {
+		struct tac_header h;
+		struct tac_record r;
+		struct instr *in;
+		char *buf, *names_buf;
+		size_t len, names_len;
+		FILE *f, *names;
+		int i;
+
+		if (u->reused) continue;
+
+		f = open_memstream(&buf, &len);
+		names = open_memstream(&names_buf, &names_len);
+
+		memset(&h, 0, sizeof(h));
+		h.magic = TAC_MAGIC;
+		h.nlabels = u->nlabels;
+		h.nstrings = u->nstrings;
+		for (in = u->code; in != NULL; in = in == u->code_tail ? NULL : in->next) {
+			h.ninstrs++;
+		}
+		fwrite(&h, sizeof(h), 1, f);
+
+		for (in = u->code; in != NULL; in = in == u->code_tail ? NULL : in->next) {
+			memset(&r, 0, sizeof(r));
+			r.opcode = in->opcode;
+			r.code_type = in->code_type;
+			r.nparams = in->nparams;
+			r.block_bytes = in->block_bytes;
+			r.name = put_name(names, in->name);
+			put_addr(&r.a[0], in->dest, u->label_base, names);
+			put_addr(&r.a[1], in->src1, u->label_base, names);
+			put_addr(&r.a[2], in->src2, u->label_base, names);
+			fwrite(&r, sizeof(r), 1, f);
+		}
+
+		for (i = 0; i < u->nstrings; i++) {
+			memset(&r, 0, sizeof(r));
+			r.name = put_name(names, u->string_text[i]);
+			put_addr(&r.a[0], *u->string_addr[i], u->label_base, names);
+			fwrite(&r, sizeof(r), 1, f);
+		}
+
+		fclose(names);
+		fwrite(names_buf, 1, names_len, f);
+		fclose(f);
+
+		/* the header goes out before the names are counted */
+		((struct tac_header *) buf)->names_len = names_len;
+
+		cache_put(u->key, ".tac", buf, len);
+		free(names_buf);
+		free(buf);
+	}
+}
+
+/*
+ * method_units - the methods of the tree, as found by plan_methods() or,
+ * without the cache, found now.
+ */
+struct method_unit *method_units(struct tree *root) {
+
+	if (units == NULL) {
+		walk_tree(root, find_unit, NULL, NULL);
+	}
+
+	return units;
+}
+
+/* method_checked - n is a method that needs no type checking here */
+int method_checked(struct tree *n) {
+	return n->unit != NULL && (n->unit->reused || n->unit->checked);
+}
+
+/*
+ * method_attr_begin - note where the method's labels start. A method
+ * whose code is ready (reused, or generated by another thread) takes as
+ * many labels as it did when it was compiled, and its subtree is not
+ * walked (returns 0).
+ */
+int method_attr_begin(struct tree *n) {
+
+	struct method_unit *u = n->unit;
+
+	u->label_base = labelcounter;
+	if (u->ready) {
+		labelcounter += u->nlabels;
+		return 0;
+	}
+
+	return 1;
+}
+
+void method_attr_end(struct tree *n) {
+	n->unit->nlabels = labelcounter - n->unit->label_base;
+}
+
+static void rebase(struct addr *a, int base) {
+	if (a->region == R_LABEL) a->u.offset += base;
+}
+
+/*
+ * method_gen_begin - splice in the code of a ready method, with its
+ * labels moved to where they are in this compile (returns 0, don't walk
+ * it). Otherwise remember where its string literals will start.
+ */
+int method_gen_begin(struct tree *n) {
+
+	struct method_unit *u = n->unit;
+	struct instr *in;
+	int i;
+
+	if (!u->ready) {
+		u->uses_before = icn_strings.nuses;
+		return 1;
+	}
+
+	for (in = u->code; in != NULL; in = in->next) {
+		rebase(&in->dest, u->label_base);
+		rebase(&in->src1, u->label_base);
+		rebase(&in->src2, u->label_base);
+	}
+	n->icode = u->code;
+	n->icode_tail = u->code_tail;
+
+	for (i = 0; i < u->nstrings; i++) {
+		append_icn_string(u->string_text[i], u->string_addr[i]);
+	}
+
+	return 0;
+}
+
+/*
+ * method_gen_end - record the method's code and the string literals it
+ * uses. All of them, not just the ones it added to the pool: a literal
+ * first used by an earlier method may not be there next time.
+ */
+void method_gen_end(struct tree *n) {
+
+	struct method_unit *u = n->unit;
+	int i;
+
+	u->code = n->icode;
+	u->code_tail = n->icode;
+	while (u->code_tail != NULL && u->code_tail->next != NULL) {
+		u->code_tail = u->code_tail->next;
+	}
+
+	u->nstrings = icn_strings.nuses - u->uses_before;
+	u->string_text = malloc((u->nstrings + 1) * sizeof(char *));
+	u->string_addr = malloc((u->nstrings + 1) * sizeof(struct addr *));
+	for (i = 0; i < u->nstrings; i++) {
+		u->string_text[i] = icn_strings.uses[u->uses_before + i]->text;
+		u->string_addr[i] = icn_strings.uses[u->uses_before + i]->address;
+	}
+}
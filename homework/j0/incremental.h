@@ -0,0 +1,40 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdint.h>
+
+#include "tree.h"
+#include "intermediate.h"
+
+/* what is kept about one method of the file being compiled */
+struct method_unit {
+	struct tree *decl;		/* the MethodDecl */
+	uint64_t key;			/* hash of the class outline and the method */
+	int first_line, last_line;	/* source span */
+	int reused;			/* its code came from the cache */
+	int checked;			/* type checked, see parallel.c */
+	int ready;			/* code is here, labels relative to 0 */
+
+	int label_base, nlabels;	/* labels it uses, [base, base + n) */
+	struct instr *code, *code_tail;
+
+	/* string literals in the method, in order */
+	int nstrings;
+	char **string_text;
+	struct addr **string_addr;
+	int uses_before;		/* while generating it */
+
+	struct method_unit *next;
+};
+
+void plan_methods(struct tree *root, const char *flags);
+void save_methods();
+struct method_unit *method_units(struct tree *root);
+
+int method_checked(struct tree *n);
+int method_attr_begin(struct tree *n);
+void method_attr_end(struct tree *n);
+int method_gen_begin(struct tree *n);
+void method_gen_end(struct tree *n);
+
+#endif
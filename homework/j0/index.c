@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index.h"
+#include "token.h"
+#include "symboltable.h"
+
+/*
+ * j0 -index: every name populate_symbol_tables() resolves is noted here
+ * along with the entry it resolved to, and the notes are written out
+ * as a cross-reference index (see index.h) once the tables are built.
+ *
+ * There is no separate record of where a name is declared: a
+ * declaration inserts its name before the walk reaches the declarator,
+ * so the first use noted for an entry is its declaration. The builtins
+ * and the names poisoned after an error are the exceptions; they have
+ * no declaration in the file.
+ */
+
+struct use {
+	struct token *t;
+	SymbolTableEntry e;
+	int seq;
+};
+
+static struct use *uses = NULL;
+static int nuses = 0, uses_size = 0;
+static int indexing = 0;
+
+void index_start() {
+	indexing = 1;
+}
+
+/* index_use - note that the name at t refers to e */
+void index_use(struct token *t, SymbolTableEntry e) {
+
+	if (!indexing || t == NULL || e == NULL) return;
+
+	if (nuses == uses_size) {
+		uses_size = uses_size ? uses_size * 2 : 256;
+		uses = realloc(uses, uses_size * sizeof(struct use));
+		if (uses == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(4);
+		}
+	}
+
+	uses[nuses].t = t;
+	uses[nuses].e = e;
+	uses[nuses].seq = nuses;
+	nuses++;
+}
+
+/* uses sorted by position, the order of the refs */
+static int by_position(const void *a, const void *b) {
+
+	const struct use *x = a, *y = b;
+	int c = strcmp(x->t->filename, y->t->filename);
+
+	if (c != 0) return c;
+	if (x->t->lineno != y->t->lineno) return x->t->lineno - y->t->lineno;
+	if (x->t->colno != y->t->colno) return x->t->colno - y->t->colno;
+	return x->seq - y->seq;
+}
+
+/* refs grouped by entry, in position order within a group */
+static int by_entry(const void *a, const void *b) {
+
+	const uint32_t *x = a, *y = b;
+	SymbolTableEntry ex = uses[*x].e, ey = uses[*y].e;
+
+	if (ex != ey) return ex < ey ? -1 : 1;
+	return (int) *x - (int) *y;
+}
+
+static struct index_symbol *name_symbols;
+static char *name_strings;
+
+static int by_name(const void *a, const void *b) {
+
+	const uint32_t *x = a, *y = b;
+	int c = strcmp(name_strings + name_symbols[*x].name,
+		name_strings + name_symbols[*y].name);
+
+	return c != 0 ? c : (int) *x - (int) *y;
+}
+
+/* is_builtin - e is in the builtin image, which the global scope chains to */
+static int is_builtin(SymbolTableEntry e) {
+
+	SymbolTable st;
+
+	for (st = e->table; st != NULL; st = st->parent) {
+		if (st == globals) return 0;
+	}
+	return 1;
+}
+
+struct strings {
+	FILE *f;
+	char *last[2];		/* file and scope names repeat, keep the last two */
+	uint32_t last_at[2];
+};
+
+/* put_string - offset of text in the strings section */
+static uint32_t put_string(struct strings *s, char *text) {
+
+	uint32_t at;
+
+	if (text == NULL) text = "";
+	if (text == s->last[0]) return s->last_at[0];
+	if (text == s->last[1]) return s->last_at[1];
+
+	at = ftell(s->f);
+	fwrite(text, 1, strlen(text) + 1, s->f);
+
+	s->last[1] = s->last[0];
+	s->last_at[1] = s->last_at[0];
+	s->last[0] = text;
+	s->last_at[0] = at;
+
+	return at;
+}
+
+/*
+ * write_index - write what was noted to path. Returns 0, or -1 if it
+ * could not be written.
+ */
+int write_index(char *path) {
+
+	struct index_header h;
+	struct index_symbol *symbols;
+	struct index_ref *refs;
+	uint32_t *by_symbol, *sorted, *renumber;
+	struct strings strings = { NULL, { NULL, NULL }, { 0, 0 } };
+	char *strings_buf;
+	size_t strings_len;
+	int nsymbols = 0, i, j, k;
+	FILE *f;
+
+	qsort(uses, nuses, sizeof(struct use), by_position);
+
+	strings.f = open_memstream(&strings_buf, &strings_len);
+	refs = calloc(nuses + 1, sizeof(struct index_ref));
+	by_symbol = malloc((nuses + 1) * sizeof(uint32_t));
+	symbols = calloc(nuses + 1, sizeof(struct index_symbol));
+
+	for (i = 0; i < nuses; i++) {
+		refs[i].file = put_string(&strings, uses[i].t->filename);
+		refs[i].line = uses[i].t->lineno;
+		refs[i].col = uses[i].t->colno;
+		refs[i].len = strlen(uses[i].t->text);
+		by_symbol[i] = i;
+	}
+	qsort(by_symbol, nuses, sizeof(uint32_t), by_entry);
+
+	/* a symbol per entry; the use noted first declares it */
+	for (i = 0; i < nuses; i = j) {
+		SymbolTableEntry e = uses[by_symbol[i]].e;
+		struct index_symbol *s = &symbols[nsymbols];
+		int first = by_symbol[i];
+
+		for (j = i; j < nuses && uses[by_symbol[j]].e == e; j++) {
+			refs[by_symbol[j]].symbol = nsymbols;
+			if (uses[by_symbol[j]].seq < uses[first].seq) first = by_symbol[j];
+		}
+
+		s->name = put_string(&strings, e->s);
+		s->scope = put_string(&strings, e->table->table_name);
+		s->kind = e->type ? e->type->basetype : 0;
+		s->decl = is_builtin(e) || s->kind == ERROR_TYPE ? -1 : first;
+		s->first = i;
+		s->nrefs = j - i;
+		nsymbols++;
+	}
+	fclose(strings.f);
+
+	/* put the symbols in name order */
+	sorted = malloc((nsymbols + 1) * sizeof(uint32_t));
+	renumber = malloc((nsymbols + 1) * sizeof(uint32_t));
+	for (k = 0; k < nsymbols; k++) {
+		sorted[k] = k;
+	}
+	name_symbols = symbols;
+	name_strings = strings_buf;
+	qsort(sorted, nsymbols, sizeof(uint32_t), by_name);
+	for (k = 0; k < nsymbols; k++) {
+		renumber[sorted[k]] = k;
+	}
+	for (i = 0; i < nuses; i++) {
+		refs[i].symbol = renumber[refs[i].symbol];
+	}
+
+	if ((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	memset(&h, 0, sizeof(h));
+	h.magic = INDEX_MAGIC;
+	h.version = INDEX_VERSION;
+	h.nsymbols = nsymbols;
+	h.nrefs = nuses;
+	h.strings_len = strings_len;
+	fwrite(&h, sizeof(h), 1, f);
+	for (k = 0; k < nsymbols; k++) {
+		fwrite(&symbols[sorted[k]], sizeof(struct index_symbol), 1, f);
+	}
+	fwrite(refs, sizeof(struct index_ref), nuses, f);
+	fwrite(by_symbol, sizeof(uint32_t), nuses, f);
+	fwrite(strings_buf, 1, strings_len, f);
+
+	free(sorted);
+	free(renumber);
+	free(symbols);
+	free(refs);
+	free(by_symbol);
+	free(strings_buf);
+
+	return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,50 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdint.h>
+
+/*
+ * The cross-reference index written by j0 -index, next to the .icn, and
+ * read by j0query. It is laid out to be mmap()ed and searched in place:
+ *
+ *	header
+ *	symbols		every declared name, sorted by name
+ *	refs		every occurrence of a name, declarations included,
+ *			sorted by file, line and column
+ *	by_symbol	indexes into refs, grouped by symbol and sorted
+ *	strings		NUL terminated names, scopes and file names
+ *
+ * Strings are offsets into the strings section. A builtin (System.out
+ * and such) has no declaration and a decl of -1.
+ */
+
+#define INDEX_MAGIC 0x6a30697a	/* "j0iz" */
+#define INDEX_VERSION 1
+
+struct index_header {
+	uint32_t magic, version;
+	uint32_t nsymbols, nrefs;
+	uint32_t strings_len;
+};
+
+struct index_symbol {
+	uint32_t name, scope;		/* scope is the table it is declared in */
+	int32_t kind;			/* basetype of its type, e.g. FUNC_TYPE */
+	int32_t decl;			/* the ref that declares it, or -1 */
+	uint32_t first, nrefs;		/* its refs, in by_symbol */
+};
+
+struct index_ref {
+	uint32_t file;
+	int32_t line, col, len;
+	uint32_t symbol;
+};
+
+struct token;
+struct sym_entry;
+
+void index_start();
+void index_use(struct token *t, struct sym_entry *e);
+int write_index(char *path);
+
+#endif
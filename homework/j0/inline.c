@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * Inlining of small leaf procedures. A call
+ *
+ *	PARM an; ... PARM a1; CALL f,n,d
+ *
+ * to a procedure f that calls nothing becomes a copy of f's body, after
+ *
+ *	ASN p1,a1; ... ASN pn,an
+ *
+ * with every RET x made ASN d,x and a GOTO to the end of the copy. Each
+ * slot of f's frame, its parameters first, is renamed to a new slot of
+ * the caller's, and each of its labels to a new label. A leaf can't be
+ * recursive, and once every call a procedure makes has been inlined it
+ * is a leaf itself, so the program is gone over until nothing changes.
+ *
+ * The cost model: a body no bigger than the PARMs, CALL and RET it saves
+ * is always inlined. A bigger one, up to INLINE_MAX_SIZE, is inlined
+ * while the caller has grown by no more than INLINE_MAX_GROWTH. A callee
+ * that uses a slot which may be a field (see cfg.h) is left alone, as
+ * the copy could not tell its own slot from the field.
+ */
+
+#define INLINE_MAX_SIZE 12	/* instructions in a body, but labels */
+#define INLINE_MAX_GROWTH 64	/* instructions inlining may add to a caller */
+
+struct proc {
+	struct instr *decl;	/* its D_PROC */
+	int size;
+	int leaf;		/* it has no CALL */
+	int inlinable;
+	int growth;		/* what inlining has added to it so far */
+	int nlabels;		/* from labels[0] */
+	int labels[2];
+};
+
+struct inliner {
+	struct proc *procs;
+	int nprocs;
+	int next_label;		/* above every label in the program */
+	struct instr *caller;	/* the D_PROC of the procedure inlined into */
+	int next_slot;		/* in its frame */
+	int *slot_map;		/* per callee slot, the caller's, -1 if none yet */
+	int nslots;
+};
+
+static void *xrealloc(void *p, size_t size) {
+
+	p = realloc(p, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static int is_decl(struct instr *in, int opcode) {
+	return in->code_type == DECLARATION && in->opcode == opcode;
+}
+
+static int in_proc(struct instr *in) {
+	return in != NULL && !is_decl(in, D_PROC);
+}
+
+static int is_slot(struct addr *a) {
+	return a->region == R_LOCAL && a->tag == OFFSET;
+}
+
+/* examine - size up p, and whether it could be inlined */
+static void examine(struct proc *p) {
+
+	struct instr *in;
+
+	p->size = 0;
+	p->leaf = 1;
+	p->inlinable = 1;
+	p->labels[0] = -1;
+	p->labels[1] = -1;
+
+	for (in = p->decl->next; in_proc(in); in = in->next) {
+		struct addr *as[3] = {&in->dest, &in->src1, &in->src2};
+
+		if (is_decl(in, D_LABEL)) {
+			if (p->labels[0] < 0 || in->dest.u.offset < p->labels[0]) {
+				p->labels[0] = in->dest.u.offset;
+			}
+			if (in->dest.u.offset > p->labels[1]) p->labels[1] = in->dest.u.offset;
+			continue;
+		}
+		if (in->code_type == DECLARATION) {
+			p->inlinable = 0;
+			continue;
+		}
+
+		if (in->opcode == O_CALL) p->leaf = 0;
+		if (in->opcode != O_RET) p->size++;
+		for (int k = 0; k < 3; k++) {
+			if (as[k]->region == R_LOCAL && !is_private(as[k])) p->inlinable = 0;
+		}
+	}
+
+	p->nlabels = p->labels[0] < 0 ? 0 : p->labels[1] - p->labels[0] + 1;
+	if (!p->leaf || p->size > INLINE_MAX_SIZE) p->inlinable = 0;
+}
+
+/* find_proc - the procedure called name, NULL if there is not just one */
+static struct proc *find_proc(struct inliner *x, char *name) {
+
+	struct proc *found = NULL;
+
+	if (name == NULL) return NULL;
+
+	for (int i = 0; i < x->nprocs; i++) {
+		if (x->procs[i].decl->name == NULL || strcmp(x->procs[i].decl->name, name) != 0) {
+			continue;
+		}
+		if (found != NULL) return NULL;
+		found = &x->procs[i];
+	}
+	return found;
+}
+
+/* worth_it - the cost model, see above */
+static int worth_it(struct proc *caller, struct proc *callee, int nparams) {
+
+	if (!callee->inlinable) return 0;
+	if (callee->size <= nparams + 2) return 1;
+	return caller->growth + callee->size <= INLINE_MAX_GROWTH;
+}
+
+static struct addr rename_addr(struct inliner *x, struct proc *callee, struct addr a) {
+
+	if (a.region == R_LABEL && a.tag == OFFSET) {
+		a.u.offset = x->next_label + a.u.offset - callee->labels[0];
+	} else if (is_slot(&a)) {
+		int i = a.u.offset / 8;
+
+		if (i >= x->nslots) {
+			x->slot_map = xrealloc(x->slot_map, (i + 1) * sizeof(int));
+			while (x->nslots <= i) x->slot_map[x->nslots++] = -1;
+		}
+		if (x->slot_map[i] < 0) x->slot_map[i] = new_frame_slot(x->caller, &x->next_slot).u.offset;
+		a.u.offset = x->slot_map[i];
+	}
+	return a;
+}
+
+static struct instr *emit(struct instr ***link, struct instr *in) {
+
+	**link = in;
+	*link = &in->next;
+	return in;
+}
+
+/*
+ * expand - the code that does what call does, by way of a copy of
+ *  callee's body. parms are the call's PARMs, the last argument first.
+ */
+static struct instr *expand(struct inliner *x, struct proc *callee,
+	struct instr **parms, struct instr *call) {
+
+	struct instr *code = NULL, **link = &code, *in;
+	struct addr done, none;
+	int n = call->nparams, jumps = 0;
+
+	for (int i = 0; i < x->nslots; i++) x->slot_map[i] = -1;
+
+	memset(&none, 0, sizeof(none));
+	none.region = R_NONE;
+	memset(&done, 0, sizeof(done));
+	done.region = R_LABEL;
+	done.tag = OFFSET;
+	done.u.offset = x->next_label + callee->nlabels;
+
+	for (int i = 0; i < n; i++) {
+		struct addr param;
+
+		memset(&param, 0, sizeof(param));
+		param.region = R_LOCAL;
+		param.tag = OFFSET;
+		param.u.offset = 8 * i;
+		emit(&link, gen(O_ASN, rename_addr(x, callee, param), parms[n - 1 - i]->dest,
+			none));
+	}
+
+	for (in = callee->decl->next; in_proc(in); in = in->next) {
+		struct instr *copy;
+
+		if (in->code_type != DECLARATION && in->opcode == O_RET) {
+			if (in->dest.region != 0 && in->dest.region != R_NONE) {
+				emit(&link, gen(O_ASN, call->dest, rename_addr(x, callee, in->dest),
+					none));
+			}
+			if (in_proc(in->next)) {
+				emit(&link, gen(O_GOTO, done, none, none));
+				jumps++;
+			}
+			continue;
+		}
+
+		copy = emit(&link, gen(in->opcode, rename_addr(x, callee, in->dest),
+			rename_addr(x, callee, in->src1), rename_addr(x, callee, in->src2)));
+		copy->code_type = in->code_type;
+	}
+
+	/* a label no one goes to would only split the block */
+	if (jumps > 0) {
+		in = emit(&link, gen(D_LABEL, done, none, none));
+		in->code_type = DECLARATION;
+	}
+
+	x->next_label = done.u.offset + 1;
+	return code;
+}
+
+/* inline_into - inline what calls p makes that are worth it; returns how many */
+static int inline_into(struct inliner *x, struct proc *p) {
+
+	struct instr **link = &p->decl->next, **first_parm = NULL;
+	int nparms = 0, inlined = 0;
+
+	x->caller = p->decl;
+	x->next_slot = frame_end(p->decl);
+
+	while (in_proc(*link)) {
+		struct instr *in = *link, *code, *parms[64];
+		struct proc *callee;
+		int n = in->nparams;
+
+		if (in->code_type == DECLARATION || (in->opcode != O_PARM && in->opcode != O_CALL)) {
+			nparms = 0;
+			link = &in->next;
+			continue;
+		}
+		if (in->opcode == O_PARM) {
+			if (nparms++ == 0) first_parm = link;
+			link = &in->next;
+			continue;
+		}
+
+		/* a CALL, after its own PARMs at the end of the run */
+		callee = find_proc(x, in->name);
+		if (callee == NULL || n > nparms || n > 64 || callee->decl->nparams != n ||
+			!worth_it(p, callee, n)) {
+			nparms = 0;
+			link = &in->next;
+			continue;
+		}
+
+		if (n == 0) {
+			first_parm = link;
+		} else {
+			for (int i = 0; i < nparms - n; i++) first_parm = &(*first_parm)->next;
+		}
+		for (int i = 0; i < n; i++) parms[i] = i ? parms[i - 1]->next : *first_parm;
+
+		code = expand(x, callee, parms, in);
+		*first_parm = code;
+		for (link = first_parm; *link != NULL; link = &(*link)->next);
+		*link = in->next;
+
+		p->growth += callee->size;
+		nparms = 0;
+		inlined++;
+	}
+
+	return inlined;
+}
+
+/*
+ * inline_calls - inline the calls to small leaf procedures throughout the
+ *  program, see above. Returns how many were.
+ */
+int inline_calls(struct instr *code, struct opt_stats *stats) {
+
+	struct inliner x;
+	struct instr *in;
+	int size = 0, inlined = 0, changed = 1;
+
+	memset(&x, 0, sizeof(x));
+
+	for (in = code; in != NULL; in = in->next) {
+		if (is_decl(in, D_LABEL) && in->dest.u.offset >= x.next_label) {
+			x.next_label = in->dest.u.offset + 1;
+		}
+		if (!is_decl(in, D_PROC)) continue;
+		if (x.nprocs == size) {
+			size = size ? 2 * size : 16;
+			x.procs = xrealloc(x.procs, size * sizeof(struct proc));
+		}
+		memset(&x.procs[x.nprocs], 0, sizeof(struct proc));
+		x.procs[x.nprocs++].decl = in;
+	}
+
+	while (changed) {
+		changed = 0;
+		for (int i = 0; i < x.nprocs; i++) examine(&x.procs[i]);
+		for (int i = 0; i < x.nprocs; i++) {
+			int n = inline_into(&x, &x.procs[i]);
+
+			if (n > 0) {
+				/* it may be a leaf now, for the callers after it */
+				examine(&x.procs[i]);
+				inlined += n;
+				changed = 1;
+			}
+		}
+	}
+
+	free(x.procs);
+	free(x.slot_map);
+	stats->inlined += inlined;
+	return inlined;
+}
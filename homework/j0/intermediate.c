@@ -1,8 +1,14 @@
 #include "intermediate.h"
+#include "incremental.h"
+#include "cache.h"
+#include "cfg.h"
 
 struct addr empty_address = {R_NONE, OFFSET, {0}};
+static struct addr zero_address = {R_CONST, OFFSET, {0}};
+static struct addr one_address = {R_CONST, OFFSET, {1}};
 
-struct icn_string *icn_strings = NULL;
+/* per thread, like labelcounter */
+_Thread_local struct string_pool icn_strings;
 
 // struct instr instructions = NULL;
 
@@ -33,10 +39,6 @@ int print_intermediate_tree(struct tree* tree, int depth) {
 	printf("%*s %s: %d ", depth*4, " ", humanreadable(tree->prodrule),
 	 tree->nkids);
 
-	 if (tree->first) {
-	 	printf("[#first] ");
-	 }
-
 	 if (tree->follow) {
 		printf("[#has follow]\n");
 	} else {
@@ -51,34 +53,205 @@ int print_intermediate_tree(struct tree* tree, int depth) {
 
 }
 
-void gen_intermediate_code(struct tree *n) {
+static struct instr *last_instr(struct instr *l) {
+	while (l != NULL && l->next != NULL) l = l->next;
+	return l;
+}
 
-	int i;
-	if (n == NULL) return;
+static struct instr *tail_of(struct tree *n) {
+	return n->icode_tail ? n->icode_tail : last_instr(n->icode);
+}
 
-	for (i = 0; i < n->nkids; i++) {
-		if(n->kids[i] == NULL) {
-			printf("null child\n");
-			continue;
-		}
-		if (n->kids[i]->prodrule == prodR_QualifiedName) {
-			// printf("Qualified name found here \n");
-			gen_qualified_addr(n->kids[i]);
+/* link_code - append the list l, whose last instruction is tail, to n's code */
+static void link_code(struct tree *n, struct instr *l, struct instr *tail) {
 
-		} else {
-			 // n->kids[i]->icode
-			 // struct instr *child = gen_intermediate_code(n->kids[i]);
-			 // n->icode->next = child;
-			 gen_intermediate_code(n->kids[i]);
+	if (l == NULL) return;
+
+	if (n->icode == NULL) {
+		n->icode = l;
+	} else {
+		n->icode_tail->next = l;
+	}
+	n->icode_tail = tail;
+}
+
+/* link_kid - append kid's code, if it has any, to n's */
+static void link_kid(struct tree *n, struct tree *kid) {
+	if (kid != NULL) link_code(n, kid->icode, tail_of(kid));
+}
+
+/*
+ * join_code - set n's code to the code of a, then b, then last, linking the
+ *  lists in place rather than copying them. Nothing else holds on to a kid's
+ *  code once its parent is generated, and with the tails cached on the nodes
+ *  a long statement chain or deeply nested expression is joined in linear
+ *  time instead of being copied once per level.
+ */
+static void join_code(struct tree *n, struct tree *a, struct tree *b, struct instr *last) {
+
+	struct instr *lists[3], *tails[3];
+
+	lists[0] = a ? a->icode : NULL;
+	tails[0] = a ? tail_of(a) : NULL;
+	lists[1] = b ? b->icode : NULL;
+	tails[1] = b ? tail_of(b) : NULL;
+	lists[2] = last;
+	tails[2] = last_instr(last);
+
+	n->icode = NULL;
+	n->icode_tail = NULL;
+
+	for (int i = 0; i < 3; i++) {
+		link_code(n, lists[i], tails[i]);
+	}
+}
+
+static struct addr fall;
+static int is_not(struct tree *t);
+static int is_condition(struct tree *t);
+
+static void link_instr(struct tree *n, struct instr *in) {
+	link_code(n, in, in);
+}
+
+static void link_label(struct tree *n, struct addr *label) {
+
+	struct instr *in = gen(D_LABEL, *label, empty_address, empty_address);
+
+	in->code_type = DECLARATION;
+	link_instr(n, in);
+}
+
+static void link_goto(struct tree *n, struct addr *label) {
+	if (label != &fall) link_instr(n, gen(O_GOTO, *label, empty_address, empty_address));
+}
+
+/*
+ * link_jump - append to n's code the branch that takes c to its onTrue
+ *  or onFalse, op being the test for true and negop its opposite
+ */
+static void link_jump(struct tree *n, struct tree *c, int op, int negop,
+	struct addr a, struct addr b) {
+
+	if (c->onTrue != &fall) {
+		link_instr(n, gen(op, *c->onTrue, a, b));
+		link_goto(n, c->onFalse);
+	} else {
+		link_instr(n, gen(negop, *c->onFalse, a, b));
+	}
+}
+
+/* link_cond - append to n's code the jumping code of the condition c */
+static void link_cond(struct tree *n, struct tree *c) {
+
+	if (is_condition(c)) {
+		link_kid(n, c);
+	} else if (c->prodrule == TOKEN && c->leaf->category == BOOLLIT) {
+		link_goto(n, strcmp(c->leaf->text, "true") == 0 ? c->onTrue : c->onFalse);
+	} else {
+		link_kid(n, c);
+		/* none when c could not be compiled, as with a call to no method */
+		if (c->address != NULL) link_jump(n, c, O_BIF, O_BNIF, *c->address, empty_address);
+	}
+}
+
+/*
+ * temp_slot - the next slot of the frame of the method n is in, passing
+ *  over any a field is at: fields are R_LOCAL slots too.
+ */
+static struct addr temp_slot(struct tree *n) {
+
+	int next = n->stab->byte_words * 8;
+	struct addr a = frame_slot(&next);
+
+	n->stab->byte_words = next / 8;
+	return a;
+}
+
+/*
+ * materialize - turn the jumping code of a condition used as a value into
+ *  code that leaves 0 or 1 in its address. Its onTrue is &fall.
+ */
+static void materialize(struct tree *n) {
+
+	struct instr *zero;
+
+	if (n->address == NULL) return;
+
+	*n->address = temp_slot(n);
+
+	zero = gen(O_ASN, *n->address, zero_address, empty_address);
+	zero->next = n->icode;
+	n->icode = zero;
+	if (n->icode_tail == NULL) n->icode_tail = zero;
+
+	link_instr(n, gen(O_ASN, *n->address, one_address, empty_address));
+	link_label(n, n->onFalse);
+}
+
+/* local_temp - a new temporary in the frame of the method n is in */
+static struct addr *local_temp(struct tree *n) {
+
+	struct addr *t = newtemp(1);
+
+	*t = temp_slot(n);
+	return t;
+}
+
+/*
+ * element - append to n's code the address of element index of the array
+ *  at base, and return where it is left. An element is a word, the first
+ *  of them at the array's address.
+ */
+static struct addr *element(struct tree *n, struct addr *base, struct addr *index) {
+
+	struct addr *p = local_temp(n), scale = {R_CONST, OFFSET, {8}};
+
+	if (index->region == R_CONST && index->tag == OFFSET) {
+		scale.u.offset = 8 * index->u.offset;
+		link_instr(n, gen(O_ADD, *p, *base, scale));
+	} else {
+		struct addr *offset = local_temp(n);
+
+		link_instr(n, gen(O_MUL, *offset, *index, scale));
+		link_instr(n, gen(O_ADD, *p, *base, *offset));
+	}
+	return p;
+}
+
+/*
+ * size_frame - make the D_PROC of the method n declares big enough for
+ *  its frame. It starts as big as the class, whose fields the code names
+ *  as slots of the frame; the method's scope has a slot for each of its
+ *  parameters, locals and temporaries, known only once the body's code is.
+ */
+static void size_frame(struct tree *n) {
+
+	for (struct instr *in = n->icode; in != NULL; in = in->next) {
+		if (in->code_type == DECLARATION && in->opcode == D_PROC) {
+			if (n->stab->byte_words * 8 > in->block_bytes) in->block_bytes = n->stab->byte_words * 8;
+			return;
 		}
-	 }
+	}
+}
 
-	if (n->symbolname) {
-		/* code */
-		// printf("\n********** current node is %s\n", n->symbolname);
-		// printf("\n********** kids %d\n", n->nkids);
+static int gen_pre(struct tree *n, int depth, void *arg) {
+
+	if (n->unit != NULL) {
+		return method_gen_begin(n);
 	}
 
+	if (depth > 0 && n->prodrule == prodR_QualifiedName) {
+		// printf("Qualified name found here \n");
+		gen_qualified_addr(n);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int gen_node(struct tree *n, int depth, void *arg) {
+
 	switch (n->prodrule) {
 
 		case prodR_TypeAssignment:
@@ -89,10 +262,8 @@ void gen_intermediate_code(struct tree *n) {
 			int field_assn = strcmp(n->symbolname, "FieldDeclAssignment");
 
 			struct instr *current_instr;
-			struct instr *other_instr;
 
 			current_instr = gen(O_ASN, *n->kids[1]->address, *n->kids[3]->address, empty_address);
-			other_instr = n->kids[3]->icode;
 
 			if (field_assn == 0) {
 				n->address->region = R_GLOBAL;
@@ -101,7 +272,7 @@ void gen_intermediate_code(struct tree *n) {
 				n->address->region = R_LOCAL;
 			}
 
-			n->icode = concat(other_instr, current_instr);
+			join_code(n, n->kids[3], NULL, current_instr);
 			// //tacprint(n->icode);
 
 			break;
@@ -116,105 +287,207 @@ void gen_intermediate_code(struct tree *n) {
 			if (n->kids[0] == NULL) {
 				// printf("Empty return statement\n");
 				n->address = newtemp(1);
-				n->icode = gen(O_RET, *n->address, empty_address, empty_address);
+				n->icode = gen(O_RET, empty_address, empty_address, empty_address);
 
 			} else {
 				// printf("Return statement has an expresstion\n");
 				n->address = newtemp(1);
-				n->icode = gen(O_RET, *n->kids[0]->address, empty_address, empty_address);
-				// printf("%s\n", );
+				join_code(n, n->kids[0], NULL,
+					gen(O_RET, *n->kids[0]->address, empty_address, empty_address));
 			}
 
 
 			break;
 		}
 
-		// case prodR_UnaryAssignment: {
-		// 	break;
-		// }
+		case prodR_UnaryAssignment: {
+
+			int category = n->kids[1]->leaf->category;
+
+			/* x =; has no code, type checking having rejected it */
+			n->address = n->kids[0]->address;
+			if (category == INCREMENT) {
+				n->icode = gen(O_ADD, *n->address, *n->address, one_address);
+			} else if (category == DECREMENT) {
+				n->icode = gen(O_SUB, *n->address, *n->address, one_address);
+			}
+			break;
+		}
 
 		case prodR_Assignment: {
 
+			/*
+			 * A variable keeps its slot. It used to move to a new one at
+			 * every assignment, which only works for straight-line code;
+			 * the optimizer's SSA form does that renaming properly.
+			 */
+			/* a[k] = e stores e through the address of the element */
+			if (n->kids[0]->prodrule == prodR_PostBracketArray) {
+				struct tree *a = n->kids[0];
+
+				n->icode = NULL;
+				n->icode_tail = NULL;
+				link_kid(n, n->kids[2]);
+				n->address = n->kids[2]->address;
+				if (n->address == NULL || a->kids[0]->address == NULL ||
+					a->kids[1] == NULL || a->kids[1]->address == NULL) break;
+				link_instr(n, gen(O_SCONT, *element(n, a->kids[0]->address,
+					a->kids[1]->address), *n->address, empty_address));
+				break;
+			}
+
 			n->address = n->kids[0]->address;
-			n->address->region = R_LOCAL;
-			n->address->u.offset = n->stab->byte_words *  8;
-			n->stab->byte_words++;
 
 			struct instr *current_instr;
-			struct instr *other_instr;
 
 			current_instr = gen(O_ASN, *n->kids[0]->address, *n->kids[2]->address, empty_address);
-			other_instr = n->kids[2]->icode;
 
-			n->icode = concat(other_instr, current_instr);
+			join_code(n, n->kids[2], NULL, current_instr);
 			//tacprint(n->icode);
 
 			break;
 		}
 
+		/*
+		 * new T[k] is k words from the runtime's new, which zeroes them.
+		 * No method can be called new, it being a keyword.
+		 */
+		case prodR_ArrayInstantiation: {
+
+			struct tree *a = n->kids[0];
+			struct addr size = zero_address;
+
+			if (a->prodrule == prodR_PostBracketArray && a->kids[1] != NULL &&
+				a->kids[1]->address != NULL) size = *a->kids[1]->address;
+
+			n->icode = NULL;
+			n->icode_tail = NULL;
+			n->address = local_temp(n);
+			link_instr(n, gen(O_PARM, size, empty_address, empty_address));
+			link_instr(n, gen_method("new", 1, *n->address, O_CALL));
+			break;
+		}
+
+		case prodR_ArrayAccess: {
+
+			n->icode = NULL;
+			n->icode_tail = NULL;
+			link_kid(n, n->kids[1]);
+			if (n->kids[0]->address == NULL || n->kids[1]->address == NULL) break;
+
+			struct addr *p = element(n, n->kids[0]->address, n->kids[1]->address);
+
+			n->address = local_temp(n);
+			link_instr(n, gen(O_LCONT, *n->address, *p, empty_address));
+			break;
+		}
+
 		case prodR_UnaryExpr: {
 
-			int neg = strcmp(n->symbolname, "UnaryExpr_Neg");
-			n->address = newtemp(1);
-			n->address->region = R_LOCAL;
-			n->address->u.offset = n->stab->byte_words *  8;
-			n->stab->byte_words++;
+			if (is_not(n)) {
+				n->icode = NULL;
+				n->icode_tail = NULL;
+				link_cond(n, n->kids[1]);
+				materialize(n);
+				break;
+			}
 
-			struct instr *current_instr;
-			// struct instr *other_instr;
+			n->address = local_temp(n);
+
+			join_code(n, n->kids[1], NULL,
+				gen(O_NEG, *n->address, *n->kids[1]->address, empty_address));
+			break;
+		}
+
+		/*
+		 * A condition is jumping code, see genattributes(). Its value,
+		 * when it has one, comes from materialize().
+		 */
+		case prodR_RelExpr:
+		case prodR_EqExpr: {
+
+			struct tree *a = n->kids[0], *b = n->kids[n->nkids - 1];
+			int op, negop;
 
-			if (neg == 0) {
-				current_instr = gen(O_NEG, *n->address, *n->kids[1]->address,
-					 empty_address);
+			if (n->prodrule == prodR_EqExpr) {
+				int eq = strcmp(n->symbolname, "EqExpr_isequal") == 0;
+				op = eq ? O_BEQ : O_BNE;
+				negop = eq ? O_BNE : O_BEQ;
 			} else {
-				//Exclamation
-				current_instr = gen(O_NOT, *n->address, *n->kids[1]->address,
-					 empty_address);
+				switch (n->kids[1]->leaf->category) {
+					case '<': op = O_BLT; negop = O_BGE; break;
+					case '>': op = O_BGT; negop = O_BLE; break;
+					case GREATERTHANOREQUAL: op = O_BGE; negop = O_BLT; break;
+					default: op = O_BLE; negop = O_BGT; break;
+				}
 			}
 
-			// other_instr = n->kids[1]->icode;
-			n->icode = current_instr;
-			//tacprint(n->icode);
+			join_code(n, a, b, NULL);
+			link_jump(n, n, op, negop, *a->address, *b->address);
+			materialize(n);
+			break;
+		}
+
+		/* a && b: a falls through to b when it holds */
+		case prodR_CondAndExpr: {
 
+			n->icode = NULL;
+			n->icode_tail = NULL;
+			link_cond(n, n->kids[0]);
+			link_cond(n, n->kids[1]);
+			if (n->onFalse == &fall) link_label(n, n->kids[0]->onFalse);
+			materialize(n);
 			break;
 		}
 
-		case prodR_RelExpr: {
+		/* a || b: a falls through to b when it doesn't */
+		case prodR_CondOrExpr: {
 
-			// printf("The symbol is: %d\n", n->kids[1]->leaf->category);
-			struct instr *current_instr = NULL;
-			struct instr *other_instr = NULL;
+			n->icode = NULL;
+			n->icode_tail = NULL;
+			link_cond(n, n->kids[0]);
+			link_cond(n, n->kids[1]);
+			if (n->onTrue == &fall) link_label(n, n->kids[0]->onTrue);
+			materialize(n);
+			break;
+		}
 
-			n->address = newtemp(1);
+		case prodR_WhileStmt:
+		case prodR_ForStmt: {
+
+			/*
+			 * The test goes after the body, so a trip around the loop
+			 * takes one branch:
+			 *
+			 *	init; GOTO test; body: body; update; test: if cond GOTO body
+			 *
+			 * The loop's own onTrue and onFalse are the labels of its
+			 * body and of its test.
+			 */
+			int is_for = n->prodrule == prodR_ForStmt;
+			struct tree *cond = n->kids[is_for ? 1 : 0];
+			struct instr *go, *body_label, *test_label;
+
+			go = gen(O_GOTO, *n->onFalse, empty_address, empty_address);
+			body_label = gen(D_LABEL, *n->onTrue, empty_address, empty_address);
+			body_label->code_type = DECLARATION;
+			test_label = gen(D_LABEL, *n->onFalse, empty_address, empty_address);
+			test_label->code_type = DECLARATION;
 
-			switch (n->kids[1]->leaf->category) {
-				case 60:
-					// <
-					current_instr = gen(O_BLT, *n->onTrue,
-						 *n->kids[0]->address, *n->kids[2]->address);
-					break;
-				case 62:
-					// >
-					current_instr = gen(O_BGT, *n->onTrue,
-						 *n->kids[0]->address, *n->kids[2]->address);
-					break;
-				case 293:
-					// >=
-					current_instr = gen(O_BGE, *n->onTrue,
-						 *n->kids[0]->address, *n->kids[2]->address);
-					break;
-				case 294:
-					// <=
-					current_instr = gen(O_BLE, *n->onTrue,
-						 *n->kids[0]->address, *n->kids[2]->address);
-					break;
+			n->icode = NULL;
+			n->icode_tail = NULL;
+			if (is_for) link_kid(n, n->kids[0]);
+			link_code(n, go, go);
+			link_code(n, body_label, body_label);
+			link_kid(n, n->kids[is_for ? 3 : 1]);
+			if (is_for) link_kid(n, n->kids[2]);
+			link_code(n, test_label, test_label);
+
+			if (cond == NULL) {
+				link_goto(n, n->onTrue);
+			} else {
+				link_cond(n, cond);
 			}
-
-			other_instr = concat(n->kids[0]->icode, n->kids[2]->icode);
-			n->icode = concat(current_instr, other_instr);
-			// printf("\n");
-			// printf("Region %d\n", n->icode->dest.region);
-			// tacprint(n->icode);
 			break;
 		}
 
@@ -238,7 +511,8 @@ void gen_intermediate_code(struct tree *n) {
 			n->address = newtemp(1);
 			n->address->region = R_PROCNAME;
 
-			SymbolTableEntry method = check_if_undeclared(n->stab, n->kids[0]->leaf->text);
+			SymbolTableEntry method = n->kids[0]->entry ? n->kids[0]->entry :
+				check_if_undeclared(n->stab, n->kids[0]->leaf->text);
 
 			if (method != NULL) {
 
@@ -247,6 +521,7 @@ void gen_intermediate_code(struct tree *n) {
 
 				n->icode = gen_method(method_name, params, *method->address, D_PROC);
 				n->icode->code_type = DECLARATION;
+				/* fields are slots of the frame too, see size_frame() */
 				n->icode->block_bytes = method->table->byte_words * 8;
 				// tacprint(n->icode);
 
@@ -261,13 +536,9 @@ void gen_intermediate_code(struct tree *n) {
 		case prodR_AddExpr: {
 
 			int add = strcmp(n->symbolname, "AddExpr_add");
-			n->address = newtemp(1);
-			n->address->region = R_LOCAL;
-			n->address->u.offset = n->stab->byte_words *  8;
-			n->stab->byte_words++;
+			n->address = local_temp(n);
 
 			struct instr *current_instr;
-			struct instr *other_instr;
 
 			if (add == 0) {
 				current_instr = gen(O_ADD, *n->address, *n->kids[0]->address,
@@ -278,8 +549,7 @@ void gen_intermediate_code(struct tree *n) {
 					 *n->kids[1]->address);
 			}
 
-			other_instr = concat(n->kids[0]->icode, n->kids[1]->icode);
-			n->icode = concat(other_instr, current_instr);
+			join_code(n, n->kids[0], n->kids[1], current_instr);
 			//tacprint(n->icode);
 
  			break;
@@ -290,13 +560,9 @@ void gen_intermediate_code(struct tree *n) {
 			int multiply = strcmp(n->symbolname, "MulExpr_multiply");
 			int divide = strcmp(n->symbolname, "MulExpr_divide");
 
-			n->address = newtemp(1);
-			n->address->region = R_LOCAL;
-			n->address->u.offset = n->stab->byte_words *  8;
-			n->stab->byte_words++;
+			n->address = local_temp(n);
 
 			struct instr *current_instr;
-			struct instr *other_instr;
 
 			if (multiply == 0) {
 				current_instr = gen(O_MUL, *n->address, *n->kids[0]->address,
@@ -309,50 +575,24 @@ void gen_intermediate_code(struct tree *n) {
 					 *n->kids[1]->address);
 			}
 
-			other_instr = concat(n->kids[0]->icode, n->kids[1]->icode);
-			n->icode = concat(other_instr, current_instr);
+			join_code(n, n->kids[0], n->kids[1], current_instr);
 			//tacprint(n->icode);
 			break;
 		}
 
+		case prodR_ArgList: {
+			gen_arglist(n);
+			break;
+		}
+
 		case prodR_MethodCall: {
 
-			struct instr *method_params;
 			struct instr *method_call;
-
-			if (n->kids[1]->nkids == 0) {
-				//Expr
-				switch (n->kids[1]->leaf->category) {
-					case IDENTIFIER: {
-
-						int set = set_identifier_addr(n->kids[1]);
-
-						if (set == 1) {
-							method_params = gen(O_PARM, *n->kids[1]->address, empty_address, empty_address);
-							// //tacprint(method_params);
-						}
-						break;
-					}
-
-					case INTLIT:
-					case STRINGLIT:
-					case REALLIT:
-					case BOOLLIT:
-					case CHARLIT:
-						// printf("Handle literals here\n");
-						gentoken(n->kids[1]);
-						method_params = gen(O_PARM, *n->kids[1]->address, empty_address, empty_address);
-
-						break;
-				}
-			} else {
-				// Arglist in kids[1]
-				method_params = gen_arglist(n->kids[1]);
-			}
-
 			SymbolTableEntry method;
 
-			if (n->kids[0]->prodrule == prodR_QualifiedName) {
+			if (n->kids[0]->entry != NULL) {
+				method = n->kids[0]->entry;
+			} else if (n->kids[0]->prodrule == prodR_QualifiedName) {
 				struct tree *last_name = get_last_name(n->kids[0]);
 				method = check_if_undeclared(last_name->stab, last_name->leaf->text);
 
@@ -363,9 +603,13 @@ void gen_intermediate_code(struct tree *n) {
 			if (method != NULL) {
 				char* method_name = method->type->u.f.name;
 				int params = method->type->u.f.nparams;
-				method_call = gen_method(method_name, params, *method->address, O_CALL);
 
-				n->icode = concat(method_params, method_call);
+				/* the result goes to a temporary of the caller's */
+				n->address = local_temp(n);
+
+				method_call = gen_method(method_name, params, *n->address, O_CALL);
+
+				join_code(n, n->kids[1], NULL, method_call);
 				//tacprint(n->icode);
 
 			} else {
@@ -375,33 +619,43 @@ void gen_intermediate_code(struct tree *n) {
 			break;
 		}
 
-		case prodR_IfThenStmt: {
+		/*
+		 * cond; then; onFalse: and with an else, cond; then; GOTO follow;
+		 * onFalse: else; follow: where the else of an else-if chain is
+		 * its sequence of IfThenStmts, which all go to the follow of the
+		 * chain when they are done.
+		 */
+		case prodR_IfThenStmt:
+		case prodR_IfThenElseStmt:
+		case prodR_IfThenElseIfStmt:
+		case prodR_IfThenElseIfElseStmt: {
 
-			if (n->kids[0]->icode != NULL) {
-				n->icode = n->kids[0]->icode;
-			} else {
-				n->icode = gen(O_BIF, *n->kids[0]->onFalse,
-					 *n->kids[0]->address, empty_address);
+			n->icode = NULL;
+			n->icode_tail = NULL;
+			link_cond(n, n->kids[0]);
+			link_kid(n, n->kids[1]);
+			if (n->follow != NULL) link_goto(n, n->follow);
+			link_label(n, n->onFalse);
+
+			if (n->prodrule != prodR_IfThenStmt) {
+				for (int i = 2; i < n->nkids; i++) link_kid(n, n->kids[i]);
+				link_label(n, n->follow);
 			}
-
-			struct instr *label = gen(D_LABEL, *n->kids[0]->onTrue, empty_address, empty_address);
-			label = concat(label, n->kids[1]->icode);
-			label->code_type = DECLARATION;
-			n->icode = concat(n->icode, label);
-
 			break;
 		}
 
-
 		case prodR_BlockStmts: {
-			n->kids[0]->follow = n->kids[1]->first;
-			n->kids[1]->follow = n->kids[0]->follow;
-
-			n->icode = concat(n->kids[0]->icode, n->kids[1]->icode);
+			join_code(n, n->kids[0], n->kids[1], NULL);
 			// tacprint(n->icode);
 			break;
 		}
 
+		case prodR_ElseIfSequence:
+		case prodR_ClassBodyDecls: {
+			join_code(n, n->kids[0], n->kids[1], NULL);
+			break;
+		}
+
 		case TOKEN: {
 			gentoken(n);
 			break;
@@ -413,13 +667,24 @@ void gen_intermediate_code(struct tree *n) {
 
 			for (int i=0; i < n->nkids; i++) {
 				// printf("%s --> %s\n", n->kids[i]->symbolname,n->symbolname);
-				n->icode = concat(n->icode, n->kids[i]->icode);
+				if (n->kids[i] != NULL) n->icode = concat(n->icode, n->kids[i]->icode);
 			}
 
 	}
 
+	if (n->prodrule == prodR_MethodDecl) size_frame(n);
+	if (n->unit != NULL) {
+		method_gen_end(n);
+	}
+
+	return 1;
 }
 
+void gen_intermediate_code(struct tree *n) {
+	walk_tree(n, gen_pre, gen_node, NULL);
+}
+
+
 struct addr *newtemp(int num_bytes) {
 
 	struct addr *temp = malloc(sizeof(struct addr));
@@ -429,256 +694,219 @@ struct addr *newtemp(int num_bytes) {
 }
 
 
-void genfirst(struct tree *t) {
-
-	if (t->nkids != 0) {
-		for (int i = 0; i < t->nkids; i++) {
-			genfirst(t->kids[i]);
-		}
-		// printf("________ %s ________\n\n", t->symbolname);
-		switch (t->prodrule) {
+/*
+ * Attribute evaluation for the labels used by codegen.
+ *
+ * Codegen lays out the statements in the order of the tree, so the labels
+ * it needs are the ones jumps go to: the targets of a condition, onTrue
+ * and onFalse, and the labels a statement places itself. A condition is
+ * compiled to jumping code, which goes to onTrue when it holds and to
+ * onFalse when it doesn't. At most one of them is &fall, the code that
+ * comes right after the condition, so a test costs one compare and branch.
+ *
+ * A statement makes its labels and its condition's targets when it is
+ * done in a post-order walk. The targets are inherited from there by the
+ * kids of &&, || and !, pushed down with an explicit worklist: a node's
+ * targets are set exactly once, so the pushes are linear in the size of
+ * the tree. A condition that is a value instead, x = a < b, materializes
+ * it as 0 or 1 and gets its address here, to tell it from one that jumps.
+ *
+ * All labels are made here rather than in codegen, so that incremental.c
+ * can count the labels of a method in this walk.
+ */
+struct attr_worklist {
+	struct tree **nodes;
+	int top;
+	int size;
+};
 
-			case prodR_AddExpr:
-			case prodR_MulExpr: {
+/* the target of a jump to the code that comes next, which needs none */
+static struct addr fall = {R_LABEL, OFFSET, {-1}};
 
-				if (t->kids[0]->first != NULL) {
-					t->first = t->kids[0]->first;
-				} else if (t->kids[1]->first != NULL) {
-					t->first = t->kids[1]->first;
-				} else {
-					struct addr *temp = genlabel();
-					t->first = temp;
-				}
+static int is_not(struct tree *t) {
+	return t->prodrule == prodR_UnaryExpr && strcmp(t->symbolname, "UnaryExpr_Excl") == 0;
+}
 
-				// printf("L%d %s\n", t->first->u.offset, t->symbolname);
+/* is_condition - t is an operator whose code is jumping code */
+static int is_condition(struct tree *t) {
 
-				break;
-			}
+	if (t == NULL) return 0;
+	switch (t->prodrule) {
+		case prodR_RelExpr:
+		case prodR_EqExpr:
+		case prodR_CondAndExpr:
+		case prodR_CondOrExpr:
+			return 1;
+	}
+	return is_not(t);
+}
 
-			case prodR_UnaryExpr: {
+/* condition_of - which kid of t is a condition it jumps on, -1 if none */
+static int condition_of(struct tree *t) {
 
-				if (t->kids[1]->first != NULL) {
-					t->first = t->kids[1]->first;
-				} else {
-					t->first = genlabel();
-				}
+	switch (t->prodrule) {
+		case prodR_IfThenStmt:
+		case prodR_IfThenElseStmt:
+		case prodR_IfThenElseIfStmt:
+		case prodR_IfThenElseIfElseStmt:
+		case prodR_WhileStmt:
+			return 0;
+		case prodR_ForStmt:
+			return 1;
+	}
+	return -1;
+}
 
-				// printf("L%d %s\n", t->first->u.offset, t->symbolname);
-				break;
-			}
+static void push(struct attr_worklist *wl, struct tree *t) {
 
-			case prodR_Assignment: {
+	if (wl->top == wl->size) {
+		wl->size = wl->size ? wl->size * 2 : 64;
+		wl->nodes = realloc(wl->nodes, wl->size * sizeof(struct tree *));
+		if (wl->nodes == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(4);
+		}
+	}
+	wl->nodes[wl->top++] = t;
+}
 
-				if (t->kids[0]->first != NULL) {
-					t->first = t->kids[0]->first;
-				} else if (t->kids[1]->first != NULL) {
-					t->first = t->kids[1]->first;
-				} else {
-					struct addr *temp = genlabel();
-					t->first = temp;
-				}
+static void set_targets(struct attr_worklist *wl, struct tree *kid,
+	struct addr *on_true, struct addr *on_false) {
 
-				// printf("L%d %s\n", t->first->u.offset, t->symbolname);
-				break;
-			}
+	if (kid == NULL) return;
 
-			case prodR_TypeAssignment:
-			case prodR_FieldDeclAssign: {
+	kid->onTrue = on_true;
+	kid->onFalse = on_false;
+	push(wl, kid);
+}
 
-				if (t->kids[1]->first != NULL) {
-					t->first = t->kids[1]->first;
-				} else if (t->kids[3]->first != NULL) {
-					t->first = t->kids[3]->first;
-				} else {
-					struct addr *temp = genlabel();
-					t->first = temp;
-				}
-				// printf("L%d %s\n", t->first->u.offset, t->symbolname);
-				break;
-			}
+static void set_follow(struct attr_worklist *wl, struct tree *kid, struct addr *follow) {
 
-			case prodR_RelExpr: {
-				// printf("RELEXPR case\n");
-				if (t->kids[0]->first != NULL) {
-					t->first = t->kids[0]->first;
-				} else if (t->kids[2]->first != NULL) {
-					t->first = t->kids[2]->first;
-				} else {
-					struct addr *temp = genlabel();
-					t->first = temp;
-				}
-				// printf("L%d %s\n", t->first->u.offset, t->symbolname);
-				break;
-			}
+	if (kid == NULL) return;
 
-			case prodR_EqExpr:
-			case prodR_CondAndExpr:
-			case prodR_CondOrExpr: {
+	kid->follow = follow;
+	push(wl, kid);
+}
 
-				if (t->kids[0]->first != NULL) {
-					t->first = t->kids[0]->first;
-				} else if (t->kids[1]->first != NULL) {
-					t->first = t->kids[1]->first;
-				} else {
-					struct addr *temp = genlabel();
-					t->first = temp;
-				}
-				// printf("L%d %s\n", t->first->u.offset, t->symbolname);
-				break;
-			}
+/*
+ * push_inherited - hand the inherited attributes of every node on the
+ *  worklist down to its kids. && and || jump past their second operand
+ *  when the first one decides; if that is where they fall through to, it
+ *  gets a label of its own, which codegen places after the second one.
+ */
+static void push_inherited(struct attr_worklist *wl) {
 
-			case prodR_WhileStmt: {
+	while (wl->top > 0) {
 
-				if (t->kids[0]->first != NULL) {
-					t->first = t->kids[0]->first;
-				} else {
-					t->first = genlabel();
-				}
-				// printf("L%d %s\n", t->first->u.offset, t->symbolname);
-				break;
-			}
+		struct tree *t = wl->nodes[--wl->top];
 
-			case prodR_IfThenStmt:
-			case prodR_IfThenElseStmt:
-			case prodR_IfThenElseIfStmt:
-			case prodR_IfThenElseIfElseStmt: {
+		switch (t->prodrule) {
 
-				if (t->kids[0]->first != NULL) {
-					t->first = t->kids[0]->first;
-				} else {
-					t->first = genlabel();
-				}
-				// printf("L%d %s\n", t->first->u.offset, t->symbolname);
+			case prodR_ElseIfSequence: {
+				set_follow(wl, t->kids[0], t->follow);
+				set_follow(wl, t->kids[1], t->follow);
 				break;
 			}
 
-			case prodR_BlockStmts: {
-
-				// printf("Hit Block stmt\n");
-				if (t->kids[1]->first == NULL) {t->kids[1]->first = genlabel();}
-
-				if (t->kids[0]->first != NULL) {
-					t->first = t->kids[0]->first;
-				} else {
-					t->first = t->kids[1]->first;
-				}
-				// printf("And assigned FIRST\n");
-				// printf("L%d %s\n", t->first->u.offset, t->symbolname);
+			case prodR_CondAndExpr: {
+				set_targets(wl, t->kids[0], &fall,
+					t->onFalse == &fall ? genlabel() : t->onFalse);
+				set_targets(wl, t->kids[1], t->onTrue, t->onFalse);
 				break;
 			}
 
-			case prodR_MethodDecl: {
-
-				if (t->kids[1]->first == NULL) {t->kids[1]->first = genlabel();}
-
-				t->first = t->kids[1]->first;
-				// printf("And assigned FIRST\n");
-				// printf("L%d %s\n", t->first->u.offset, t->symbolname);
-
+			case prodR_CondOrExpr: {
+				set_targets(wl, t->kids[0],
+					t->onTrue == &fall ? genlabel() : t->onTrue, &fall);
+				set_targets(wl, t->kids[1], t->onTrue, t->onFalse);
 				break;
 			}
 
-
-			default: {
-				if (t->nkids != 0) {
-					for (int i=0; i < t->nkids; i++) {
-						if (t->kids[i] != NULL) {
-							t->first = t->kids[i]->first;
-							break;
-						}
-					}
-				}
+			case prodR_UnaryExpr: {
+				if (is_not(t)) set_targets(wl, t->kids[1], t->onFalse, t->onTrue);
+				break;
 			}
-
 		}
 	}
-
 }
 
-void genfollow(struct tree *t) {
-
-	// printf("GENFOLLOW %s\n", t->symbolname);
-	int i;
-	if (t == NULL) return;
+static int attr_node(struct tree *t, int depth, void *arg) {
 
-	if (t->symbolname) {
-		// printf("\n_______________________________\n");
-		// printf("GENFOLLOW %s\n", t->symbolname);
+	struct attr_worklist *wl = arg;
+	int cond = condition_of(t);
 
-	}
 	switch (t->prodrule) {
 
-		case prodR_MethodDecl: {
-			// printf("GENFOLLOW %s\n", t->symbolname);
-			t->kids[1]->follow = genlabel();
-			// printf("FL%d %s\n", t->kids[1]->follow->u.offset, t->kids[1]->symbolname);
-
+		/* cond; then; [GOTO follow;] onFalse: */
+		case prodR_IfThenStmt: {
+			t->onFalse = genlabel();
+			set_targets(wl, t->kids[0], &fall, t->onFalse);
 			break;
 		}
 
-		case prodR_BlockStmts: {
-			// printf("GENFOLLOW %s\n", t->symbolname);
-			t->kids[0]->follow = t->kids[1]->first;
-			t->kids[1]->follow = t->follow;
-			// printf("FL%d %s\n", t->follow->u.offset, t->symbolname);
+		/* cond; then; GOTO follow; onFalse: else; follow: */
+		case prodR_IfThenElseStmt:
+		case prodR_IfThenElseIfStmt:
+		case prodR_IfThenElseIfElseStmt: {
+			t->onFalse = genlabel();
+			t->follow = genlabel();
+			set_targets(wl, t->kids[0], &fall, t->onFalse);
+			if (t->prodrule != prodR_IfThenElseStmt) set_follow(wl, t->kids[2], t->follow);
 			break;
 		}
 
-		case prodR_IfThenStmt: {
-			// printf("GENFOLLOW %s\n", t->symbolname);
-			t->kids[0]->follow = t->kids[1]->first;
-			t->kids[1]->follow = t->follow;
-			// printf("FL%d %s\n", t->follow->u.offset, t->symbolname);
+		/* see gen_node(): onTrue labels the body, onFalse the test */
+		case prodR_WhileStmt:
+		case prodR_ForStmt: {
+			t->onTrue = genlabel();
+			t->onFalse = genlabel();
+			set_targets(wl, t->kids[cond], t->onTrue, &fall);
 			break;
 		}
-
 	}
 
-	if (t->nkids != 0) {
-		for (i = 0; i < t->nkids; i++) {
-			// printf("loop case!\n");
-			genfollow(t->kids[i]);
+	/* an operator of a condition anywhere else is a value */
+	for (int i = 0; i < t->nkids; i++) {
+		struct tree *kid = t->kids[i];
+
+		if (!is_condition(kid) || i == cond) continue;
+		if (t->prodrule == prodR_CondAndExpr || t->prodrule == prodR_CondOrExpr || is_not(t)) {
+			continue;
 		}
+		kid->address = newtemp(1);
+		set_targets(wl, kid, &fall, genlabel());
 	}
-}
 
-void gentargets(struct tree *t) {
+	push_inherited(wl);
 
-	int i;
-	if (t == NULL) return;
+	if (t->unit != NULL) {
+		method_attr_end(t);
+	}
 
-	switch (t->prodrule) {
+	return 1;
+}
 
-		case prodR_IfThenStmt: {
-			t->kids[0]->onTrue = t->kids[1]->first;
-			t->kids[0]->onFalse = t->follow;
-			// printf("%s onTrue->L%d, onFalse->L%d\n", t->symbolname,
-			 // t->kids[0]->onTrue->u.offset, t->kids[0]->onFalse->u.offset);
+static int attr_pre(struct tree *t, int depth, void *arg) {
 
+	if (t->unit != NULL) {
+		return method_attr_begin(t);
+	}
 
-			break;
-		}
+	return 1;
+}
 
-		case prodR_CondAndExpr: {
-			t->kids[0]->onTrue = t->kids[1]->first;
-			t->kids[0]->onFalse = t->onFalse;
-			t->kids[1]->onTrue = t->onTrue;
-			t->kids[1]->onFalse = t->onFalse;
+void genattributes(struct tree *t) {
 
-			break;
-		}
-	}
+	struct attr_worklist wl = { NULL, 0, 0 };
 
-	if (t->nkids != 0) {
-		for (i = 0; i < t->nkids; i++) {
-			gentargets(t->kids[i]);
-		}
-	}
+	walk_tree(t, attr_pre, attr_node, &wl);
+	free(wl.nodes);
 }
 
 int set_identifier_addr(struct tree *n) {
 
-	SymbolTableEntry search = check_if_undeclared(n->stab ,n->leaf->text);
+	SymbolTableEntry search = n->entry ? n->entry :
+		check_if_undeclared(n->stab ,n->leaf->text);
 
 	if (search) {
 		n->address = search->address;
@@ -696,45 +924,93 @@ void add_icn_string(struct tree *t) {
 	t->address->tag = NAME;
 	t->address->u.name = strdup(t->leaf->sval);
 
-	struct icn_string *new_str = malloc(sizeof(struct icn_string));
-	memset(new_str, 0, sizeof(struct icn_string));
+	append_icn_string(t->leaf->text, t->address);
+}
 
-	new_str->node = t;
-	new_str->address = t->address;
+static void *grow(void *p, int *size, int min, size_t elem) {
 
-	if (icn_strings == NULL) {
-		// printf("Set initial string %s\n", t->leaf->text);
-		new_str->str_bytes = 16;
-		icn_strings = new_str;
-		icn_strings->total_bytes = icn_strings->total_bytes + 16;
-	} else {
-		struct icn_string *current = icn_strings;
-		while (current->next != NULL) {
-			current = current->next;
-		}
-		// printf("last should be %s\n", current->node->leaf->text);
-		new_str->str_bytes = current->str_bytes + 16;
-		icn_strings->total_bytes = icn_strings->total_bytes + 16;
-		// printf("with %d bytes\n", new_str->str_bytes);
-		current->next = new_str;
+	*size = *size ? *size * 2 : min;
+	p = realloc(p, *size * elem);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
 	}
+
+	return p;
 }
 
-void print_icn_strings(struct icn_string *head, FILE *icn_out) {
+static void rehash(struct string_pool *pool) {
 
-	if (head == NULL) {
-		return;
+	struct icn_string *s;
+	int mask;
+
+	free(pool->buckets);
+	pool->buckets = grow(NULL, &pool->nbuckets, 64, sizeof(struct icn_string *));
+	memset(pool->buckets, 0, pool->nbuckets * sizeof(struct icn_string *));
+
+	mask = pool->nbuckets - 1;
+	for (s = pool->head; s != NULL; s = s->next) {
+		uint64_t h = fnv1a(FNV_OFFSET, s->text, strlen(s->text));
+		s->chain = pool->buckets[h & mask];
+		pool->buckets[h & mask] = s;
+	}
+}
+
+/*
+ * append_icn_string - add a string literal to the .string section. A
+ * literal already there is not added again; every one gets the next
+ * 16 byte slot, so its offset is fixed when it is first seen.
+ */
+void append_icn_string(char *text, struct addr *address) {
+
+	struct string_pool *pool = &icn_strings;
+	struct icn_string *s;
+	uint64_t h = fnv1a(FNV_OFFSET, text, strlen(text));
+
+	for (s = pool->nbuckets ? pool->buckets[h & (pool->nbuckets - 1)] : NULL;
+		s != NULL; s = s->chain) {
+		if (strcmp(s->text, text) == 0) break;
+	}
+
+	if (s == NULL) {
+		s = calloc(1, sizeof(struct icn_string));
+		s->text = text;
+		s->address = address;
+		s->str_bytes = ++pool->count * 16;
+
+		if (pool->tail == NULL) {
+			pool->head = s;
+		} else {
+			pool->tail->next = s;
+		}
+		pool->tail = s;
+
+		if (pool->count > pool->nbuckets / 2) {
+			rehash(pool);
+		} else {
+			s->chain = pool->buckets[h & (pool->nbuckets - 1)];
+			pool->buckets[h & (pool->nbuckets - 1)] = s;
+		}
 	}
 
-	// printf(".string [%d]\n", head->total_bytes);
-	fprintf(icn_out, ".string [%d]\n", head->total_bytes);
+	if (pool->nuses == pool->uses_size) {
+		pool->uses = grow(pool->uses, &pool->uses_size, 64,
+			sizeof(struct icn_string *));
+	}
+	pool->uses[pool->nuses++] = s;
+}
+
+void print_icn_strings(FILE *icn_out) {
 
-	struct icn_string *current = head;
+	struct icn_string *s;
 
-	while (current->next != NULL) {
-		// printf("\t%s:%d\n", current->node->leaf->text, current->str_bytes);
-		fprintf(icn_out, "\t%s:%d\n", current->node->leaf->text, current->str_bytes);
-		current = current->next;
+	if (icn_strings.head == NULL) {
+		return;
+	}
+
+	fprintf(icn_out, ".string [%d]\n", icn_strings.count * 16);
+	for (s = icn_strings.head; s != NULL; s = s->next) {
+		fprintf(icn_out, "\t%s:%d\n", s->text, s->str_bytes);
 	}
 }
 
@@ -782,34 +1058,39 @@ void gentoken(struct tree *n) {
 	}
 }
 
+/*
+ * gen_arglist - the code of a call's arguments, left to right, then a
+ *  PARM for each, the last argument first. One pass over the ArgList,
+ *  whose arguments are all its kids, linking the code in place.
+ */
 struct instr *gen_arglist(struct tree *arglist) {
 
-	struct instr *first_param;
-	struct instr *second_param;
-	struct instr *combined;
+	int i;
+
+	arglist->icode = NULL;
+	arglist->icode_tail = NULL;
 
-	if (arglist->kids[0]->nkids == 0) {
+	for (i = 0; i < arglist->nkids; i++) {
+		link_code(arglist, arglist->kids[i]->icode, tail_of(arglist->kids[i]));
+	}
 
-		gentoken(arglist->kids[0]);
-		gentoken(arglist->kids[1]);
+	for (i = arglist->nkids - 1; i >= 0; i--) {
+		struct tree *arg = arglist->kids[i];
+		struct instr *parm;
 
-		first_param = gen(O_PARM, *arglist->kids[0]->address, empty_address,
-			 empty_address);
-		second_param = gen(O_PARM, *arglist->kids[1]->address, empty_address,
-			 empty_address);
-		combined = concat(second_param, first_param);
+		/* set_identifier_addr() has already said why */
+		if (arg->address == NULL) continue;
 
-	} else {
-		second_param = gen(O_PARM, *arglist->kids[1]->address,
-			 empty_address, empty_address);
-		first_param = gen_arglist(arglist->kids[0]);
-		combined = concat(second_param, first_param);
+		parm = gen(O_PARM, *arg->address, empty_address, empty_address);
+		link_code(arglist, parm, parm);
 	}
-	return combined;
+
+	return arglist->icode;
 }
 
 /**
- * Initialize symbol tables for each token in a qualified name
+ * Initialize symbol tables for each token in a qualified name. A name
+ * resolved while the tables were built already has them.
  * @param  name_head the first name in a qualified name
  */
 void gen_qualified_addr(struct tree *name_head) {
@@ -818,6 +1099,10 @@ void gen_qualified_addr(struct tree *name_head) {
 	SymbolTableEntry outer_addr = NULL;
 	SymbolTableEntry addr_check = NULL;
 
+	if (name_head->entry != NULL) {
+		return;
+	}
+
 	if (name_head->nkids == 0) {
 		// printf("Name: %s\n", name_head->leaf->text);
 		addr_check = check_if_undeclared(name_head->stab, name_head->leaf->text);
@@ -5,25 +5,40 @@
 #include "symboltable.h"
 
 struct icn_string {
-	struct tree *node;
+	char *text;		/* the literal as written, quotes and all */
 	struct addr *address;
-	int str_bytes;
-	int total_bytes;
+	int str_bytes;		/* its offset in the .string section */
 
-	struct icn_string *next;
+	struct icn_string *next;	/* in the order first used */
+	struct icn_string *chain;	/* in the same hash bucket */
 };
 
+/*
+ * The string literals of a compile, each text once. uses has every
+ * literal interned, repeats included, which is what a method keeps of
+ * its literals (see incremental.c).
+ */
+struct string_pool {
+	struct icn_string *head, *tail;
+	struct icn_string **buckets;
+	int nbuckets, count;
+
+	struct icn_string **uses;
+	int nuses, uses_size;
+};
+
+extern _Thread_local struct string_pool icn_strings;
+
 struct instr *gen_arglist(struct tree *arglist);
 struct addr *newtemp(int num_bytes);
 void gen_intermediate_code (struct tree *n);
 void gentoken(struct tree *n);
 void gen_qualified_addr(struct tree *name_head);
-void genfirst(struct tree *t);
-void genfollow(struct tree *t);
-void gentargets(struct tree *t);
+void genattributes(struct tree *t);
 int set_identifier_addr(struct tree *n);
 int print_intermediate_tree(struct tree* tree, int depth);
-void print_icn_strings(struct icn_string *head, FILE *icn_out);
+void append_icn_string(char *text, struct addr *address);
+void print_icn_strings(FILE *icn_out);
 
 
 
@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * Induction variables and strength reduction.
+ *
+ * A basic induction variable of a loop is a private variable whose one
+ * write in the loop is i = i + c, c a constant. A derived one is
+ * j = i * k, k a constant, computed somewhere in the loop from a basic i.
+ * Its multiplication is reduced to an addition: a new variable s gets
+ * i * k in the preheader and s + k * c right after the write to i, so it
+ * holds i * k all through the loop, and j = i * k becomes j = s. (The
+ * copy usually goes away in the next round of copy propagation.)
+ *
+ * When a basic variable is only read by its own update and by the loop's
+ * test in the header, i < n with n a constant, the test can be made on
+ * s < n * k instead for a positive k, and i is no longer needed in the
+ * loop unless it is live after it. That needs i * k not to overflow
+ * between i's value on entry, a constant, and n, so the two tests agree;
+ * i moves toward n, so it stays within a step of the two.
+ */
+
+struct reduction {
+	int iv;			/* the basic variable */
+	int k;			/* its factor */
+	struct addr s;		/* holds iv * k */
+};
+
+struct ivopt {
+	struct cfg *g;
+	struct loop *l;
+	int *defs;		/* per variable: writes in the loop */
+	struct instr **update;	/* per variable: i = i + c, when it is basic */
+	int *step;		/* and its c */
+	struct reduction *red;
+	int nred;
+};
+
+static void *xcalloc(size_t n, size_t size) {
+
+	void *p = calloc(n, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static void *xrealloc(void *p, size_t size) {
+
+	p = realloc(p, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static int is_int(struct addr *a) {
+	return a->region == R_CONST && a->tag == OFFSET;
+}
+
+static int fits(long long x) {
+	return x >= INT_MIN && x <= INT_MAX;
+}
+
+/* block_of - the block of the loop where in is, and its index there */
+static struct block *block_of(struct ivopt *o, struct instr *in, int *at) {
+
+	struct cfg *g = o->g;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		if (!o->l->body[i]) continue;
+		for (int j = 0; j < g->blocks[i]->ncode; j++) {
+			if (g->blocks[i]->code[j] == in) {
+				*at = j;
+				return g->blocks[i];
+			}
+		}
+	}
+	return NULL;
+}
+
+static void count_defs(struct ivopt *o) {
+
+	struct cfg *g = o->g;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		if (!o->l->body[i]) continue;
+		for (int j = 0; j < g->blocks[i]->ncode; j++) {
+			struct instr *in = g->blocks[i]->code[j];
+			struct addr *d = instr_def(in);
+			int v;
+
+			if (d != NULL && (v = cfg_var(g, d)) >= 0) o->defs[v]++;
+		}
+	}
+}
+
+/* increment - in is v = u + c or v = u - c, for a constant c; returns its c */
+static int increment(struct instr *in, struct addr **u, int *c) {
+
+	if (in->code_type == DECLARATION) return 0;
+	if (in->opcode == O_ADD && is_int(&in->src2)) {
+		*u = &in->src1;
+		*c = in->src2.u.offset;
+	} else if (in->opcode == O_ADD && is_int(&in->src1)) {
+		*u = &in->src2;
+		*c = in->src1.u.offset;
+	} else if (in->opcode == O_SUB && is_int(&in->src2)) {
+		*u = &in->src1;
+		*c = (int) (0u - in->src2.u.offset);
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * find_basic - the basic induction variables. At -O1 an update that is
+ *  not i++ is still t = i + c; i = t, so that counts too, by its copy.
+ */
+static void find_basic(struct ivopt *o) {
+
+	struct cfg *g = o->g;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		if (!o->l->body[i]) continue;
+		for (int j = 0; j < b->ncode; j++) {
+			struct instr *in = b->code[j];
+			struct addr *u;
+			int c, v, t;
+
+			if (increment(in, &u, &c) && addr_equal(*u, in->dest)) {
+				/* i = i + c */
+			} else if (j > 0 && in->code_type != DECLARATION && in->opcode == O_ASN &&
+				increment(b->code[j - 1], &u, &c) && addr_equal(*u, in->dest) &&
+				addr_equal(b->code[j - 1]->dest, in->src1)) {
+				/* t = i + c; i = t */
+				t = cfg_var(g, &in->src1);
+				if (t < 0 || !g->vars[t].private || o->defs[t] != 1) continue;
+			} else {
+				continue;
+			}
+
+			v = cfg_var(g, &in->dest);
+			if (v < 0 || !g->vars[v].private || o->defs[v] != 1) continue;
+			o->update[v] = in;
+			o->step[v] = c;
+		}
+	}
+}
+
+/* entry_value - the constant iv has coming into the loop, 0 if not known */
+static int entry_value(struct ivopt *o, int iv, long long *value) {
+
+	struct block *pre = o->l->preheader;
+
+	for (int j = pre->ncode - 1; j >= 0; j--) {
+		struct instr *in = pre->code[j];
+		struct addr *d = instr_def(in);
+
+		if (d == NULL || cfg_var(o->g, d) != iv) continue;
+		if (in->opcode != O_ASN || !is_int(&in->src1)) return 0;
+		*value = in->src1.u.offset;
+		return 1;
+	}
+	return 0;
+}
+
+/* reduce - the variable holding iv * k, made the first time it is asked for */
+static struct addr reduce(struct ivopt *o, int iv, int k) {
+
+	struct cfg *g = o->g;
+	struct block *b, *pre = o->l->preheader;
+	struct addr none, kk;
+	long long init;
+	int at, i;
+
+	for (i = 0; i < o->nred; i++) {
+		if (o->red[i].iv == iv && o->red[i].k == k) return o->red[i].s;
+	}
+
+	o->red = xrealloc(o->red, (o->nred + 1) * sizeof(struct reduction));
+	o->red[o->nred].iv = iv;
+	o->red[o->nred].k = k;
+	o->red[o->nred].s = cfg_new_slot(g);
+
+	memset(&none, 0, sizeof(none));
+	none.region = R_NONE;
+	kk = none;
+	kk.region = R_CONST;
+	if (entry_value(o, iv, &init)) {
+		kk.u.offset = (int) (init * k);
+		block_insert(pre, block_end(pre), gen(O_ASN, o->red[o->nred].s, kk, none));
+	} else {
+		kk.u.offset = k;
+		block_insert(pre, block_end(pre), gen(O_MUL, o->red[o->nred].s, g->vars[iv].a, kk));
+	}
+
+	kk.u.offset = (int) ((long long) k * o->step[iv]);
+	b = block_of(o, o->update[iv], &at);
+	block_insert(b, at + 1, gen(O_ADD, o->red[o->nred].s, o->red[o->nred].s, kk));
+
+	return o->red[o->nred++].s;
+}
+
+static int reduce_loop(struct ivopt *o) {
+
+	struct cfg *g = o->g;
+	int reduced = 0;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		if (!o->l->body[i]) continue;
+		for (int j = 0; j < g->blocks[i]->ncode; j++) {
+			struct instr *in = g->blocks[i]->code[j];
+			struct addr *a, *k;
+			int v;
+
+			if (in->code_type == DECLARATION || in->opcode != O_MUL) continue;
+			if (is_int(&in->src2)) {
+				a = &in->src1;
+				k = &in->src2;
+			} else if (is_int(&in->src1)) {
+				a = &in->src2;
+				k = &in->src1;
+			} else {
+				continue;
+			}
+			if ((v = cfg_var(g, a)) < 0 || o->update[v] == NULL) continue;
+
+			in->src1 = reduce(o, v, k->u.offset);
+			in->opcode = O_ASN;
+			in->src2.region = R_NONE;
+			reduced++;
+		}
+	}
+	return reduced;
+}
+
+/*
+ * replace_test - make the header's test on iv a test on a reduction
+ *  of it, if that is sure to come out the same
+ */
+static int replace_test(struct ivopt *o, struct reduction *r) {
+
+	struct block *h = o->l->header;
+	struct instr *br;
+	struct addr *ivp, *bound;
+	long long init, n, lo, hi, step = o->step[r->iv];
+	int op, up;
+
+	if (h->ncode == 0 || h->nsucc != 2 || r->k <= 0) return 0;
+	if (o->l->body[h->succ[0]->id] == o->l->body[h->succ[1]->id]) return 0;
+	br = h->code[h->ncode - 1];
+	if (br->code_type == DECLARATION) return 0;
+	switch (br->opcode) {
+		case O_BLT: case O_BLE: case O_BGT: case O_BGE:
+			break;
+		default:
+			return 0;
+	}
+	if (cfg_var(o->g, &br->src1) == r->iv && is_int(&br->src2)) {
+		ivp = &br->src1;
+		bound = &br->src2;
+		op = br->opcode;
+	} else if (cfg_var(o->g, &br->src2) == r->iv && is_int(&br->src1)) {
+		/* n < i is i > n */
+		ivp = &br->src2;
+		bound = &br->src1;
+		op = br->opcode == O_BLT ? O_BGT : br->opcode == O_BLE ? O_BGE :
+			br->opcode == O_BGT ? O_BLT : O_BLE;
+	} else {
+		return 0;
+	}
+
+	/* the loop goes on while i < n (or i > n), so i must go up (or down) */
+	up = op == O_BLT || op == O_BLE;
+	if (!o->l->body[h->succ[1]->id]) up = !up;
+	if ((up && step <= 0) || (!up && step >= 0)) return 0;
+
+	if (!entry_value(o, r->iv, &init)) return 0;
+	n = bound->u.offset;
+	lo = (init < n ? init : n) - (step < 0 ? -step : step);
+	hi = (init > n ? init : n) + (step < 0 ? -step : step);
+	if (!fits(lo * r->k) || !fits(hi * r->k)) return 0;
+
+	*ivp = r->s;
+	bound->u.offset = (int) (n * r->k);
+	return 1;
+}
+
+/* exits_live - v is live into a block the loop exits to */
+static int exits_live(struct ivopt *o, int v) {
+
+	struct cfg *g = o->g;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		if (!o->l->body[i]) continue;
+		for (int k = 0; k < b->nsucc; k++) {
+			if (!o->l->body[b->succ[k]->id] && live_test(b->succ[k]->live_in, v)) return 1;
+		}
+	}
+	return 0;
+}
+
+static int loop_uses(struct ivopt *o, int v) {
+
+	struct cfg *g = o->g;
+	int uses = 0;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		if (!o->l->body[i]) continue;
+		for (int j = 0; j < g->blocks[i]->ncode; j++) {
+			struct addr *u[2];
+			int n = instr_uses(g->blocks[i]->code[j], u);
+
+			while (n-- > 0) uses += cfg_var(g, u[n]) == v;
+		}
+	}
+	return uses;
+}
+
+static void ivopt_loop(struct ivopt *o, struct opt_stats *stats) {
+
+	struct cfg *g = o->g;
+	int nvars = g->nvars, at;
+
+	o->defs = xcalloc(nvars + 1, sizeof(int));
+	o->update = xcalloc(nvars + 1, sizeof(struct instr *));
+	o->step = xcalloc(nvars + 1, sizeof(int));
+	o->red = NULL;
+	o->nred = 0;
+
+	count_defs(o);
+	find_basic(o);
+	stats->reduced += reduce_loop(o);
+
+	for (int i = 0; i < o->nred; i++) {
+		struct reduction *r = &o->red[i];
+		struct instr *in = o->update[r->iv];
+		struct block *b;
+		int t = -1;
+
+		/* read by its update and the test, and by nothing after the loop */
+		if (in == NULL || loop_uses(o, r->iv) != 2 || exits_live(o, r->iv)) continue;
+		if (in->opcode == O_ASN) {
+			t = cfg_var(g, &in->src1);
+			if (loop_uses(o, t) != 1 || exits_live(o, t)) continue;
+		}
+		if (!replace_test(o, r)) continue;
+
+		b = block_of(o, in, &at);
+		block_remove(b, at);
+		if (t >= 0) block_remove(b, at - 1);
+		o->update[r->iv] = NULL;
+		stats->ivs_removed++;
+	}
+
+	free(o->defs);
+	free(o->update);
+	free(o->step);
+	free(o->red);
+}
+
+/* ivopt - strength-reduce the induction variables of every loop with a preheader */
+int ivopt(struct cfg *g, struct opt_stats *stats) {
+
+	struct ivopt o;
+	int before = stats->reduced + stats->ivs_removed;
+
+	find_loops(g);
+	cfg_liveness(g);
+
+	memset(&o, 0, sizeof(o));
+	o.g = g;
+	for (int i = 0; i < g->nloops; i++) {
+		int changed = stats->reduced + stats->ivs_removed;
+
+		if (g->loops[i]->preheader == NULL) continue;
+		o.l = g->loops[i];
+		ivopt_loop(&o, stats);
+		if (stats->reduced + stats->ivs_removed != changed) cfg_liveness(g);
+	}
+
+	return stats->reduced + stats->ivs_removed - before;
+}
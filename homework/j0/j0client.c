@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "frame.h"
+
+/*
+ * j0client - takes the same command line as j0 and does the same thing,
+ * but has a running j0 --server do the work. Output, .icn files and the
+ * exit code come back as if j0 had run here.
+ *
+ * usage: ./j0client [--stdin] [flags] [input files]
+ *
+ * With --stdin the source text is read from standard input and compiled
+ * in place of the (single) file named, for editors with unsaved buffers.
+ * If no server is running, j0 itself is run instead ($J0, default j0).
+ */
+
+static int connect_server(char *path) {
+
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static char *read_stdin(size_t *len) {
+
+	size_t size = 4096, n;
+	char *buf = malloc(size);
+
+	*len = 0;
+	while ((n = fread(buf + *len, 1, size - *len, stdin)) > 0) {
+		*len += n;
+		if (*len == size) {
+			size *= 2;
+			buf = realloc(buf, size);
+		}
+	}
+
+	return buf;
+}
+
+/*
+ * write_icn - write an output file the server sent. It names only a file
+ * in the working directory, never one elsewhere. Returns 0, or -1 if the
+ * file is not written.
+ */
+static int write_icn(char *data, uint32_t len) {
+
+	size_t namelen = strlen(data) + 1;
+	FILE *f;
+
+	if (namelen > len || data[0] == '\0' || strchr(data, '/') != NULL ||
+		strcmp(data, ".") == 0 || strcmp(data, "..") == 0) {
+		fprintf(stderr, "j0client: won't write '%s', not a file here\n", data);
+		return -1;
+	}
+
+	if ((f = fopen(data, "w")) == NULL) {
+		fprintf(stderr, "j0client: can not write '%s'\n", data);
+		return -1;
+	}
+
+	fwrite(data + namelen, 1, len - namelen, f);
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+
+	char cwd[4096];
+	char tag, *data, *request;
+	uint32_t len;
+	size_t request_len;
+	FILE *f;
+	int use_stdin = 0, failed = 0, conn, i;
+
+	if (argc > 1 && strcmp(argv[1], "--stdin") == 0) {
+		use_stdin = 1;
+		argv[1] = argv[0];
+		argv++;
+		argc--;
+	}
+
+	if ((conn = connect_server(default_socket_path())) < 0) {
+		char *j0 = getenv("J0") ? getenv("J0") : "j0";
+
+		if (use_stdin) {
+			fprintf(stderr, "j0client: no server at %s\n", default_socket_path());
+			return -1;
+		}
+
+		argv[0] = j0;
+		execvp(j0, argv);
+		perror("j0client");
+		return -1;
+	}
+
+	if (!peer_is_owner(conn)) {
+		fprintf(stderr, "j0client: the server at %s is not yours\n", default_socket_path());
+		return -1;
+	}
+
+	if (getcwd(cwd, sizeof(cwd)) == NULL) {
+		perror("j0client");
+		return -1;
+	}
+
+	f = open_memstream(&request, &request_len);
+	put_frame(f, FRAME_CWD, cwd, strlen(cwd));
+	for (i = 1; i < argc; i++) {
+		put_frame(f, FRAME_ARG, argv[i], strlen(argv[i]));
+	}
+	if (use_stdin) {
+		size_t n;
+		char *source = read_stdin(&n);
+		put_frame(f, FRAME_SOURCE, source, n);
+		free(source);
+	}
+	put_frame(f, FRAME_END, "", 0);
+	fclose(f);
+	write_all(conn, request, request_len);
+	free(request);
+
+	while (read_frame(conn, &tag, &data, &len) == 0) {
+		switch (tag) {
+			case FRAME_STDOUT:
+				fwrite(data, 1, len, stdout);
+				fflush(stdout);
+				break;
+			case FRAME_STDERR:
+				fwrite(data, 1, len, stderr);
+				break;
+			case FRAME_ICN:
+				if (write_icn(data, len) < 0) failed = 1;
+				break;
+			case FRAME_EXIT:
+				return failed ? -1 : atoi(data);
+		}
+		free(data);
+	}
+
+	fprintf(stderr, "j0client: lost connection to server\n");
+	return -1;
+}
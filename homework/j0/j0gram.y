@@ -1,5 +1,7 @@
 %{
 	#define YYDEBUG 1
+	/* deeply nested expressions need far more than bison's default 10000 */
+	#define YYMAXDEPTH 1000000
 
 	extern int yylex();
 	extern int yyerror(const char *s);
@@ -146,6 +148,10 @@ ClassBodyDecl:
 		{}
 	| ConstructorDecl
 		{}
+	| error ';'
+		{$$ = NULL; yyerrok;}
+	| error Block
+		{$$ = NULL; yyerrok;}
 	;
 FieldDecl:
 	Type VarDecls ';'
@@ -187,7 +193,12 @@ VarDecls:
 	VarDeclarator
 		{$$ = create_branch(prodR_VarDecls,"VarDecls",1, $1);}
 	| VarDecls ',' VarDeclarator
-		{throw_syntax_error("inline declarations not supported in j0.1");}
+		{
+			/* reported once per declaration, not once per comma */
+			if ($1->prodrule != prodR_MultiVarDecls)
+				throw_syntax_error("inline declarations not supported in j0.1");
+			$$ = create_branch(prodR_MultiVarDecls,"MultiVarDecls",2, $1,$3);
+		}
 	;
 
 VarDeclarator:
@@ -281,6 +292,8 @@ BlockStmt:
 		{}
 	| Stmt
 		{}
+	| error ';'
+		{$$ = NULL; yyerrok;}
 	;
 
 LocalVarDeclStmt:
@@ -340,7 +353,7 @@ IfThenElseStmt:
 	;
 IfThenElseIfStmt:
 	IF '(' Expr ')' Block ElseIfSequence
-		{$$ = create_branch(prodR_IfThenElseIfStmt,"IfThenElseIfStmt",3,$5,$6);}
+		{$$ = create_branch(prodR_IfThenElseIfStmt,"IfThenElseIfStmt",3,$3,$5,$6);}
 
   |  IF '(' Expr ')' Block ElseIfSequence ELSE Block
 		{$$ = create_branch(prodR_IfThenElseIfElseStmt,"IfThenElseIf_Else_Stmt",4, $3,$5,$6,$8);}
@@ -464,9 +477,9 @@ ArrayAccess:
 
 ArgList:
 	Expr
-		{}
+		{$$ = create_branch(prodR_ArgList,"ArgList",1, $1);}
 	| ArgList ',' Expr
-		{$$ = create_branch(prodR_ArgList,"ArgList",2, $1,$3);}
+		{$$ = append_kid($1, $3);}
 	;
 FieldAccess:
 	Primary '.' IDENTIFIER
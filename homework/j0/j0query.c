@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "index.h"
+
+/*
+ * j0query - answer editor queries from an index written by j0 -index.
+ *
+ * usage: ./j0query FILE.idx def LINE COL	where the name at LINE:COL is declared
+ *        ./j0query FILE.idx refs LINE COL	every use of the name at LINE:COL
+ *        ./j0query FILE.idx sym NAME		every symbol called NAME
+ *
+ * Answers are printed one per line as file:line:col: scope.name, and
+ * the exit code is 1 when there are none. The index is mapped and
+ * binary searched in place, nothing is read up front.
+ */
+
+struct index {
+	struct index_header *h;
+	struct index_symbol *symbols;
+	struct index_ref *refs;
+	uint32_t *by_symbol;
+	char *strings;
+};
+
+static int open_index(char *path, struct index *ix) {
+
+	struct stat st;
+	char *map;
+	size_t need;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		return -1;
+	}
+
+	map = st.st_size >= (off_t) sizeof(struct index_header) ?
+		mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: not an index\n", path);
+		return -1;
+	}
+
+	ix->h = (struct index_header *) map;
+	need = sizeof(struct index_header) +
+		ix->h->nsymbols * sizeof(struct index_symbol) +
+		ix->h->nrefs * (sizeof(struct index_ref) + sizeof(uint32_t)) +
+		ix->h->strings_len;
+	if (ix->h->magic != INDEX_MAGIC || ix->h->version != INDEX_VERSION ||
+		need != (size_t) st.st_size) {
+		fprintf(stderr, "%s: not an index, or from another j0\n", path);
+		return -1;
+	}
+
+	ix->symbols = (struct index_symbol *) (ix->h + 1);
+	ix->refs = (struct index_ref *) (ix->symbols + ix->h->nsymbols);
+	ix->by_symbol = (uint32_t *) (ix->refs + ix->h->nrefs);
+	ix->strings = (char *) (ix->by_symbol + ix->h->nrefs);
+
+	return 0;
+}
+
+static void print_ref(struct index *ix, struct index_ref *r) {
+
+	struct index_symbol *s = &ix->symbols[r->symbol];
+
+	printf("%s:%d:%d: %s.%s\n", ix->strings + r->file, r->line, r->col,
+		ix->strings + s->scope, ix->strings + s->name);
+}
+
+/* ref_at - the ref whose name covers line:col, NULL if none does */
+static struct index_ref *ref_at(struct index *ix, int line, int col) {
+
+	int lo = 0, hi = ix->h->nrefs - 1;
+	struct index_ref *best = NULL;
+
+	/* the last ref starting at or before line:col */
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+		struct index_ref *r = &ix->refs[mid];
+
+		if (r->line < line || (r->line == line && r->col <= col)) {
+			best = r;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	if (best == NULL || best->line != line || col >= best->col + best->len) {
+		return NULL;
+	}
+	return best;
+}
+
+static int query_def(struct index *ix, int line, int col) {
+
+	struct index_ref *r = ref_at(ix, line, col);
+	struct index_symbol *s;
+
+	if (r == NULL) return 1;
+
+	s = &ix->symbols[r->symbol];
+	if (s->decl < 0) {
+		printf("<builtin>: %s.%s\n", ix->strings + s->scope,
+			ix->strings + s->name);
+	} else {
+		print_ref(ix, &ix->refs[s->decl]);
+	}
+	return 0;
+}
+
+static int query_refs(struct index *ix, int line, int col) {
+
+	struct index_ref *r = ref_at(ix, line, col);
+	struct index_symbol *s;
+	uint32_t i;
+
+	if (r == NULL) return 1;
+
+	s = &ix->symbols[r->symbol];
+	for (i = s->first; i < s->first + s->nrefs; i++) {
+		print_ref(ix, &ix->refs[ix->by_symbol[i]]);
+	}
+	return 0;
+}
+
+static int query_sym(struct index *ix, char *name) {
+
+	int lo = 0, hi = ix->h->nsymbols, found = 0;
+
+	/* the first symbol not before name */
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (strcmp(ix->strings + ix->symbols[mid].name, name) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for (; lo < (int) ix->h->nsymbols &&
+		strcmp(ix->strings + ix->symbols[lo].name, name) == 0; lo++) {
+		struct index_symbol *s = &ix->symbols[lo];
+
+		if (s->decl < 0) {
+			printf("<builtin>: %s.%s\n", ix->strings + s->scope, name);
+		} else {
+			print_ref(ix, &ix->refs[s->decl]);
+		}
+		found = 1;
+	}
+
+	return !found;
+}
+
+int main(int argc, char *argv[]) {
+
+	struct index ix;
+
+	if (argc < 4 || ((strcmp(argv[2], "def") == 0 ||
+		strcmp(argv[2], "refs") == 0) && argc != 5) ||
+		(strcmp(argv[2], "sym") == 0 && argc != 4)) {
+		fprintf(stderr, "usage: %s FILE.idx def|refs LINE COL\n"
+			"       %s FILE.idx sym NAME\n", argv[0], argv[0]);
+		return 2;
+	}
+
+	if (open_index(argv[1], &ix) < 0) {
+		return 2;
+	}
+
+	if (strcmp(argv[2], "def") == 0) {
+		return query_def(&ix, atoi(argv[3]), atoi(argv[4]));
+	} else if (strcmp(argv[2], "refs") == 0) {
+		return query_refs(&ix, atoi(argv[3]), atoi(argv[4]));
+	} else if (strcmp(argv[2], "sym") == 0) {
+		return query_sym(&ix, argv[3]);
+	}
+
+	fprintf(stderr, "%s: unknown query '%s'\n", argv[0], argv[2]);
+	return 2;
+}
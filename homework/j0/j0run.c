@@ -0,0 +1,457 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include "tac.h"
+
+/*
+ * j0run - run the .icn that j0 writes, to test the code it generates.
+ *
+ * usage: ./j0run [-steps] FILE.icn
+ *
+ * Runs main, with what System.out.print and println print on stdout, and
+ * with -steps how many instructions it ran on stderr. A call gets a frame
+ * of the size its proc line declares, with its parameters in the first
+ * slots and every other slot unset; new gives a zeroed run of words.
+ * Memory is words of 8 bytes, and an address is a byte offset into it.
+ * Arithmetic is on 32 bit ints, as in Java, and wraps the same way. A
+ * string constant runs to the end of its line, so one with a comma can
+ * only be the last operand.
+ *
+ * The exit code is 1, after a message, when the program does what no
+ * program should: reads a slot before it is set, divides by zero, calls
+ * what is not a procedure, goes outside memory, or runs for too long; or
+ * when the code has a branch to no label, or names a slot past its frame,
+ * even in code never run.
+ */
+
+#define MEM_WORDS (1 << 20)
+#define GLOBAL_WORDS 4096	/* the first words of memory, for global: and class: */
+#define MAX_ARGS 4096
+#define MAX_DEPTH 10000
+#define MAX_STEPS 50000000L
+#define STRING_TAG (1L << 56)	/* a value that is a string constant, by its number */
+#define UNSET (3L << 60)	/* what a slot holds until it is set, which no int can be */
+
+struct operand {
+	int region;
+	long value;
+};
+
+struct op {
+	int opcode;
+	struct operand a[3];
+	char *name;		/* of what a CALL calls */
+	int nparams;
+	int target;		/* where a branch goes, -1 if its label is not in the procedure */
+};
+
+struct label {
+	int label;
+	int at;
+};
+
+struct proc {
+	char *name;
+	int frame_bytes;
+	struct op *code;
+	int ncode, code_size;
+	struct label *labels;
+	int nlabels, labels_size;
+};
+
+static struct proc *procs;
+static int nprocs, procs_size;
+
+static char **strings;
+static int nstrings, strings_size;
+
+static long *mem;
+static long sp = 8 * GLOBAL_WORDS, heap = 8L * MEM_WORDS;	/* the stack goes up, the heap down */
+static long args[MAX_ARGS];
+static int nargs;
+static long steps;
+
+static void *xrealloc(void *p, size_t size) {
+
+	p = realloc(p, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static void fail(struct proc *p, char *fmt, ...) {
+
+	va_list ap;
+
+	fprintf(stderr, "j0run: ");
+	if (p != NULL) fprintf(stderr, "in %s: ", p->name);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static long intern(char *text) {
+
+	for (int i = 0; i < nstrings; i++) {
+		if (strcmp(strings[i], text) == 0) return STRING_TAG + i;
+	}
+	if (nstrings == strings_size) {
+		strings_size = strings_size ? 2 * strings_size : 64;
+		strings = xrealloc(strings, strings_size * sizeof(char *));
+	}
+	strings[nstrings] = strdup(text);
+	return STRING_TAG + nstrings++;
+}
+
+static int region(char *name, int len) {
+
+	for (int r = R_GLOBAL; r <= R_STRING; r++) {
+		if ((int) strlen(regionname(r)) == len && strncmp(regionname(r), name, len) == 0) return r;
+	}
+	return 0;
+}
+
+/* parse_operand - the operand at *s, which is left past it and any comma */
+static struct operand parse_operand(char **s, struct proc *p) {
+
+	struct operand o = {R_NONE, 0};
+	char *colon = strchr(*s, ':'), *end;
+
+	if (**s == '\0') return o;
+	if (colon == NULL || (o.region = region(*s, colon - *s)) == 0) {
+		fail(p, "no operand at '%s'", *s);
+	}
+
+	*s = colon + 1;
+	o.value = strtol(*s, &end, 10);
+	if (*end == '.') o.value = (long) strtod(*s, &end);
+	if (end == *s || (*end != ',' && *end != '\0')) {
+		if (o.region != R_CONST) fail(p, "can't run %s:%s", regionname(o.region), *s);
+		o.value = intern(*s);
+		end = *s + strlen(*s);
+	}
+	*s = *end == ',' ? end + 1 : end;
+	return o;
+}
+
+static int opcode(char *name, int len) {
+
+	for (int op = O_ADD; op <= O_NOT; op++) {
+		if ((int) strlen(opcodename(op)) == len && strncmp(opcodename(op), name, len) == 0) return op;
+	}
+	return 0;
+}
+
+static void parse_instr(struct proc *p, char *line) {
+
+	char *tab = strchr(line, '\t'), *s;
+	struct op *in;
+
+	if (tab == NULL) tab = line + strlen(line);
+	if (p->ncode == p->code_size) {
+		p->code_size = p->code_size ? 2 * p->code_size : 64;
+		p->code = xrealloc(p->code, p->code_size * sizeof(struct op));
+	}
+	in = &p->code[p->ncode];
+	memset(in, 0, sizeof(struct op));
+	if ((in->opcode = opcode(line, tab - line)) == 0) fail(p, "no instruction '%s'", line);
+	s = *tab ? tab + 1 : tab;
+
+	if (in->opcode == O_CALL) {
+		char *comma = strchr(s, ',');
+
+		if (comma == NULL) fail(p, "a CALL of nothing");
+		in->name = strndup(s, comma - s);
+		in->nparams = strtol(comma + 1, &s, 10);
+		if (*s == ',') s++;
+		in->a[0] = parse_operand(&s, p);
+	} else {
+		for (int k = 0; k < 3; k++) in->a[k] = parse_operand(&s, p);
+	}
+	p->ncode++;
+}
+
+static void parse_label(struct proc *p, int label) {
+
+	if (p->nlabels == p->labels_size) {
+		p->labels_size = p->labels_size ? 2 * p->labels_size : 16;
+		p->labels = xrealloc(p->labels, p->labels_size * sizeof(struct label));
+	}
+	p->labels[p->nlabels].label = label;
+	p->labels[p->nlabels++].at = p->ncode;
+}
+
+/*
+ * resolve - where each branch of p goes. A branch to no label fails here,
+ *  whether or not it would be taken, and so does a slot past the frame.
+ */
+static void resolve(struct proc *p) {
+
+	for (int i = 0; i < p->ncode; i++) {
+		struct op *in = &p->code[i];
+
+		in->target = -1;
+		for (int j = 0; j < p->nlabels; j++) {
+			if (in->a[0].region == R_LABEL && p->labels[j].label == in->a[0].value) {
+				in->target = p->labels[j].at;
+			}
+		}
+		if (in->a[0].region == R_LABEL && in->target < 0) {
+			fail(p, "no L:%ld to go to", in->a[0].value);
+		}
+		for (int k = 0; k < 3; k++) {
+			if (in->a[k].region == R_LOCAL &&
+				(in->a[k].value < 0 || in->a[k].value + 8 > p->frame_bytes)) {
+				fail(p, "loc:%ld is past its frame of %d bytes", in->a[k].value,
+					p->frame_bytes);
+			}
+		}
+	}
+}
+
+static void load(FILE *f) {
+
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	int in_code = 0, label;
+	struct proc *p = NULL;
+
+	while ((len = getline(&line, &size, f)) > 0) {
+		if (line[len - 1] == '\n') line[--len] = '\0';
+
+		if (strncmp(line, ".string", 7) == 0) {
+			in_code = 0;
+		} else if (strncmp(line, ".code", 5) == 0) {
+			in_code = 1;
+		} else if (!in_code || len == 0) {
+			continue;
+		} else if (strncmp(line, "proc\t", 5) == 0) {
+			char name[256];
+			int param_bytes, frame_bytes;
+
+			if (sscanf(line + 5, "%255[^,], %d, %d", name, &param_bytes, &frame_bytes) != 3) {
+				fail(NULL, "no procedure in '%s'", line);
+			}
+			if (p != NULL) resolve(p);
+			if (nprocs == procs_size) {
+				procs_size = procs_size ? 2 * procs_size : 16;
+				procs = xrealloc(procs, procs_size * sizeof(struct proc));
+			}
+			p = &procs[nprocs++];
+			memset(p, 0, sizeof(struct proc));
+			p->name = strdup(name);
+			p->frame_bytes = param_bytes > frame_bytes ? param_bytes : frame_bytes;
+		} else if (sscanf(line, "L:%d", &label) == 1) {
+			if (p == NULL) fail(NULL, "L:%d outside a procedure", label);
+			parse_label(p, label);
+		} else if (line[0] == '\t' && p != NULL) {
+			parse_instr(p, line + 1);
+		}
+	}
+	if (p != NULL) resolve(p);
+	free(line);
+}
+
+static struct proc *find_proc(char *name) {
+
+	for (int i = 0; i < nprocs; i++) {
+		if (strcmp(procs[i].name, name) == 0) return &procs[i];
+	}
+	return NULL;
+}
+
+/* word - the word of memory that operand o is, in the frame at base */
+static long *word(struct proc *p, long base, struct operand o) {
+
+	long at;
+
+	switch (o.region) {
+		case R_LOCAL:
+			at = base + o.value;
+			break;
+		case R_GLOBAL: case R_CLASS:
+			at = o.value;
+			if (at < 0 || at >= 8 * GLOBAL_WORDS) fail(p, "no global at %ld", at);
+			break;
+		default:
+			fail(p, "can't store in region %s", regionname(o.region));
+			return NULL;
+	}
+	return &mem[at / 8];
+}
+
+static long value(struct proc *p, long base, struct operand o) {
+
+	long v;
+
+	if (o.region == R_CONST) return o.value;
+	if (o.region == R_NONE) return 0;
+	v = *word(p, base, o);
+	if (v == UNSET) fail(p, "reads %s:%ld before it is set", regionname(o.region), o.value);
+	return v;
+}
+
+static long *pointer(struct proc *p, long address) {
+
+	if (address <= 0 || address % 8 != 0 || address >= 8L * MEM_WORDS) {
+		fail(p, "no memory at %ld", address);
+	}
+	return &mem[address / 8];
+}
+
+static void print_value(long v, int newline) {
+
+	if (v >= STRING_TAG && v < STRING_TAG + nstrings) {
+		printf("%s", strings[v - STRING_TAG]);
+	} else {
+		printf("%ld", v);
+	}
+	if (newline) printf("\n");
+}
+
+static long call(struct proc *caller, char *name, long *a, int n, int depth);
+
+/* int32 - v cut down to an int, wrapping as Java does */
+static long int32(long v) {
+	return (long) (int32_t) (uint32_t) v;
+}
+
+/* run - p, with its parameters a[0..n-1]; returns what it returns */
+static long run(struct proc *p, long *a, int n, int depth) {
+
+	long base = sp, result = 0;
+	int pc = 0;
+
+	if (depth > MAX_DEPTH) fail(p, "calls go too deep");
+	if (sp + p->frame_bytes + 8L * n >= heap) fail(p, "out of stack");
+	sp += p->frame_bytes > 8 * n ? p->frame_bytes : 8 * n;
+	for (long i = base / 8; i < sp / 8; i++) mem[i] = UNSET;
+	for (int i = 0; i < n; i++) mem[base / 8 + i] = a[i];
+
+	while (pc < p->ncode) {
+		struct op *in = &p->code[pc++];
+		long x = 0, y = 0;
+		int taken = 0;
+
+		if (++steps > MAX_STEPS) fail(p, "runs too long");
+		/* an ADDR reads no value, only where its operand is */
+		if (in->opcode != O_CALL && in->opcode != O_ADDR) {
+			x = value(p, base, in->a[1]);
+			y = value(p, base, in->a[2]);
+		}
+
+		switch (in->opcode) {
+			case O_ADD: *word(p, base, in->a[0]) = int32(x + y); break;
+			case O_SUB: *word(p, base, in->a[0]) = int32(x - y); break;
+			case O_MUL: *word(p, base, in->a[0]) = int32(x * y); break;
+			case O_DIV: case O_MOD:
+				if (y == 0) fail(p, "divides by zero");
+				*word(p, base, in->a[0]) = int32(in->opcode == O_DIV ? x / y : x % y);
+				break;
+			case O_NEG: *word(p, base, in->a[0]) = int32(-x); break;
+			case O_NOT: *word(p, base, in->a[0]) = !x; break;
+			case O_ASN: *word(p, base, in->a[0]) = x; break;
+			case O_ADDR:
+				if (in->a[1].region == R_LOCAL) {
+					*word(p, base, in->a[0]) = base + in->a[1].value;
+				} else {
+					*word(p, base, in->a[0]) = (long) (word(p, base, in->a[1]) - mem) * 8;
+				}
+				break;
+			case O_LCONT:
+				if (*pointer(p, x) == UNSET) fail(p, "reads memory at %ld before it is set", x);
+				*word(p, base, in->a[0]) = *pointer(p, x);
+				break;
+			case O_SCONT: *pointer(p, value(p, base, in->a[0])) = x; break;
+			case O_GOTO: taken = 1; break;
+			case O_BLT: taken = x < y; break;
+			case O_BLE: taken = x <= y; break;
+			case O_BGT: taken = x > y; break;
+			case O_BGE: taken = x >= y; break;
+			case O_BEQ: taken = x == y; break;
+			case O_BNE: taken = x != y; break;
+			case O_BIF: taken = x != 0; break;
+			case O_BNIF: taken = x == 0; break;
+			case O_PARM:
+				if (nargs == MAX_ARGS) fail(p, "too many parameters");
+				args[nargs++] = value(p, base, in->a[0]);
+				break;
+			case O_CALL: {
+				long a[64], r;
+
+				if (in->nparams > nargs || in->nparams > 64) fail(p, "%s without its parameters", in->name);
+				/* the PARMs come last parameter first */
+				for (int i = 0; i < in->nparams; i++) a[i] = args[nargs - 1 - i];
+				nargs -= in->nparams;
+				r = call(p, in->name, a, in->nparams, depth);
+				if (in->a[0].region != R_NONE) *word(p, base, in->a[0]) = r;
+				break;
+			}
+			case O_RET:
+				result = value(p, base, in->a[0]);
+				pc = p->ncode;
+				break;
+		}
+
+		if (taken) {
+			if (in->target < 0) fail(p, "no L:%ld to go to", in->a[0].value);
+			pc = in->target;
+		}
+	}
+
+	sp = base;
+	return result;
+}
+
+/* call - name, by caller, with its parameters a[0..n-1]; the runtime's own first */
+static long call(struct proc *caller, char *name, long *a, int n, int depth) {
+
+	struct proc *p;
+
+	if ((strcmp(name, "println") == 0 || strcmp(name, "print") == 0) && n == 1) {
+		print_value(a[0], name[5] == 'l');
+		return 0;
+	}
+	if (strcmp(name, "new") == 0 && n == 1) {
+		if (a[0] < 0 || heap - 8 * a[0] <= sp) fail(caller, "new of %ld words", a[0]);
+		heap -= 8 * a[0];
+		memset(&mem[heap / 8], 0, 8 * a[0]);
+		return heap;
+	}
+	if ((p = find_proc(name)) == NULL) fail(caller, "no procedure %s", name);
+	return run(p, a, n, depth + 1);
+}
+
+int main(int argc, char *argv[]) {
+
+	FILE *f;
+	int show_steps = argc == 3 && strcmp(argv[1], "-steps") == 0;
+
+	if (argc != 2 + show_steps) {
+		fprintf(stderr, "usage: %s [-steps] FILE.icn\n", argv[0]);
+		return 2;
+	}
+	if ((f = fopen(argv[argc - 1], "r")) == NULL) {
+		perror(argv[argc - 1]);
+		return 2;
+	}
+	load(f);
+	fclose(f);
+
+	mem = calloc(MEM_WORDS, sizeof(long));
+	if (mem == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	call(NULL, "main", NULL, 0, 0);
+	if (show_steps) fprintf(stderr, "j0run: %ld instructions\n", steps);
+	return 0;
+}
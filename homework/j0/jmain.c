@@ -1,23 +1,71 @@
+#include <unistd.h>
+#include <ctype.h>
+#include <time.h>
+
 #include "defs.h"
 #include "tree.h"
 #include "error.h"
 #include "symboltable.h"
 #include "intermediate.h"
+#include "server.h"
+#include "frame.h"
+#include "cache.h"
+#include "incremental.h"
+#include "parallel.h"
+#include "index.h"
+#include "optimize.h"
 
 extern int yydebug;
 char *filename;
 extern struct tree *root;
-extern struct icn_string *icn_strings;
 
 //Flag set boolean values
 int symtab_print_flag = 0;
 int tree_print_flag = 0;
+int cache_flag = 0;
+int cache_stats_flag = 0;
+int index_flag = 0;
+int jobs = 1;
+int flat_scopes = 0;
+int opt_level = 0;
+char *opt_passes = NULL;
+int opt_stats_flag = 0;
+int phase_times_flag = 0;
+
+//Set by the server in a compile child, see server.c
+char *icn_dir = NULL;
+char *source_text = NULL;
+size_t source_len = 0;
 
 int check_file_extension(char *file);
 void set_flag (char* flag);
+FILE *open_source(char *path);
+char *read_source(FILE *f, size_t *len);
+char *output_flags();
+
+/* seconds - a monotonic clock, for -phasetimes */
+static double seconds() {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 int main(int argc, char *argv[]) {
 
+	if (argc > 1 && strncmp(argv[1], "--server", 8) == 0) {
+		if (argv[1][8] == '=') {
+			return run_server(argv[1] + 9);
+		}
+		return run_server(default_socket_path());
+	}
+
+	return run_compiler(argc, argv);
+}
+
+int run_compiler(int argc, char *argv[]) {
+
 	if (argc == 1) {
 		printf("Must provide file name as command line argument\n");
     	return 0;
@@ -45,61 +93,205 @@ int main(int argc, char *argv[]) {
 		argv += flag_count;
 		argc -= flag_count;
 
+		if (cache_stats_flag) {
+			cache_print_stats(stdout);
+		}
+
 		while (--argc > 0) {
 
-			if ((yyin = fopen(*++argv, "r")) == NULL) {
+			if ((yyin = open_source(*++argv)) == NULL) {
 				printf("\nCan not open '%s': File does not exist\n\n", *argv);
 			} else if(check_file_extension(*argv) != 1) {
 		  		printf("\nCan not open '%s': File does not have .java extension\n\n", *argv);
 			} else {
 
 	    		filename = *argv;
-				char* simplified_name = strrchr(filename, '/') + 1;
-				char* icn_file_name = strdup(simplified_name);
+				char* simplified_name = strrchr(filename, '/') ?
+					strrchr(filename, '/') + 1 : filename;
+				char* icn_file_name = malloc(strlen(simplified_name) +
+					(icn_dir ? strlen(icn_dir) + 1 : 0) + 1);
+				if (icn_dir) {
+					sprintf(icn_file_name, "%s/%s", icn_dir, simplified_name);
+				} else {
+					strcpy(icn_file_name, simplified_name);
+				}
 				icn_file_name[strlen(icn_file_name)-4] = 0;
 				strcat(icn_file_name, "icn");
 
 				printf("\n\n---------------------------------------\n");
 				printf("Opened File: %s\n", simplified_name);
 				printf("---------------------------------------\n");
+
+				/*
+				 * -tree and -symtab print as they go, and only the .icn
+				 * is cached, so those compiles always run in full. So do
+				 * -index compiles, which need the symbol tables.
+				 */
+				uint64_t key = 0;
+				int use_cache = cache_flag && !tree_print_flag &&
+					!symtab_print_flag && !index_flag;
+				if (use_cache) {
+					size_t len;
+					char *source = read_source(yyin, &len);
+					key = cache_key(source, len, output_flags());
+					free(source);
+					if (cache_fetch(key, icn_file_name)) {
+						printf("\n");
+						exit(0);
+					}
+				}
+
 				// yydebug = 1;
 				yyparse();
 
-				if (tree_print_flag) {
+				if (tree_print_flag && root != NULL) {
 					printf("\n");
 					print_tree(root, 0);
 				}
 
-				globals = make_sym_table(20, "global");
-				current = globals;
-				load_builtins();
+				/* error recovery leaves holes in the tree, don't analyze it */
+				if (error_count(SYNTAX_ERROR) > 0 || root == NULL) {
+					exit(flush_diagnostics(stderr));
+				}
+
+				if (globals == NULL) {
+					init_globals();
+				}
+				if (index_flag) {
+					index_start();
+				}
 				populate_symbol_tables(root);
+				if (index_flag) {
+					char *index_file_name = strdup(icn_file_name);
+					strcpy(index_file_name + strlen(index_file_name) - 3, "idx");
+					write_index(index_file_name);
+				}
+				if (use_cache) {
+					plan_methods(root, output_flags());
+				}
 
 				if (symtab_print_flag) {
 					printf("\n\nprintsymbols() output:\n");
 					printf("---------------------------------------\n\n");
+					printsymbols(globals->parent, 1);
 					printsymbols(globals, 1);
 				}
+				if (jobs > 1) {
+					parallel_check(root, jobs);
+				}
 				check_types(root);
 
+				if (error_count(0) > 0) {
+					exit(flush_diagnostics(stderr));
+				}
+
 				// print_intermediate_tree(root, 0);
-				genfirst(root);
-				genfollow(root);
-				gentargets(root);
+				if (jobs > 1) {
+					parallel_gen(root, jobs);
+				}
+				double start = seconds();
+				genattributes(root);
+				double attributes = seconds();
 				gen_intermediate_code(root);
+				double codegen = seconds();
+				if (phase_times_flag) {
+					fprintf(stderr, "attributes: %.3f s\n", attributes - start);
+					fprintf(stderr, "code generation: %.3f s\n", codegen - attributes);
+				}
 				// print_intermediate_tree(root, 0);
 
+				/* what the cache keeps of each method is its code as generated */
+				if (use_cache) {
+					save_methods();
+				}
+				if (opt_level > 0 || opt_passes != NULL) {
+					struct opt_stats stats = {0};
+					root->icode = optimize(root->icode, opt_level, opt_passes, &stats);
+					if (phase_times_flag) {
+						fprintf(stderr, "optimize: %.3f s\n", seconds() - codegen);
+					}
+					if (opt_stats_flag) {
+						print_opt_stats(stdout, &stats);
+					}
+				}
+
 				// printf("\n\n_____Final Tac Print_____\n\n");
+				/* it may be a hardlink into the cache, don't write through it */
+				unlink(icn_file_name);
 				FILE *icn_out = fopen(icn_file_name, "w");
-				print_icn_strings(icn_strings, icn_out);
+				print_icn_strings(icn_out);
 				tacprint(root->icode, icn_out);
 				printf("\n");
 				fclose(icn_out);
+				if (use_cache) {
+					cache_store(key, icn_file_name);
+				}
 				exit(0);
 				//free_tree(root, 0);
 			}
 		}
 	}
+
+	return 0;
+}
+
+/*
+ * open_source - open a file to compile. A server request can carry the
+ * source text itself (an editor's unsaved buffer), read that instead.
+ */
+FILE *open_source(char *path) {
+
+	if (source_text != NULL) {
+		return fmemopen(source_text, source_len, "r");
+	}
+
+	return fopen(path, "r");
+}
+
+/*
+ * read_source - the whole of f, which is left rewound for the parser.
+ * The cache key is a hash of these bytes.
+ */
+char *read_source(FILE *f, size_t *len) {
+
+	size_t size = 8192, n;
+	char *buf = malloc(size);
+
+	*len = 0;
+	while (buf != NULL && (n = fread(buf + *len, 1, size - *len, f)) > 0) {
+		*len += n;
+		if (*len == size) {
+			size *= 2;
+			buf = realloc(buf, size);
+		}
+	}
+
+	if (buf == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+
+	rewind(f);
+	return buf;
+}
+
+/* output_flags - the options that change what goes in the .icn, for the cache key */
+char *output_flags() {
+
+	static char *flags = NULL;
+
+	flags = realloc(flags, 16 + (opt_passes ? strlen(opt_passes) : 0));
+	if (flags == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	flags[0] = 0;
+	if (opt_passes != NULL) {
+		sprintf(flags, "-passes=%s", opt_passes);
+	} else if (opt_level > 0) {
+		sprintf(flags, "-O%d", opt_level);
+	}
+	return flags;
 }
 
 int check_file_extension(char *file) {
@@ -122,8 +314,31 @@ void set_flag (char* flag) {
 		symtab_print_flag = 1;
 	} else if(strcmp(flag, "-tree") == 0) {
 		tree_print_flag = 1;
+	} else if(strncmp(flag, "-maxerrors=", 11) == 0) {
+		set_max_errors(atoi(flag + 11));
+	} else if(strcmp(flag, "-cache") == 0) {
+		cache_flag = 1;
+	} else if(strcmp(flag, "-cachestats") == 0) {
+		cache_stats_flag = 1;
+	} else if(strncmp(flag, "-jobs=", 6) == 0 && atoi(flag + 6) > 0) {
+		jobs = atoi(flag + 6);
+	} else if(strcmp(flag, "-index") == 0) {
+		index_flag = 1;
+	} else if(strcmp(flag, "-flatscopes") == 0) {
+		flat_scopes = 1;
+	} else if(strcmp(flag, "-optstats") == 0) {
+		opt_stats_flag = 1;
+	} else if(strcmp(flag, "-phasetimes") == 0) {
+		phase_times_flag = 1;
+	} else if(strncmp(flag, "-passes=", 8) == 0 && check_pipeline(flag + 8, stderr)) {
+		opt_passes = flag + 8;
+	} else if(strcmp(flag, "-O") == 0) {
+		opt_level = 1;
+	} else if(flag[1] == 'O' && isdigit(flag[2]) && flag[3] == 0) {
+		opt_level = flag[2] - '0';
 	} else {
-		printf("\nAvailable flags include: -symtab, -tree\n");
+		printf("\nAvailable flags include: -symtab, -tree, -maxerrors=N, -cache, -cachestats, -jobs=N, -index, -flatscopes, -O[N], -passes=a,b,..., -optstats, -phasetimes\n");
+		printf("Or run as a compile server: ./j0 --server[=socket]\n");
 		throw_error("unknown flag");
 	}
 
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * Loop-invariant code motion. An instruction computes the same value on
+ * every trip around a loop when each of its operands is a constant, a
+ * variable the loop never writes, or the result of another such
+ * instruction. It can run once, in the preheader, instead when:
+ *
+ *  - it has no side effects (a division by what may be zero stays put);
+ *  - it is the loop's only write to its dest, a private variable;
+ *  - the dest is not live into the header, so no trip reads an older
+ *    value of it, and nothing before the loop sees the new one;
+ *  - the dest is not live out of an exit its block does not dominate,
+ *    where the loop would have left it alone.
+ *
+ * Memory is invariant only in a loop without a CALL or a store. Loops
+ * are done innermost first, so what leaves an inner loop may go on out
+ * of the one around it.
+ */
+
+struct licm {
+	struct cfg *g;
+	struct loop *l;
+	int *defs;		/* per variable: writes in the loop */
+	char *invariant;	/* per variable: its write in the loop is invariant */
+	int clobbers;		/* the loop has a CALL or a store */
+};
+
+static void *xcalloc(size_t n, size_t size) {
+
+	void *p = calloc(n, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static int invariant_operand(struct licm *m, struct addr *a) {
+
+	int v = cfg_var(m->g, a);
+
+	if (v < 0) return a->region == R_CONST;
+	if (m->defs[v] == 0) return m->g->vars[v].private || !m->clobbers;
+	return m->defs[v] == 1 && m->invariant[v];
+}
+
+/* dest_escapes - d is live out of an exit of the loop that b does not dominate */
+static int dest_escapes(struct licm *m, struct block *b, int d) {
+
+	struct cfg *g = m->g;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		struct block *e = g->blocks[i];
+
+		if (!m->l->body[e->id] || dominates(b, e)) continue;
+		for (int k = 0; k < e->nsucc; k++) {
+			if (!m->l->body[e->succ[k]->id] && live_test(e->succ[k]->live_in, d)) return 1;
+		}
+	}
+	return 0;
+}
+
+static int hoistable(struct licm *m, struct block *b, struct instr *in) {
+
+	struct addr *uses[2], *d = instr_def(in);
+	int n, v, k;
+
+	if (d == NULL || has_side_effects(in)) return 0;
+	switch (in->opcode) {
+		case O_ADD: case O_SUB: case O_MUL: case O_DIV: case O_MOD:
+		case O_NEG: case O_NOT: case O_ASN:
+			break;
+		default:
+			return 0;
+	}
+
+	v = cfg_var(m->g, d);
+	if (v < 0 || !m->g->vars[v].private || m->defs[v] != 1 || m->invariant[v]) return 0;
+	if (live_test(m->l->header->live_in, v) || dest_escapes(m, b, v)) return 0;
+
+	n = instr_uses(in, uses);
+	for (k = 0; k < n; k++) {
+		if (!invariant_operand(m, uses[k])) return 0;
+	}
+	return 1;
+}
+
+static int hoist_loop(struct licm *m) {
+
+	struct cfg *g = m->g;
+	struct loop *l = m->l;
+	struct block *pre = l->preheader;
+	struct instr **moved;
+	int nmoved = 0, changed = 1, i, j;
+
+	memset(m->defs, 0, g->nvars * sizeof(int));
+	memset(m->invariant, 0, g->nvars);
+	m->clobbers = 0;
+	for (i = 0; i < g->nblocks; i++) {
+		if (!l->body[i]) continue;
+		for (j = 0; j < g->blocks[i]->ncode; j++) {
+			struct instr *in = g->blocks[i]->code[j];
+			struct addr *d = instr_def(in);
+			int v;
+
+			if (in->code_type != DECLARATION &&
+				(in->opcode == O_CALL || in->opcode == O_SCONT)) m->clobbers = 1;
+			if (d != NULL && (v = cfg_var(g, d)) >= 0) m->defs[v]++;
+		}
+	}
+
+	/* mark until nothing more is invariant, then move them in that order */
+	moved = xcalloc(1, sizeof(struct instr *));
+	while (changed) {
+		changed = 0;
+		for (i = 0; i < g->nrpo; i++) {
+			struct block *b = g->rpo_order[i];
+
+			if (!l->body[b->id]) continue;
+			for (j = 0; j < b->ncode; j++) {
+				struct instr *in = b->code[j];
+
+				if (!hoistable(m, b, in)) continue;
+
+				m->invariant[cfg_var(g, instr_def(in))] = 1;
+				moved = realloc(moved, (nmoved + 1) * sizeof(struct instr *));
+				if (moved == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(4);
+				}
+				moved[nmoved++] = in;
+				block_remove(b, j--);
+				changed = 1;
+			}
+		}
+	}
+
+	for (i = 0; i < nmoved; i++) block_insert(pre, block_end(pre), moved[i]);
+	free(moved);
+	return nmoved;
+}
+
+/* licm - hoist the invariant instructions of every loop with a preheader */
+int licm(struct cfg *g, struct opt_stats *stats) {
+
+	struct licm m;
+	int hoisted = 0;
+
+	find_loops(g);
+	cfg_liveness(g);
+
+	memset(&m, 0, sizeof(m));
+	m.g = g;
+	m.defs = xcalloc(g->nvars + 1, sizeof(int));
+	m.invariant = xcalloc(g->nvars + 1, 1);
+
+	for (int i = 0; i < g->nloops; i++) {
+		int n;
+
+		if (g->loops[i]->preheader == NULL) continue;
+		m.l = g->loops[i];
+		n = hoist_loop(&m);
+		stats->loops++;
+		if (n > 0) {
+			hoisted += n;
+			cfg_liveness(g);
+		}
+	}
+
+	free(m.defs);
+	free(m.invariant);
+
+	stats->hoisted += hoisted;
+	return hoisted;
+}
@@ -0,0 +1,47 @@
+#!/bin/bash
+# Compile each program in tests/opt at -O0, -O1 and -O2, and once with
+# each optimizer pass on its own, run it with ./j0run, and compare what
+# it prints with the .expected file beside it. However it is compiled,
+# a program must print the same.
+# usage: ./opt_runner.sh [programs...]     (default: tests/opt/*.java)
+
+J0=$(realpath ./j0)
+J0RUN=$(realpath ./j0run)
+PASSES="tailcall inline jumps peephole sccp stack cse range licm ivopt dce"
+OUT=$(pwd)/opt_runner.out
+WORK=$(mktemp -d)
+FILES=("$@")
+failed=0
+runs=0
+
+if [ ${#FILES[@]} -eq 0 ]; then
+	FILES=(tests/opt/*.java)
+fi
+
+rm -f $OUT
+
+for f in "${FILES[@]}"; do
+	name=$(basename $f .java)
+	expected=$(realpath ${f%.java}.expected)
+	f=$(realpath $f)
+	for flags in -O0 -O1 -O2 $(for p in $PASSES; do echo -passes=$p; done); do
+		runs=$((runs + 1))
+		rm -f $WORK/$name.icn
+		if ! (cd $WORK && $J0 $flags $f > $WORK/j0.out 2>&1); then
+			echo "FAIL $name $flags: does not compile" | tee -a $OUT
+			cat $WORK/j0.out >> $OUT
+			failed=$((failed + 1))
+			continue
+		fi
+		$J0RUN $WORK/$name.icn > $WORK/run.out 2>&1
+		if ! cmp -s $WORK/run.out $expected; then
+			echo "FAIL $name $flags" | tee -a $OUT
+			diff $expected $WORK/run.out >> $OUT
+			failed=$((failed + 1))
+		fi
+	done
+done
+
+echo "$runs runs of ${#FILES[@]} programs, $failed failed" | tee -a $OUT
+rm -rf $WORK
+[ $failed -eq 0 ]
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * The pass manager. A pipeline is a list of passes by name, run in order;
+ * -O1 and -O2 each have one, and -passes= gives any other. There are three
+ * kinds of pass: those that take the whole program, those that take the
+ * list of one procedure's code, and those that take its graph. The passes
+ * between two that take the whole program are run a procedure at a time,
+ * and each run of graph passes among them shares one graph, built and
+ * linearized around it. Building one drops the code no one reaches.
+ *
+ * Each pass is timed, and the instructions it was given counted before
+ * and after. Unless NDEBUG is defined, the code is checked after every
+ * pass (see verify.c), and the compiler stops at the first that breaks
+ * it.
+ */
+
+enum pass_kind {ON_PROGRAM, ON_PROC, ON_CFG};
+
+struct pass {
+	char *name;
+	enum pass_kind kind;
+	int (*program)(struct instr *code, struct opt_stats *stats);
+	int (*proc)(struct instr *proc, struct opt_stats *stats);
+	int (*cfg)(struct cfg *g, struct opt_stats *stats);
+};
+
+static int constants(struct cfg *g, struct opt_stats *stats);
+static int reduce(struct cfg *g, struct opt_stats *stats);
+
+static struct pass passes[] = {
+	{"tailcall", ON_PROGRAM, tail_calls, NULL, NULL},
+	{"inline", ON_PROGRAM, inline_calls, NULL, NULL},
+	{"jumps", ON_PROC, NULL, thread_jumps, NULL},
+	{"peephole", ON_PROC, NULL, peephole, NULL},
+	{"sccp", ON_CFG, NULL, NULL, constants},
+	{"stack", ON_CFG, NULL, NULL, stack_allocate},
+	{"cse", ON_CFG, NULL, NULL, cse},
+	{"range", ON_CFG, NULL, NULL, range_checks},
+	{"licm", ON_CFG, NULL, NULL, licm},
+	{"ivopt", ON_CFG, NULL, NULL, reduce},
+	{"dce", ON_CFG, NULL, NULL, dead_code},
+};
+
+#define NPASSES (int) (sizeof(passes) / sizeof(passes[0]))
+
+/*
+ * The pipelines of -O1 and up. Tail calls go first, since a procedure
+ * without them may be a leaf to inline. The GOTOs threaded first leave
+ * code no one reaches for the graph to drop.
+ */
+static char *levels[] = {
+	"",
+	"tailcall,inline,jumps,stack,cse,range,licm,ivopt,dce,jumps,peephole",
+	"tailcall,inline,jumps,sccp,stack,cse,range,licm,ivopt,dce,jumps,peephole",
+};
+
+#define NLEVELS (int) (sizeof(levels) / sizeof(levels[0]))
+
+/* constants - sccp(), which wants SSA form, and only there */
+static int constants(struct cfg *g, struct opt_stats *stats) {
+
+	int before = stats->constants + stats->branches;
+
+	to_ssa(g, stats);
+	sccp(g, stats);
+	from_ssa(g, stats);
+	return stats->constants + stats->branches - before;
+}
+
+/* reduce - ivopt(), then cse() for what it leaves the same twice */
+static int reduce(struct cfg *g, struct opt_stats *stats) {
+
+	int reduced = ivopt(g, stats);
+
+	if (reduced > 0) cse(g, stats);
+	return reduced;
+}
+
+static struct pass *find_pass(char *name, int len) {
+
+	for (int i = 0; i < NPASSES; i++) {
+		if ((int) strlen(passes[i].name) == len && strncmp(passes[i].name, name, len) == 0) {
+			return &passes[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * parse_pipeline - the passes text names, separated by commas, into
+ *  pipeline. Returns how many, or -1 if one is not a pass.
+ */
+static int parse_pipeline(char *text, struct pass **pipeline, FILE *err) {
+
+	int n = 0;
+
+	while (*text != '\0') {
+		int len = strcspn(text, ",");
+
+		if (len > 0) {
+			struct pass *p = find_pass(text, len);
+
+			if (p == NULL || n == OPT_MAX_PIPELINE) {
+				if (err != NULL && p == NULL) {
+					fprintf(err, "no pass called '%.*s', there are:", len, text);
+					for (int i = 0; i < NPASSES; i++) fprintf(err, " %s", passes[i].name);
+					fprintf(err, "\n");
+				} else if (err != NULL) {
+					fprintf(err, "no more than %d passes to a pipeline\n", OPT_MAX_PIPELINE);
+				}
+				return -1;
+			}
+			pipeline[n++] = p;
+		}
+		text += len;
+		if (*text == ',') text++;
+	}
+	return n;
+}
+
+/* check_pipeline - whether text names passes, for -passes=; if not, says why on err */
+int check_pipeline(char *text, FILE *err) {
+
+	struct pass *pipeline[OPT_MAX_PIPELINE];
+
+	return parse_pipeline(text, pipeline, err) >= 0;
+}
+
+static int is_proc(struct instr *in) {
+	return in != NULL && in->code_type == DECLARATION && in->opcode == D_PROC;
+}
+
+/* count_code - the instructions from in up to the next D_PROC, or all if whole */
+static long count_code(struct instr *in, int whole) {
+
+	long n = 0;
+
+	for (; in != NULL && (whole || !is_proc(in)); in = in->next) {
+		if (in->code_type != DECLARATION) n++;
+	}
+	return n;
+}
+
+static long count_cfg(struct cfg *g) {
+
+	long n = 0;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		for (int j = 0; j < g->blocks[i]->ncode; j++) {
+			if (g->blocks[i]->code[j]->code_type != DECLARATION) n++;
+		}
+	}
+	return n;
+}
+
+static double seconds(void) {
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+/* broken - stop the compiler, pass having left the code of proc wrong */
+static void broken(struct pass *pass, struct instr *proc, char *why) {
+
+	fprintf(stderr, "optimizer: %s left %s wrong: %s\n", pass ? pass->name : "code generation",
+		proc != NULL && proc->name != NULL ? proc->name : "the program", why);
+	abort();
+}
+
+/* verify_list - check the code from code, all of it or just the procedure it declares */
+static void verify_list(struct pass *pass, struct instr *code, int whole) {
+#ifndef NDEBUG
+	char *why = verify_code(code, whole);
+
+	if (why != NULL) broken(pass, whole ? NULL : code, why);
+#endif
+}
+
+static void verify_graph(struct pass *pass, struct cfg *g) {
+#ifndef NDEBUG
+	char *why = verify_cfg(g);
+
+	if (why != NULL) broken(pass, g->proc, why);
+#endif
+}
+
+/* run_on_graph - the graph passes from pipeline[k], on g; returns the index past them */
+static int run_on_graph(struct pass **pipeline, int k, int end, struct cfg *g,
+	struct opt_stats *stats) {
+
+	for (; k < end && pipeline[k]->kind == ON_CFG; k++) {
+		struct pass_stats *s = &stats->pipeline[k];
+		double start = seconds();
+
+		s->before += count_cfg(g);
+		pipeline[k]->cfg(g, stats);
+		s->seconds += seconds() - start;
+		s->after += count_cfg(g);
+		s->runs++;
+		verify_graph(pipeline[k], g);
+	}
+	return k;
+}
+
+/*
+ * run_on_proc - pipeline[from] up to pipeline[end], none of which takes
+ *  the whole program, on the procedure declared by proc. next is the
+ *  D_PROC after it, which linearizing a graph loses.
+ */
+static void run_on_proc(struct pass **pipeline, int from, int end, struct instr *proc,
+	struct instr *next, struct opt_stats *stats) {
+
+	int k = from;
+
+	while (k < end) {
+		struct instr *tail;
+		struct cfg *g;
+
+		if (pipeline[k]->kind == ON_PROC) {
+			struct pass_stats *s = &stats->pipeline[k];
+			double start = seconds();
+
+			s->before += count_code(proc->next, 0);
+			pipeline[k]->proc(proc, stats);
+			s->seconds += seconds() - start;
+			s->after += count_code(proc->next, 0);
+			s->runs++;
+			verify_list(pipeline[k], proc, 0);
+			k++;
+			continue;
+		}
+
+		g = build_cfg(proc, proc->next);
+		cfg_dominators(g);
+		stats->removed += cfg_remove_unreachable(g);
+
+		k = run_on_graph(pipeline, k, end, g, stats);
+
+		linearize_cfg(g, &tail);
+		tail->next = next;
+		free_cfg(g);
+	}
+}
+
+/* weighted_size - cfg_weighted_size() summed over the procedures of code */
+static long weighted_size(struct instr *code) {
+
+	long size = 0;
+
+	for (struct instr *in = code; in != NULL; in = in->next) {
+		struct cfg *g;
+
+		if (!is_proc(in)) continue;
+		g = build_cfg(in, in->next);
+		find_loops(g);
+		size += cfg_weighted_size(g);
+		free_cfg(g);
+	}
+	return size;
+}
+
+/*
+ * optimize - the optimized code of a program, by the pipeline passes
+ *  names, or if that is NULL the one for level. The procedures are done
+ *  in place; whatever comes before the first of them is left.
+ */
+struct instr *optimize(struct instr *code, int level, char *names, struct opt_stats *stats) {
+
+	struct pass *pipeline[OPT_MAX_PIPELINE];
+	int n, k = 0;
+
+	if (names == NULL) {
+		if (level <= 0) return code;
+		names = levels[level < NLEVELS ? level : NLEVELS - 1];
+	}
+	if ((n = parse_pipeline(names, pipeline, stderr)) < 0) return code;
+
+	stats->npipeline = n;
+	for (int i = 0; i < n; i++) stats->pipeline[i].name = pipeline[i]->name;
+	stats->weight_before += weighted_size(code);
+	verify_list(NULL, code, 1);
+
+	while (k < n) {
+		struct pass_stats *s = &stats->pipeline[k];
+		int end;
+
+		if (pipeline[k]->kind == ON_PROGRAM) {
+			double start = seconds();
+
+			s->before += count_code(code, 1);
+			pipeline[k]->program(code, stats);
+			s->seconds += seconds() - start;
+			s->after += count_code(code, 1);
+			s->runs++;
+			verify_list(pipeline[k], code, 1);
+			k++;
+			continue;
+		}
+
+		for (end = k; end < n && pipeline[end]->kind != ON_PROGRAM; end++);
+		for (struct instr *in = code; in != NULL; ) {
+			struct instr *next;
+
+			if (!is_proc(in)) {
+				in = in->next;
+				continue;
+			}
+			for (next = in->next; next != NULL && !is_proc(next); next = next->next);
+			run_on_proc(pipeline, k, end, in, next, stats);
+			in = next;
+		}
+		k = end;
+	}
+
+	stats->weight_after += weighted_size(code);
+	return code;
+}
+
+/* print_opt_stats - what optimize() did, for -optstats */
+void print_opt_stats(FILE *f, struct opt_stats *stats) {
+
+	fprintf(f, "optimizer: %d+%d common subexpressions (local+global), %d copies propagated\n",
+		stats->cse_local, stats->cse_global, stats->copies);
+	fprintf(f, "optimizer: %d constants propagated, %d branches folded, %d compares decided by range\n",
+		stats->constants, stats->branches, stats->checks);
+	fprintf(f, "optimizer: %d instructions hoisted out of %d loops, %d removed\n",
+		stats->hoisted, stats->loops, stats->removed);
+	fprintf(f, "optimizer: %d multiplications strength-reduced, %d induction variables removed\n",
+		stats->reduced, stats->ivs_removed);
+	fprintf(f, "optimizer: %d calls inlined, %d tail calls made jumps, %d jumps threaded\n",
+		stats->inlined, stats->tail_calls, stats->threaded);
+	fprintf(f, "optimizer: %d arrays allocated in the frame\n", stats->stack_allocated);
+	fprintf(f, "optimizer: loop-weighted instruction count %ld -> %ld\n",
+		stats->weight_before, stats->weight_after);
+	for (int i = 0; i < stats->npipeline; i++) {
+		struct pass_stats *s = &stats->pipeline[i];
+
+		fprintf(f, "pass: %2d %-9s %5d runs %10.3fms %8ld -> %ld instructions\n", i + 1,
+			s->name, s->runs, 1000 * s->seconds, s->before, s->after);
+	}
+	for (int i = 0; i < npeep_rules; i++) {
+		fprintf(f, "peephole: %6d  %-14s %s\n", stats->peephole[i],
+			peep_rules[i].name, peep_rules[i].text);
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "tac.h"
+#include "peephole.h"
+
+struct cfg;
+
+#define OPT_MAX_PIPELINE 64	/* passes, see optimize.c */
+
+/* what one pass of the pipeline did, summed over what it ran on */
+struct pass_stats {
+	char *name;
+	int runs;
+	long before, after;	/* instructions it was given, and left */
+	double seconds;
+};
+
+/* what the passes did, summed over the procedures */
+struct opt_stats {
+	int cse_local;		/* computations replaced by a copy, within a block */
+	int cse_global;		/* the same, from a dominating block */
+	int copies;		/* operands replaced by an older copy or a constant */
+	int constants;		/* operands replaced by the constant they always are */
+	int branches;		/* branches on a constant, made a GOTO or deleted */
+	int checks;		/* compares range analysis decided, the same */
+	int loops;		/* loops with a preheader */
+	int hoisted;		/* instructions moved out of a loop */
+	int reduced;		/* multiplications by an induction variable made additions */
+	int ivs_removed;	/* induction variables no longer updated in their loop */
+	int removed;		/* instructions deleted */
+	int inlined;		/* calls replaced by the body of their procedure */
+	int tail_calls;		/* calls of a procedure to itself made a jump */
+	int stack_allocated;	/* arrays put in the frame instead of the heap */
+	int threaded;		/* branches sent past a GOTO to where it goes */
+
+	int peephole[PEEP_MAX_RULES];	/* hits, per rule of peephole.def */
+
+	long weight_before;	/* see cfg_weighted_size() */
+	long weight_after;
+
+	struct pass_stats pipeline[OPT_MAX_PIPELINE];
+	int npipeline;
+};
+
+extern int opt_level;
+extern char *opt_passes;
+
+struct instr *optimize(struct instr *code, int level, char *passes, struct opt_stats *stats);
+int check_pipeline(char *text, FILE *err);
+void print_opt_stats(FILE *f, struct opt_stats *stats);
+
+char *verify_code(struct instr *code, int whole);
+char *verify_cfg(struct cfg *g);
+
+void to_ssa(struct cfg *g, struct opt_stats *stats);
+void from_ssa(struct cfg *g, struct opt_stats *stats);
+void sccp(struct cfg *g, struct opt_stats *stats);
+
+int cse(struct cfg *g, struct opt_stats *stats);
+int dead_code(struct cfg *g, struct opt_stats *stats);
+int licm(struct cfg *g, struct opt_stats *stats);
+int ivopt(struct cfg *g, struct opt_stats *stats);
+int range_checks(struct cfg *g, struct opt_stats *stats);
+int stack_allocate(struct cfg *g, struct opt_stats *stats);
+int peephole(struct instr *proc, struct opt_stats *stats);
+int thread_jumps(struct instr *proc, struct opt_stats *stats);
+int inline_calls(struct instr *code, struct opt_stats *stats);
+int tail_calls(struct instr *code, struct opt_stats *stats);
+
+#endif
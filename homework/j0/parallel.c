@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "parallel.h"
+#include "incremental.h"
+#include "type.h"
+
+/*
+ * With -jobs=N the methods of a file are type checked, and then turned
+ * into code, on N threads. Methods don't depend on one another once the
+ * symbol tables are built: the slots a method's temporaries get come
+ * from its own table, and the labels and string literals it uses are
+ * kept per thread (see method_gen_end()). A worker compiles a method the way incremental.c
+ * compiles one that missed in the cache, with labels numbered from 0.
+ * The main thread's walk over the whole tree then finds every method
+ * ready and splices the code in source order, moving the labels to
+ * where the numbering has got to, so the output is the same whatever
+ * the number of jobs.
+ *
+ * The methods are handed out from one list with an atomic index, so a
+ * thread that is done with a short method just takes the next one. That
+ * balances the load as well as per-thread queues with stealing would
+ * for tasks this small, without the queues.
+ */
+
+struct pool {
+	struct method_unit **tasks;
+	int ntasks;
+	atomic_int next;
+	void (*work)(struct method_unit *u);
+};
+
+static void *worker(void *arg) {
+
+	struct pool *p = arg;
+	int i;
+
+	while ((i = atomic_fetch_add(&p->next, 1)) < p->ntasks) {
+		p->work(p->tasks[i]);
+	}
+
+	return NULL;
+}
+
+/*
+ * run_pool - call work on every method of root not reused from the
+ * cache, on up to jobs threads. The calling thread only waits, its
+ * labels and strings are those of the whole file.
+ */
+static void run_pool(struct tree *root, int jobs,
+	void (*work)(struct method_unit *u)) {
+
+	struct method_unit *u;
+	struct pool p;
+	pthread_t *threads;
+	int nthreads, i;
+
+	p.ntasks = 0;
+	for (u = method_units(root); u != NULL; u = u->next) {
+		if (!u->reused) p.ntasks++;
+	}
+	if (p.ntasks == 0) return;
+
+	p.tasks = malloc(p.ntasks * sizeof(struct method_unit *));
+	for (u = method_units(root), i = 0; u != NULL; u = u->next) {
+		if (!u->reused) p.tasks[i++] = u;
+	}
+	atomic_init(&p.next, 0);
+	p.work = work;
+
+	nthreads = jobs < p.ntasks ? jobs : p.ntasks;
+	threads = malloc(nthreads * sizeof(pthread_t));
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, worker, &p) != 0) {
+			break;
+		}
+	}
+	nthreads = i;
+
+	/* if no thread could be had, do it here */
+	if (nthreads == 0) {
+		worker(&p);
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	free(threads);
+	free(p.tasks);
+}
+
+static void check_unit(struct method_unit *u) {
+	check_types(u->decl);
+	u->checked = 1;
+}
+
+static void gen_unit(struct method_unit *u) {
+	labelcounter = 0;
+	genattributes(u->decl);
+	gen_intermediate_code(u->decl);
+	u->ready = 1;
+}
+
+/* parallel_check - type check the methods of root, check_types() does the rest */
+void parallel_check(struct tree *root, int jobs) {
+	run_pool(root, jobs, check_unit);
+}
+
+/*
+ * parallel_gen - generate the code of the methods of root, to be spliced
+ * in by genattributes() and gen_intermediate_code() over root.
+ */
+void parallel_gen(struct tree *root, int jobs) {
+	run_pool(root, jobs, gen_unit);
+}
@@ -0,0 +1,9 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "tree.h"
+
+void parallel_check(struct tree *root, int jobs);
+void parallel_gen(struct tree *root, int jobs);
+
+#endif
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "optimize.h"
+#include "peephole.h"
+
+/*
+ * The peephole pass: slides a window down the code of a procedure and
+ * at each instruction tries the rules of peephole.def in order. When one
+ * matches, the instructions it matched are replaced and the window stays
+ * where it is, since the new code may match again. Passes repeat until
+ * one changes nothing.
+ */
+
+struct window {
+	struct instr *proc;
+	struct addr vars[PEEP_VARS];
+	char bound[PEEP_VARS];
+};
+
+static int is_declaration(struct instr *in) {
+	return in->code_type == DECLARATION;
+}
+
+static int match_operand(struct window *w, const struct peep_operand *p, struct addr *a) {
+
+	switch (p->kind) {
+		case P_VAR:
+			if (!w->bound[p->n]) {
+				w->vars[p->n] = *a;
+				w->bound[p->n] = 1;
+				return 1;
+			}
+			return addr_equal(w->vars[p->n], *a);
+		case P_INT:
+			return a->region == R_CONST && a->tag == OFFSET && a->u.offset == p->n;
+		default:
+			return 1;
+	}
+}
+
+static int match_instr(struct window *w, const struct peep_instr *p, struct instr *in) {
+
+	if (in == NULL || (is_declaration(in) && in->opcode == D_PROC)) return 0;
+	if (p->opcode == PEEP_ANY_OP) return !is_declaration(in);
+	if (in->opcode != p->opcode || is_declaration(in) != (p->opcode == D_LABEL)) return 0;
+
+	return match_operand(w, &p->opnd[0], &in->dest) &&
+		match_operand(w, &p->opnd[1], &in->src1) &&
+		match_operand(w, &p->opnd[2], &in->src2);
+}
+
+/* read_outside - whether a is read in the procedure other than by the n at first */
+static int read_outside(struct window *w, struct addr *a, struct instr *first, int n) {
+
+	struct instr *in;
+
+	for (in = w->proc->next; in != NULL && in->opcode != D_PROC; in = in->next) {
+		struct addr *uses[2];
+		int k;
+
+		if (in == first && n > 0) {
+			first = first->next;
+			n--;
+			continue;
+		}
+		for (k = instr_uses(in, uses) - 1; k >= 0; k--) {
+			if (addr_equal(*uses[k], *a)) return 1;
+		}
+	}
+	return 0;
+}
+
+static int match(struct window *w, const struct peep_rule *r, struct instr *first) {
+
+	struct instr *in = first;
+	int i;
+
+	memset(w->bound, 0, sizeof(w->bound));
+	for (i = 0; i < r->nmatch; i++, in = in->next) {
+		if (!match_instr(w, &r->match[i], in)) return 0;
+	}
+
+	for (i = 0; i < PEEP_VARS; i++) {
+		if (!(r->dead & (1u << i))) continue;
+		if (!is_private(&w->vars[i]) || read_outside(w, &w->vars[i], first, r->nmatch)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static struct addr operand(struct window *w, const struct peep_operand *p) {
+
+	struct addr a;
+
+	memset(&a, 0, sizeof(a));
+	switch (p->kind) {
+		case P_VAR:
+			return w->vars[p->n];
+		case P_INT:
+			a.region = R_CONST;
+			a.tag = OFFSET;
+			a.u.offset = p->n;
+			return a;
+		default:
+			a.region = R_NONE;
+			return a;
+	}
+}
+
+/* rewrite - replace the window at *link by what r makes of it */
+static void rewrite(struct window *w, const struct peep_rule *r, struct instr **link) {
+
+	struct instr *rest = *link;
+	int i;
+
+	for (i = 0; i < r->nmatch; i++) rest = rest->next;
+
+	for (i = 0; i < r->nreplace; i++) {
+		const struct peep_instr *p = &r->replace[i];
+		struct instr *in = gen(p->opcode, operand(w, &p->opnd[0]),
+			operand(w, &p->opnd[1]), operand(w, &p->opnd[2]));
+
+		if (p->opcode == D_LABEL) in->code_type = DECLARATION;
+		*link = in;
+		link = &in->next;
+	}
+	*link = rest;
+}
+
+/*
+ * peephole - apply the rules to the procedure declared by proc until
+ *  none applies. Returns how many times they did.
+ */
+int peephole(struct instr *proc, struct opt_stats *stats) {
+
+	struct window w;
+	int hits = 0, changed = 1;
+
+	memset(&w, 0, sizeof(w));
+	w.proc = proc;
+
+	while (changed) {
+		struct instr **link = &proc->next;
+
+		changed = 0;
+		while (*link != NULL && (*link)->opcode != D_PROC) {
+			int i;
+
+			for (i = 0; i < npeep_rules; i++) {
+				if (match(&w, &peep_rules[i], *link)) break;
+			}
+			if (i == npeep_rules) {
+				link = &(*link)->next;
+				continue;
+			}
+
+			rewrite(&w, &peep_rules[i], link);
+			stats->peephole[i]++;
+			hits++;
+			changed = 1;
+		}
+	}
+	return hits;
+}
+
+static int is_label(struct instr *in) {
+	return is_declaration(in) && in->opcode == D_LABEL;
+}
+
+/*
+ * thread_jumps - send every branch to a label that only leads to a GOTO
+ *  straight to where the GOTO goes, through any chain of them. A chain
+ *  that comes back on itself is followed no further than its length, so
+ *  a loop that never ends stays one. Returns how many branches changed.
+ */
+int thread_jumps(struct instr *proc, struct opt_stats *stats) {
+
+	struct instr *in;
+	int *target, lo = 0, hi = -1, threaded = 0;
+
+	for (in = proc->next; in != NULL && in->opcode != D_PROC; in = in->next) {
+		if (!is_label(in)) continue;
+		if (hi < lo) lo = hi = in->dest.u.offset;
+		if (in->dest.u.offset < lo) lo = in->dest.u.offset;
+		if (in->dest.u.offset > hi) hi = in->dest.u.offset;
+	}
+	if (hi < lo) return 0;
+
+	target = malloc((hi - lo + 1) * sizeof(int));
+	if (target == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+
+	/* where each label goes: the GOTO after it and any labels with it */
+	for (in = proc->next; in != NULL && in->opcode != D_PROC; in = in->next) {
+		struct instr *next = in;
+
+		if (!is_label(in)) continue;
+		while (next != NULL && is_label(next)) next = next->next;
+		target[in->dest.u.offset - lo] = next != NULL && next->code_type != DECLARATION &&
+			next->opcode == O_GOTO ? next->dest.u.offset : -1;
+	}
+
+	for (in = proc->next; in != NULL && in->opcode != D_PROC; in = in->next) {
+		int label, steps;
+
+		if (!is_branch(in) || in->opcode == O_RET) continue;
+
+		label = in->dest.u.offset;
+		for (steps = 0; steps <= hi - lo && label >= lo && label <= hi &&
+			target[label - lo] >= 0; steps++) {
+			label = target[label - lo];
+		}
+		if (label != in->dest.u.offset) {
+			in->dest.u.offset = label;
+			threaded++;
+		}
+	}
+
+	free(target);
+	stats->threaded += threaded;
+	return threaded;
+}
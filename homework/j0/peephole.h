@@ -0,0 +1,48 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "tac.h"
+
+/*
+ * The peephole rules, as gen_peephole compiles them from peephole.def
+ * into peephole_rules.c. A rule matches a window of instructions in a
+ * row and replaces them all.
+ */
+
+#define PEEP_WINDOW 3		/* instructions in a pattern or a replacement */
+#define PEEP_VARS 8		/* pattern variables in a rule */
+#define PEEP_MAX_RULES 64
+
+#define PEEP_ANY_OP 0		/* a pattern opcode that matches any instruction but a declaration */
+
+enum peep_kind {
+	P_NONE,			/* unused */
+	P_ANY,			/* matches anything */
+	P_VAR,			/* pattern variable n: the same address everywhere in the rule */
+	P_INT			/* the int constant n */
+};
+
+struct peep_operand {
+	enum peep_kind kind;
+	int n;
+};
+
+struct peep_instr {
+	int opcode;
+	struct peep_operand opnd[3];	/* dest, src1, src2 */
+};
+
+struct peep_rule {
+	char *name;
+	char *text;			/* as peephole.def has it */
+	int nmatch;
+	struct peep_instr match[PEEP_WINDOW];
+	int nreplace;
+	struct peep_instr replace[PEEP_WINDOW];
+	unsigned int dead;		/* variables not read outside the window, by bit */
+};
+
+extern const struct peep_rule peep_rules[];
+extern const int npeep_rules;
+
+#endif
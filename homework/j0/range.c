@@ -0,0 +1,461 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * Range analysis, and the compares it decides. At the top of each block
+ * every private variable has an interval of the values it may hold
+ * there, and the state also has facts x < y and x <= y between pairs of
+ * them. Taking a branch narrows the intervals of what it compares and
+ * adds its fact; a write to a variable forgets the facts about it. Once
+ * a block's state has grown a few times, any bound an edge coming back
+ * to it in reverse postorder still moves goes to the end of the int
+ * range. Every cycle has such an edge, so the analysis ends.
+ *
+ * A compare and branch the state before it decides becomes a GOTO or
+ * nothing. In the canonical loop
+ *
+ *	for (i = 0; i < n; i++) ... i < 0 ... i >= n ...
+ *
+ * i is at least 0 and below n all through the body, so both halves of a
+ * bounds check on i against n, 0 <= i < n, are known to pass there.
+ */
+
+#define MAX_FACTS 32		/* per state; more are not learned */
+#define WIDEN_AFTER 2		/* changes to a block's state before widening */
+
+struct interval {
+	long long lo, hi;
+};
+
+struct fact {
+	int x, y;		/* variables, x < y or x <= y */
+	int strict;
+};
+
+struct state {
+	int reached;
+	struct interval *r;	/* per variable */
+	struct fact facts[MAX_FACTS];
+	int nfacts;
+};
+
+struct ranges {
+	struct cfg *g;
+	int nvars;
+	struct state *in;	/* per block */
+	int *changes;		/* per block */
+};
+
+static void *xcalloc(size_t n, size_t size) {
+
+	void *p = calloc(n, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static struct interval top(void) {
+
+	struct interval t = {INT_MIN, INT_MAX};
+	return t;
+}
+
+static struct interval make(long long lo, long long hi) {
+
+	struct interval t = {lo, hi};
+
+	if (lo < INT_MIN || hi > INT_MAX) return top();
+	return t;
+}
+
+static int is_int(struct addr *a) {
+	return a->region == R_CONST && a->tag == OFFSET;
+}
+
+static int is_compare(struct instr *in) {
+	return in->code_type != DECLARATION && in->opcode >= O_BLT && in->opcode <= O_BNE;
+}
+
+/* tracked - the variable of a, if it is one the analysis follows, else -1 */
+static int tracked(struct ranges *o, struct addr *a) {
+
+	int v = cfg_var(o->g, a);
+
+	return v >= 0 && v < o->nvars && o->g->vars[v].private ? v : -1;
+}
+
+static struct interval value(struct ranges *o, struct state *s, struct addr *a) {
+
+	int v;
+
+	if (is_int(a)) return make(a->u.offset, a->u.offset);
+	if ((v = tracked(o, a)) >= 0) return s->r[v];
+	return top();
+}
+
+static void copy_state(struct ranges *o, struct state *to, struct state *from) {
+
+	to->reached = from->reached;
+	memcpy(to->r, from->r, o->nvars * sizeof(struct interval));
+	memcpy(to->facts, from->facts, from->nfacts * sizeof(struct fact));
+	to->nfacts = from->nfacts;
+}
+
+static void forget(struct state *s, int v) {
+
+	for (int i = 0; i < s->nfacts; i++) {
+		if (s->facts[i].x == v || s->facts[i].y == v) s->facts[i--] = s->facts[--s->nfacts];
+	}
+}
+
+static void learn(struct state *s, int x, int y, int strict) {
+
+	if (x < 0 || y < 0 || x == y) return;
+	for (int i = 0; i < s->nfacts; i++) {
+		if (s->facts[i].x == x && s->facts[i].y == y) {
+			s->facts[i].strict |= strict;
+			return;
+		}
+	}
+	if (s->nfacts == MAX_FACTS) return;
+	s->facts[s->nfacts].x = x;
+	s->facts[s->nfacts].y = y;
+	s->facts[s->nfacts++].strict = strict;
+}
+
+/* less - whether a < b (or a <= b, if not strict) is known in s */
+static int less(struct ranges *o, struct state *s, struct addr *a, struct addr *b, int strict) {
+
+	struct interval ra = value(o, s, a), rb = value(o, s, b);
+	int x = tracked(o, a), y = tracked(o, b);
+
+	if (strict ? ra.hi < rb.lo : ra.hi <= rb.lo) return 1;
+	if (x < 0 || y < 0) return 0;
+	if (x == y) return !strict;
+	for (int i = 0; i < s->nfacts; i++) {
+		if (s->facts[i].x == x && s->facts[i].y == y && (s->facts[i].strict || !strict)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int negate(int op) {
+
+	switch (op) {
+		case O_BLT: return O_BGE;
+		case O_BLE: return O_BGT;
+		case O_BGT: return O_BLE;
+		case O_BGE: return O_BLT;
+		case O_BEQ: return O_BNE;
+		default: return O_BEQ;
+	}
+}
+
+/* decide - 1 if the compare in always branches in s, 0 if it never does, else -1 */
+static int decide(struct ranges *o, struct state *s, struct instr *in) {
+
+	struct addr *a = &in->src1, *b = &in->src2;
+	struct interval ra, rb;
+
+	switch (in->opcode) {
+		case O_BLT:
+			return less(o, s, a, b, 1) ? 1 : less(o, s, b, a, 0) ? 0 : -1;
+		case O_BLE:
+			return less(o, s, a, b, 0) ? 1 : less(o, s, b, a, 1) ? 0 : -1;
+		case O_BGT:
+			return less(o, s, b, a, 1) ? 1 : less(o, s, a, b, 0) ? 0 : -1;
+		case O_BGE:
+			return less(o, s, b, a, 0) ? 1 : less(o, s, a, b, 1) ? 0 : -1;
+	}
+
+	/* BEQ and BNE */
+	ra = value(o, s, a);
+	rb = value(o, s, b);
+	if (less(o, s, a, b, 1) || less(o, s, b, a, 1)) return in->opcode == O_BNE;
+	if (ra.lo == ra.hi && rb.lo == rb.hi && ra.lo == rb.lo) return in->opcode == O_BEQ;
+	return -1;
+}
+
+static void narrow(struct ranges *o, struct state *s, struct addr *a, long long lo, long long hi) {
+
+	int v = tracked(o, a);
+
+	if (v < 0) return;
+	if (lo > s->r[v].lo) s->r[v].lo = lo;
+	if (hi < s->r[v].hi) s->r[v].hi = hi;
+	if (s->r[v].lo > s->r[v].hi) s->reached = 0;
+}
+
+/* refine - what s knows once a op b has come out true */
+static void refine(struct ranges *o, struct state *s, int op, struct addr *a, struct addr *b) {
+
+	struct interval ra = value(o, s, a), rb = value(o, s, b);
+
+	switch (op) {
+		case O_BGT:
+			refine(o, s, O_BLT, b, a);
+			return;
+		case O_BGE:
+			refine(o, s, O_BLE, b, a);
+			return;
+		case O_BLT:
+			narrow(o, s, a, INT_MIN, rb.hi - 1);
+			narrow(o, s, b, ra.lo + 1, INT_MAX);
+			learn(s, tracked(o, a), tracked(o, b), 1);
+			return;
+		case O_BLE:
+			narrow(o, s, a, INT_MIN, rb.hi);
+			narrow(o, s, b, ra.lo, INT_MAX);
+			learn(s, tracked(o, a), tracked(o, b), 0);
+			return;
+		case O_BEQ:
+			narrow(o, s, a, rb.lo, rb.hi);
+			narrow(o, s, b, ra.lo, ra.hi);
+			learn(s, tracked(o, a), tracked(o, b), 0);
+			learn(s, tracked(o, b), tracked(o, a), 0);
+			return;
+		case O_BNE:
+			/* only a constant at one end of the other's interval narrows it */
+			if (rb.lo == rb.hi && ra.lo == rb.lo) narrow(o, s, a, ra.lo + 1, INT_MAX);
+			if (rb.lo == rb.hi && ra.hi == rb.lo) narrow(o, s, a, INT_MIN, ra.hi - 1);
+			if (ra.lo == ra.hi && rb.lo == ra.lo) narrow(o, s, b, rb.lo + 1, INT_MAX);
+			if (ra.lo == ra.hi && rb.hi == ra.lo) narrow(o, s, b, INT_MIN, rb.hi - 1);
+			return;
+	}
+}
+
+/* arith - the interval of the result of in, from those of its operands */
+static struct interval arith(struct ranges *o, struct state *s, struct instr *in) {
+
+	struct interval a = value(o, s, &in->src1), b = value(o, s, &in->src2);
+	long long p[4], lo, hi;
+
+	switch (in->opcode) {
+		case O_ASN:
+			return a;
+		case O_ADD:
+			return make(a.lo + b.lo, a.hi + b.hi);
+		case O_SUB:
+			return make(a.lo - b.hi, a.hi - b.lo);
+		case O_NEG:
+			return make(-a.hi, -a.lo);
+		case O_MUL:
+			p[0] = a.lo * b.lo;
+			p[1] = a.lo * b.hi;
+			p[2] = a.hi * b.lo;
+			p[3] = a.hi * b.hi;
+			lo = hi = p[0];
+			for (int i = 1; i < 4; i++) {
+				if (p[i] < lo) lo = p[i];
+				if (p[i] > hi) hi = p[i];
+			}
+			return make(lo, hi);
+		case O_DIV:
+			if (b.lo != b.hi || b.lo <= 0) return top();
+			return make(a.lo / b.lo, a.hi / b.lo);
+		case O_MOD:
+			if (b.lo != b.hi || b.lo <= 0) return top();
+			if (a.lo >= 0) return make(0, a.hi < b.lo - 1 ? a.hi : b.lo - 1);
+			return make(1 - b.lo, b.lo - 1);
+	}
+	return top();
+}
+
+static void transfer(struct ranges *o, struct state *s, struct instr *in) {
+
+	struct addr *d = instr_def(in);
+	struct interval r;
+	int v, u;
+
+	if (d == NULL || (v = tracked(o, d)) < 0) return;
+
+	r = arith(o, s, in);
+	u = in->opcode == O_ASN ? tracked(o, &in->src1) : -1;
+	forget(s, v);
+	s->r[v] = r;
+
+	/* a copy knows what its source does */
+	if (u >= 0 && u != v) {
+		int n = s->nfacts;
+
+		for (int i = 0; i < n; i++) {
+			if (s->facts[i].x == u) learn(s, v, s->facts[i].y, s->facts[i].strict);
+			if (s->facts[i].y == u) learn(s, s->facts[i].x, v, s->facts[i].strict);
+		}
+	}
+}
+
+/*
+ * join - merge from, the state on the edge from pred, into the one at the
+ *  top of b; returns whether it changed
+ */
+static int join(struct ranges *o, struct block *pred, struct block *b, struct state *from) {
+
+	struct state *into = &o->in[b->id];
+	int changed = 0, widen;
+
+	if (!from->reached) return 0;
+	if (!into->reached) {
+		copy_state(o, into, from);
+		o->changes[b->id]++;
+		return 1;
+	}
+
+	widen = b->rpo <= pred->rpo && o->changes[b->id] >= WIDEN_AFTER;
+	for (int v = 0; v < o->nvars; v++) {
+		struct interval *r = &into->r[v];
+
+		if (from->r[v].lo < r->lo) {
+			r->lo = widen ? INT_MIN : from->r[v].lo;
+			changed = 1;
+		}
+		if (from->r[v].hi > r->hi) {
+			r->hi = widen ? INT_MAX : from->r[v].hi;
+			changed = 1;
+		}
+	}
+
+	/* the facts both know, as weak as the weaker says */
+	for (int i = 0; i < into->nfacts; i++) {
+		struct fact *f = &into->facts[i];
+		int j;
+
+		for (j = 0; j < from->nfacts; j++) {
+			if (from->facts[j].x == f->x && from->facts[j].y == f->y) break;
+		}
+		if (j == from->nfacts) {
+			*f = into->facts[--into->nfacts];
+			i--;
+			changed = 1;
+		} else if (f->strict && !from->facts[j].strict) {
+			f->strict = 0;
+			changed = 1;
+		}
+	}
+
+	if (changed) o->changes[b->id]++;
+	return changed;
+}
+
+/* block_out - s is what b leaves its last compare, or its end, with */
+static struct instr *block_out(struct ranges *o, struct block *b, struct state *s) {
+
+	int n = b->ncode;
+	struct instr *last = n > 0 && is_compare(b->code[n - 1]) ? b->code[n - 1] : NULL;
+
+	copy_state(o, s, &o->in[b->id]);
+	for (int j = 0; j < (last != NULL ? n - 1 : n); j++) transfer(o, s, b->code[j]);
+	return last;
+}
+
+static void analyze(struct ranges *o) {
+
+	struct cfg *g = o->g;
+	struct state cur, edge;
+	int changed = 1;
+
+	cur.r = xcalloc(o->nvars + 1, sizeof(struct interval));
+	edge.r = xcalloc(o->nvars + 1, sizeof(struct interval));
+
+	while (changed) {
+		changed = 0;
+		for (int i = 0; i < g->nrpo; i++) {
+			struct block *b = g->rpo_order[i];
+			struct instr *last;
+
+			if (!o->in[b->id].reached) continue;
+			last = block_out(o, b, &cur);
+			for (int k = 0; k < b->nsucc; k++) {
+				copy_state(o, &edge, &cur);
+				if (last != NULL && b->nsucc == 2) {
+					refine(o, &edge, k ? last->opcode : negate(last->opcode),
+						&last->src1, &last->src2);
+				}
+				changed |= join(o, b, b->succ[k], &edge);
+			}
+		}
+	}
+
+	free(cur.r);
+	free(edge.r);
+}
+
+/*
+ * range_checks - turn the compares of a procedure that range analysis
+ *  decides into a GOTO or nothing, see above. Returns how many.
+ */
+int range_checks(struct cfg *g, struct opt_stats *stats) {
+
+	struct ranges o;
+	struct state cur;
+	int decided = 0;
+
+	/* number every variable first, and leave alone a frame with its address taken */
+	for (int i = 0; i < g->nblocks; i++) {
+		for (int j = 0; j < g->blocks[i]->ncode; j++) {
+			struct instr *in = g->blocks[i]->code[j];
+			struct addr *uses[2], *d = instr_def(in);
+			int n = instr_uses(in, uses);
+
+			if (in->code_type != DECLARATION && in->opcode == O_ADDR) return 0;
+			if (d != NULL) cfg_var(g, d);
+			while (n-- > 0) cfg_var(g, uses[n]);
+		}
+	}
+
+	cfg_dominators(g);
+	memset(&o, 0, sizeof(o));
+	o.g = g;
+	o.nvars = g->nvars;
+	o.in = xcalloc(g->nblocks, sizeof(struct state));
+	o.changes = xcalloc(g->nblocks, sizeof(int));
+	for (int i = 0; i < g->nblocks; i++) o.in[i].r = xcalloc(o.nvars + 1, sizeof(struct interval));
+
+	o.in[0].reached = 1;
+	for (int v = 0; v < o.nvars; v++) o.in[0].r[v] = top();
+	analyze(&o);
+
+	cur.r = xcalloc(o.nvars + 1, sizeof(struct interval));
+	for (int i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+		struct instr *last;
+		int taken;
+
+		if (!o.in[i].reached || b->nsucc != 2) continue;
+		if ((last = block_out(&o, b, &cur)) == NULL || (taken = decide(&o, &cur, last)) < 0) {
+			continue;
+		}
+
+		if (taken) {
+			last->opcode = O_GOTO;
+			last->src1.region = R_NONE;
+			last->src2.region = R_NONE;
+			cfg_remove_edge(b, b->succ[0]);
+		} else {
+			block_remove(b, b->ncode - 1);
+			stats->removed++;
+			cfg_remove_edge(b, b->succ[1]);
+		}
+		decided++;
+	}
+
+	for (int i = 0; i < g->nblocks; i++) free(o.in[i].r);
+	free(o.in);
+	free(o.changes);
+	free(cur.r);
+
+	if (decided > 0) {
+		cfg_dominators(g);
+		stats->removed += cfg_remove_unreachable(g);
+	}
+	stats->checks += decided;
+	return decided;
+}
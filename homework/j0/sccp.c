@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * Sparse conditional constant propagation (Wegman and Zadeck), on SSA
+ * form. A value is unknown until something defines it, then a constant,
+ * then anything; it only ever moves down. Only the blocks some
+ * executable edge reaches are looked at, and a branch on a constant only
+ * makes the edge it takes executable, so a constant that is decided in
+ * one arm of an if is not spoiled by the arm that never runs.
+ *
+ * Then the uses of constant values become the constants, their defs go,
+ * branches on constants become a GOTO or nothing, and the blocks no edge
+ * reached are emptied.
+ */
+
+enum { UNKNOWN, CONSTANT, ANYTHING };
+
+struct lattice {
+	int state;
+	struct addr k;
+};
+
+struct use {
+	struct block *b;
+	struct instr *in;	/* NULL for a phi */
+	int phi;
+};
+
+struct sccp {
+	struct cfg *g;
+	struct lattice *value;		/* per SSA value */
+	struct use **uses;		/* per SSA value */
+	int *nuses, *uses_size;
+
+	char *executable;		/* per block */
+	char *edge;			/* per block, per successor */
+	struct { struct block *b; int succ; } *flow;
+	int nflow, flow_size;
+	int *ssa_work;
+	int nssa_work, ssa_work_size;
+	char *queued;
+};
+
+static void *xcalloc(size_t n, size_t size) {
+
+	void *p = calloc(n, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static void *xrealloc(void *p, size_t size) {
+
+	p = realloc(p, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static int is_int(struct addr *a) {
+	return a->region == R_CONST && a->tag == OFFSET;
+}
+
+static struct lattice operand(struct sccp *s, struct addr *a) {
+
+	struct lattice l;
+
+	if (a->region == R_SSA) return s->value[a->u.offset];
+
+	l.state = a->region == R_CONST ? CONSTANT : ANYTHING;
+	l.k = *a;
+	return l;
+}
+
+static void add_use(struct sccp *s, struct addr *a, struct block *b, struct instr *in, int phi) {
+
+	int v;
+
+	if (a->region != R_SSA) return;
+	v = a->u.offset;
+	if (s->nuses[v] == s->uses_size[v]) {
+		s->uses_size[v] = s->uses_size[v] ? 2 * s->uses_size[v] : 4;
+		s->uses[v] = xrealloc(s->uses[v], s->uses_size[v] * sizeof(struct use));
+	}
+	s->uses[v][s->nuses[v]].b = b;
+	s->uses[v][s->nuses[v]].in = in;
+	s->uses[v][s->nuses[v]].phi = phi;
+	s->nuses[v]++;
+}
+
+static void take_edge(struct sccp *s, struct block *b, int succ) {
+
+	if (s->edge[2 * b->id + succ]) return;
+	if (s->nflow == s->flow_size) {
+		s->flow_size = s->flow_size ? 2 * s->flow_size : 32;
+		s->flow = xrealloc(s->flow, s->flow_size * sizeof(*s->flow));
+	}
+	s->flow[s->nflow].b = b;
+	s->flow[s->nflow].succ = succ;
+	s->nflow++;
+}
+
+/* lower - v is l now, or lower if it already was */
+static void lower(struct sccp *s, struct addr *d, struct lattice l) {
+
+	struct lattice *old;
+
+	if (d->region != R_SSA) return;
+	old = &s->value[d->u.offset];
+
+	if (old->state == ANYTHING || l.state == UNKNOWN) return;
+	if (old->state == CONSTANT && (l.state == ANYTHING || !addr_equal(old->k, l.k))) {
+		old->state = ANYTHING;
+	} else if (old->state == UNKNOWN) {
+		*old = l;
+	} else {
+		return;
+	}
+
+	if (!s->queued[d->u.offset]) {
+		if (s->nssa_work == s->ssa_work_size) {
+			s->ssa_work_size = s->ssa_work_size ? 2 * s->ssa_work_size : 32;
+			s->ssa_work = xrealloc(s->ssa_work, s->ssa_work_size * sizeof(int));
+		}
+		s->ssa_work[s->nssa_work++] = d->u.offset;
+		s->queued[d->u.offset] = 1;
+	}
+}
+
+/* fold - the int an operation gives on ints, 0 if it has none */
+static int fold(int op, int a, int b, int *result) {
+
+	unsigned int x = (unsigned int) a, y = (unsigned int) b;
+
+	switch (op) {
+		case O_ADD: *result = (int) (x + y); return 1;
+		case O_SUB: *result = (int) (x - y); return 1;
+		case O_MUL: *result = (int) (x * y); return 1;
+		case O_NEG: *result = (int) (0u - x); return 1;
+		case O_NOT: *result = !a; return 1;
+		case O_DIV:
+		case O_MOD:
+			if (b == 0 || (a == INT_MIN && b == -1)) return 0;
+			*result = op == O_DIV ? a / b : a % b;
+			return 1;
+		case O_BLT: *result = a < b; return 1;
+		case O_BLE: *result = a <= b; return 1;
+		case O_BGT: *result = a > b; return 1;
+		case O_BGE: *result = a >= b; return 1;
+		case O_BEQ: *result = a == b; return 1;
+		case O_BNE: *result = a != b; return 1;
+		case O_BIF: *result = a != 0; return 1;
+		case O_BNIF: *result = a == 0; return 1;
+	}
+	return 0;
+}
+
+/* evaluate - what in computes, or whether a branch is taken */
+static struct lattice evaluate(struct sccp *s, struct instr *in) {
+
+	struct lattice l, a, b;
+	struct addr *uses[2];
+	int n = instr_uses(in, uses), r;
+
+	l.state = ANYTHING;
+	memset(&l.k, 0, sizeof(l.k));
+	if (n == 0) return l;
+
+	if (in->opcode == O_ASN) return operand(s, uses[0]);
+	if (in->opcode == O_LCONT || in->opcode == O_SCONT) return l;
+
+	a = operand(s, uses[0]);
+	b = n > 1 ? operand(s, uses[1]) : a;
+	if (a.state == ANYTHING || b.state == ANYTHING) return l;
+	if (a.state == UNKNOWN || b.state == UNKNOWN) {
+		l.state = UNKNOWN;
+		return l;
+	}
+
+	if (is_int(&a.k) && is_int(&b.k) &&
+		fold(in->opcode, a.k.u.offset, b.k.u.offset, &r)) {
+		l.state = CONSTANT;
+		l.k.region = R_CONST;
+		l.k.tag = OFFSET;
+		l.k.u.offset = r;
+	}
+	return l;
+}
+
+static void visit_phi(struct sccp *s, struct block *b, int i) {
+
+	struct phi *p = &b->phis[i];
+
+	for (int j = 0; j < b->npred; j++) {
+		struct block *pred = b->pred[j];
+		int k;
+
+		for (k = 0; k < pred->nsucc && pred->succ[k] != b; k++);
+		if (s->edge[2 * pred->id + k]) lower(s, &p->dest, operand(s, &p->args[j]));
+	}
+}
+
+static void visit_instr(struct sccp *s, struct block *b, struct instr *in) {
+
+	struct addr *d;
+
+	if (in->code_type == DECLARATION) return;
+
+	if (in->opcode == O_GOTO) {
+		for (int k = 0; k < b->nsucc; k++) take_edge(s, b, k);
+	} else if (in->opcode >= O_BLT && in->opcode <= O_BNIF) {
+		struct lattice l = evaluate(s, in);
+
+		if (l.state == UNKNOWN) return;
+		if (l.state == ANYTHING || b->nsucc < 2) {
+			for (int k = 0; k < b->nsucc; k++) take_edge(s, b, k);
+		} else {
+			take_edge(s, b, l.k.u.offset ? 1 : 0);
+		}
+	} else if ((d = instr_def(in)) != NULL) {
+		lower(s, d, has_side_effects(in) && in->opcode != O_DIV && in->opcode != O_MOD ?
+			(struct lattice) {ANYTHING} : evaluate(s, in));
+	}
+}
+
+static void visit_block(struct sccp *s, struct block *b) {
+
+	for (int j = 0; j < b->ncode; j++) visit_instr(s, b, b->code[j]);
+	if (b->ncode == 0 || !is_branch(b->code[b->ncode - 1])) {
+		for (int k = 0; k < b->nsucc; k++) take_edge(s, b, k);
+	}
+}
+
+static void propagate(struct sccp *s) {
+
+	while (s->nflow > 0 || s->nssa_work > 0) {
+		while (s->nflow > 0) {
+			struct block *b = s->flow[--s->nflow].b, *to;
+			int k = s->flow[s->nflow].succ;
+
+			if (s->edge[2 * b->id + k]) continue;
+			s->edge[2 * b->id + k] = 1;
+			to = b->succ[k];
+
+			for (int i = 0; i < to->nphis; i++) visit_phi(s, to, i);
+			if (!s->executable[to->id]) {
+				s->executable[to->id] = 1;
+				visit_block(s, to);
+			}
+		}
+		while (s->nssa_work > 0) {
+			int v = s->ssa_work[--s->nssa_work];
+
+			s->queued[v] = 0;
+			for (int i = 0; i < s->nuses[v]; i++) {
+				struct use *u = &s->uses[v][i];
+
+				if (!s->executable[u->b->id]) continue;
+				if (u->in == NULL) {
+					visit_phi(s, u->b, u->phi);
+				} else {
+					visit_instr(s, u->b, u->in);
+				}
+			}
+		}
+	}
+}
+
+/* replace - the constant for a, if a is a value found to be one */
+static int replace(struct sccp *s, struct addr *a) {
+
+	if (a->region != R_SSA || s->value[a->u.offset].state != CONSTANT) return 0;
+	*a = s->value[a->u.offset].k;
+	return 1;
+}
+
+/* branches_to_next - in branches to the label the block after b starts with */
+static int branches_to_next(struct cfg *g, struct block *b, struct instr *in) {
+
+	struct block *next = b->id + 1 < g->nblocks ? g->blocks[b->id + 1] : NULL;
+
+	return next != NULL && next->ncode > 0 && next->code[0]->opcode == D_LABEL &&
+		next->code[0]->dest.u.offset == in->dest.u.offset;
+}
+
+static void rewrite(struct sccp *s, struct opt_stats *stats) {
+
+	struct cfg *g = s->g;
+	int i, j, k;
+
+	for (i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		if (!s->executable[b->id]) continue;
+
+		for (j = 0; j < b->nphis; j++) {
+			if (b->phis[j].dest.region == R_SSA &&
+				s->value[b->phis[j].dest.u.offset].state == CONSTANT) {
+				free(b->phis[j].args);
+				b->phis[j--] = b->phis[--b->nphis];
+				continue;
+			}
+			for (k = 0; k < b->npred; k++) stats->constants += replace(s, &b->phis[j].args[k]);
+		}
+
+		for (j = 0; j < b->ncode; j++) {
+			struct instr *in = b->code[j];
+			struct addr *uses[2], *d = instr_def(in);
+			int n = instr_uses(in, uses);
+			struct lattice l;
+
+			for (k = 0; k < n; k++) stats->constants += replace(s, uses[k]);
+
+			if (d != NULL && d->region == R_SSA &&
+				s->value[d->u.offset].state == CONSTANT) {
+				block_remove(b, j--);
+				stats->removed++;
+				continue;
+			}
+
+			if (in->code_type == DECLARATION || in->opcode < O_BLT ||
+				in->opcode > O_BNIF) continue;
+			l = evaluate(s, in);
+			if (l.state != CONSTANT) continue;
+
+			if (b->nsucc < 2) {
+				/* taken or not, it goes on to the next block */
+				if (!branches_to_next(g, b, in)) continue;
+				block_remove(b, j--);
+				stats->removed++;
+			} else if (l.k.u.offset) {
+				in->opcode = O_GOTO;
+				in->src1.region = R_NONE;
+				in->src2.region = R_NONE;
+				cfg_remove_edge(b, b->succ[0]);
+			} else {
+				block_remove(b, j--);
+				stats->removed++;
+				cfg_remove_edge(b, b->succ[1]);
+			}
+			stats->branches++;
+		}
+	}
+}
+
+/* sccp - propagate the constants of a procedure in SSA form */
+void sccp(struct cfg *g, struct opt_stats *stats) {
+
+	struct sccp s;
+	int i, j, k, n;
+
+	memset(&s, 0, sizeof(s));
+	s.g = g;
+	s.value = xcalloc(g->nssa + 1, sizeof(struct lattice));
+	s.uses = xcalloc(g->nssa + 1, sizeof(struct use *));
+	s.nuses = xcalloc(g->nssa + 1, sizeof(int));
+	s.uses_size = xcalloc(g->nssa + 1, sizeof(int));
+	s.queued = xcalloc(g->nssa + 1, 1);
+	s.executable = xcalloc(g->nblocks, 1);
+	s.edge = xcalloc(2 * g->nblocks, 1);
+
+	for (i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		for (j = 0; j < b->nphis; j++) {
+			for (k = 0; k < b->npred; k++) add_use(&s, &b->phis[j].args[k], b, NULL, j);
+		}
+		for (j = 0; j < b->ncode; j++) {
+			struct addr *uses[2];
+
+			n = instr_uses(b->code[j], uses);
+			for (k = 0; k < n; k++) add_use(&s, uses[k], b, b->code[j], 0);
+		}
+	}
+
+	s.executable[g->blocks[0]->id] = 1;
+	visit_block(&s, g->blocks[0]);
+	propagate(&s);
+
+	rewrite(&s, stats);
+	cfg_dominators(g);
+	stats->removed += cfg_remove_unreachable(g);
+
+	for (i = 0; i <= g->nssa; i++) free(s.uses[i]);
+	free(s.value);
+	free(s.uses);
+	free(s.nuses);
+	free(s.uses_size);
+	free(s.queued);
+	free(s.executable);
+	free(s.edge);
+	free(s.flow);
+	free(s.ssa_work);
+}
@@ -0,0 +1,154 @@
+#include <string.h>
+
+#include "scopeview.h"
+#include "symboltable.h"
+
+/*
+ * The trie takes 5 bits of a name's hash per level. A node only has the
+ * slots in use, in order; bitmap says which of the 32 those are, and a
+ * slot's index is the number of bits set below its own. A slot holds a
+ * subtrie or a leaf. Names with the same hash share a leaf list, newest
+ * first, which is also how a name declared in an inner scope shadows
+ * the same name outside it.
+ *
+ * Nothing is ever changed in place. An insert copies the nodes on the
+ * way down to the new leaf and returns the new root, so the view a
+ * scope had when it was entered is still its parent's view.
+ */
+
+#define VIEW_BITS 5
+#define VIEW_MASK ((1 << VIEW_BITS) - 1)
+
+struct view_leaf {
+	unsigned int hash;
+	struct sym_entry *entry;
+	const struct view_leaf *next;	/* same hash, declared before */
+};
+
+struct view_slot {
+	const struct view_node *node;	/* a subtrie, or NULL for a leaf */
+	const struct view_leaf *leaf;
+};
+
+struct view_node {
+	uint32_t bitmap;
+	struct view_slot slot[];
+};
+
+char *checked_alloc(int size);
+
+/*
+ * hash_name - hash a name for the symbol tables and the views. Done in
+ *  unsigned arithmetic, signed overflow is undefined.
+ */
+unsigned int hash_name(char *s) {
+
+	unsigned int h = 0;
+	unsigned char c;
+
+	while ((c = *s++)) {
+		h += c;
+		h *= 37;
+	}
+
+	return h;
+}
+
+static int slot_index(uint32_t bitmap, uint32_t bit) {
+	return __builtin_popcount(bitmap & (bit - 1));
+}
+
+/* copy_node - a copy of v with room for extra more slots */
+static struct view_node *copy_node(const struct view_node *v, int extra) {
+
+	int n = v ? __builtin_popcount(v->bitmap) : 0;
+	struct view_node *copy = (struct view_node *) checked_alloc(
+		sizeof(struct view_node) + (n + extra) * sizeof(struct view_slot));
+
+	if (v != NULL) {
+		copy->bitmap = v->bitmap;
+		memcpy(copy->slot, v->slot, n * sizeof(struct view_slot));
+	}
+	return copy;
+}
+
+static const struct view_node *insert_at(const struct view_node *v,
+	const struct view_leaf *leaf, int shift) {
+
+	uint32_t bit = 1u << ((leaf->hash >> shift) & VIEW_MASK);
+	int i = v ? slot_index(v->bitmap, bit) : 0;
+	struct view_node *copy;
+
+	/* a free slot: the leaf goes here */
+	if (v == NULL || !(v->bitmap & bit)) {
+		int n = v ? __builtin_popcount(v->bitmap) : 0;
+
+		copy = copy_node(v, 1);
+		memmove(&copy->slot[i + 1], &copy->slot[i], (n - i) * sizeof(struct view_slot));
+		copy->bitmap |= bit;
+		copy->slot[i].node = NULL;
+		copy->slot[i].leaf = leaf;
+		return copy;
+	}
+
+	copy = copy_node(v, 0);
+
+	if (v->slot[i].node != NULL) {
+		copy->slot[i].node = insert_at(v->slot[i].node, leaf, shift + VIEW_BITS);
+	} else if (v->slot[i].leaf->hash == leaf->hash) {
+		struct view_leaf *l = (struct view_leaf *) checked_alloc(sizeof(struct view_leaf));
+
+		*l = *leaf;
+		l->next = v->slot[i].leaf;
+		copy->slot[i].leaf = l;
+	} else {
+		/*
+		 * Two hashes that agree this far. They differ in some later
+		 * bits, so pushing both down a level ends before the hash does.
+		 */
+		copy->slot[i].node = insert_at(insert_at(NULL, v->slot[i].leaf,
+			shift + VIEW_BITS), leaf, shift + VIEW_BITS);
+		copy->slot[i].leaf = NULL;
+	}
+
+	return copy;
+}
+
+/* view_insert - v with e's name resolving to e */
+const struct view_node *view_insert(const struct view_node *v, struct sym_entry *e) {
+
+	struct view_leaf *leaf = (struct view_leaf *) checked_alloc(sizeof(struct view_leaf));
+
+	leaf->hash = hash_name(e->s);
+	leaf->entry = e;
+	leaf->next = NULL;
+
+	return insert_at(v, leaf, 0);
+}
+
+/* view_lookup - what s resolves to in v, NULL if it is not visible */
+struct sym_entry *view_lookup(const struct view_node *v, char *s) {
+
+	unsigned int h = hash_name(s);
+	const struct view_leaf *l;
+	int shift;
+
+	for (shift = 0; v != NULL; shift += VIEW_BITS) {
+		uint32_t bit = 1u << ((h >> shift) & VIEW_MASK);
+		const struct view_slot *slot;
+
+		if (!(v->bitmap & bit)) return NULL;
+
+		slot = &v->slot[slot_index(v->bitmap, bit)];
+		if (slot->node == NULL) {
+			if (slot->leaf->hash != h) return NULL;
+			for (l = slot->leaf; l != NULL; l = l->next) {
+				if (strcmp(l->entry->s, s) == 0) return l->entry;
+			}
+			return NULL;
+		}
+		v = slot->node;
+	}
+
+	return NULL;
+}
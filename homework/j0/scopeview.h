@@ -0,0 +1,22 @@
+#ifndef SCOPEVIEW_H
+#define SCOPEVIEW_H
+
+#include <stdint.h>
+
+/*
+ * A scope view maps every name visible from a scope, its own and those
+ * of the scopes around it, to the entry the name resolves to there. It
+ * is a persistent hash array mapped trie: inserting returns a new view
+ * and leaves the old one as it was, sharing all but the path to the new
+ * name. A scope starts out with its parent's view, so a name is found
+ * in one probe instead of one hash per enclosing scope. See scopeview.c.
+ */
+
+struct sym_entry;
+struct view_node;
+
+unsigned int hash_name(char *s);
+const struct view_node *view_insert(const struct view_node *v, struct sym_entry *e);
+struct sym_entry *view_lookup(const struct view_node *v, char *s);
+
+#endif
@@ -0,0 +1,340 @@
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "symboltable.h"
+#include "server.h"
+#include "frame.h"
+
+/*
+ * j0 --server keeps a warm compiler resident on a Unix domain socket.
+ *
+ * The server loads the builtins into the global scope once, then forks
+ * a child per connection that reads the request and does the compile.
+ * The child starts from the server's memory image, so the builtin
+ * classes, their symbol tables and the canonical types are already
+ * built. Everything else the compiler keeps in globals (the tree, labels,
+ * the string list, diagnostics) is still untouched in the server, so
+ * each child starts as clean as a fresh j0 and exits when it is done,
+ * exactly as a j0 run does. The response goes out from an on_exit()
+ * hook, or from a signal handler if the compile crashes.
+ *
+ * A request is a cwd, the j0 command line and optionally the source
+ * text; the response is what j0 would have printed, the .icn it wrote
+ * and its exit code. See frame.h for the wire format and j0client.c for
+ * the other end.
+ */
+
+struct request {
+	char *cwd;
+	int argc;
+	char **argv;
+	char *source;		/* NULL: read the file named on the command line */
+	size_t source_len;
+};
+
+static char *socket_path;
+static pid_t server_pid;
+
+/* what the compile child answers with once it is done */
+static int client;
+static FILE *out, *err;
+static char icn_tmp[] = "/tmp/j0-icn-XXXXXX";
+
+static void stop_server(int sig) {
+
+	if (getpid() == server_pid) {
+		unlink(socket_path);
+	}
+	_exit(0);
+}
+
+/*
+ * read_request - collect request frames up to FRAME_END. argv[0] is
+ * filled in so the command line looks like one j0 was started with.
+ */
+static int read_request(int conn, struct request *req) {
+
+	char tag;
+	char *data;
+	uint32_t len;
+	int size = 8;
+
+	memset(req, 0, sizeof(struct request));
+	req->argv = malloc(size * sizeof(char *));
+	req->argv[req->argc++] = "j0";
+
+	for (;;) {
+		if (read_frame(conn, &tag, &data, &len) < 0) {
+			return -1;
+		}
+
+		switch (tag) {
+			case FRAME_CWD:
+				req->cwd = data;
+				break;
+			case FRAME_ARG:
+				if (req->argc + 1 == size) {
+					size *= 2;
+					req->argv = realloc(req->argv, size * sizeof(char *));
+				}
+				req->argv[req->argc++] = data;
+				break;
+			case FRAME_SOURCE:
+				req->source = data;
+				req->source_len = len;
+				break;
+			case FRAME_END:
+				free(data);
+				req->argv[req->argc] = NULL;
+				return 0;
+			default:
+				free(data);
+				return -1;
+		}
+	}
+}
+
+/* put_file - add everything written to f to the response as one frame */
+static int put_file(FILE *response, char tag, FILE *f) {
+
+	long len;
+	char *buf;
+	int rv;
+
+	fflush(f);
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	rewind(f);
+
+	buf = malloc(len + 1);
+	if (buf == NULL || fread(buf, 1, len, f) != (size_t) len) {
+		free(buf);
+		return -1;
+	}
+
+	rv = put_frame(response, tag, buf, len);
+	free(buf);
+	return rv;
+}
+
+/*
+ * put_icn_files - add each file the compile left in dir to the response
+ * as name, NUL, contents, removing them (and dir) as they go.
+ */
+static int put_icn_files(FILE *response, char *dir) {
+
+	DIR *d = opendir(dir);
+	struct dirent *e;
+	char path[4096];
+	int rv = 0;
+
+	if (d == NULL) return -1;
+
+	while ((e = readdir(d)) != NULL) {
+		if (e->d_name[0] == '.') continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+		FILE *f = fopen(path, "r");
+		if (f == NULL) continue;
+
+		fseek(f, 0, SEEK_END);
+		long len = ftell(f);
+		rewind(f);
+
+		size_t namelen = strlen(e->d_name) + 1;
+		char *buf = malloc(namelen + len);
+		memcpy(buf, e->d_name, namelen);
+		if (fread(buf + namelen, 1, len, f) == (size_t) len) {
+			rv |= put_frame(response, FRAME_ICN, buf, namelen + len);
+		}
+
+		free(buf);
+		fclose(f);
+		unlink(path);
+	}
+
+	closedir(d);
+	rmdir(dir);
+	return rv;
+}
+
+/*
+ * send_raw - copy what was written to fd into one frame using nothing
+ * but system calls, so it is safe in a handler for a crashed compile.
+ */
+static void send_raw(char tag, int fd) {
+
+	char buf[4096];
+	off_t len = lseek(fd, 0, SEEK_END);
+	uint32_t nlen = htonl((uint32_t) len);
+	ssize_t n;
+
+	buf[0] = tag;
+	memcpy(buf + 1, &nlen, 4);
+	write_all(client, buf, 5);
+
+	lseek(fd, 0, SEEK_SET);
+	while (len > 0 && (n = read(fd, buf, sizeof(buf))) > 0) {
+		write_all(client, buf, n);
+		len -= n;
+	}
+}
+
+/* compile_crashed - report what a crashed j0 would have: its output and 128+sig */
+static void compile_crashed(int sig) {
+
+	char code[4] = { '1', '0' + (128 + sig) / 10 % 10, '0' + (128 + sig) % 10, 0 };
+	uint32_t nlen = htonl(3);
+	char header[5];
+
+	send_raw(FRAME_STDOUT, 1);
+	send_raw(FRAME_STDERR, 2);
+
+	header[0] = FRAME_EXIT;
+	memcpy(header + 1, &nlen, 4);
+	write_all(client, header, 5);
+	write_all(client, code, 3);
+	rmdir(icn_tmp);
+	_exit(128 + sig);
+}
+
+/* compile_done - on_exit() hook, sends the whole response in one write */
+static void compile_done(int status, void *arg) {
+
+	char code[16], *buf;
+	size_t len;
+	FILE *response;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	response = open_memstream(&buf, &len);
+	put_file(response, FRAME_STDOUT, out);
+	put_file(response, FRAME_STDERR, err);
+	put_icn_files(response, icn_tmp);
+
+	snprintf(code, sizeof(code), "%d", status & 0377);
+	put_frame(response, FRAME_EXIT, code, strlen(code));
+	fclose(response);
+
+	write_all(client, buf, len);
+}
+
+static void handle_connection(int conn) {
+
+	struct request req;
+	static int fatal[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+	int i;
+
+	if (read_request(conn, &req) < 0) {
+		return;
+	}
+
+	if (mkdtemp(icn_tmp) == NULL || (out = tmpfile()) == NULL ||
+		(err = tmpfile()) == NULL) {
+		perror("j0 server");
+		return;
+	}
+
+	client = conn;
+	fflush(stdout);
+	dup2(fileno(out), 1);
+	dup2(fileno(err), 2);
+	/* as on a terminal, so a crash doesn't lose what was printed */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	on_exit(compile_done, NULL);
+	for (i = 0; i < sizeof(fatal) / sizeof(fatal[0]); i++) {
+		signal(fatal[i], compile_crashed);
+	}
+
+	if (req.cwd != NULL && chdir(req.cwd) < 0) {
+		fprintf(stderr, "\nerror: can not change to '%s'\n\n", req.cwd);
+		exit(-1);
+	}
+
+	icn_dir = icn_tmp;
+	source_text = req.source;
+	source_len = req.source_len;
+
+	exit(run_compiler(req.argc, req.argv));
+}
+
+int run_server(char *path) {
+
+	struct sockaddr_un addr;
+	int listener, conn;
+	mode_t mask;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		throw_error("socket path too long");
+	}
+
+	/* the state every compile shares */
+	init_globals();
+
+	if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("j0 server: socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	/* only its user can connect to the socket, see also peer_is_owner() */
+	mask = umask(0077);
+	if (bind(listener, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("j0 server: bind");
+		umask(mask);
+		return -1;
+	}
+	umask(mask);
+	if (listen(listener, 64) < 0) {
+		perror("j0 server: listen");
+		return -1;
+	}
+
+	socket_path = path;
+	server_pid = getpid();
+	signal(SIGINT, stop_server);
+	signal(SIGTERM, stop_server);
+	signal(SIGCHLD, SIG_IGN);	/* compiles are reaped automatically */
+
+	printf("j0 server listening on %s\n", path);
+	fflush(stdout);
+
+	for (;;) {
+		if ((conn = accept(listener, NULL, NULL)) < 0) {
+			if (errno == EINTR) continue;
+			perror("j0 server: accept");
+			break;
+		}
+		if (!peer_is_owner(conn)) {
+			fprintf(stderr, "j0 server: refused a connection from another user\n");
+			close(conn);
+			continue;
+		}
+
+		if (fork() == 0) {
+			close(listener);
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			signal(SIGCHLD, SIG_DFL);
+			handle_connection(conn);
+			_exit(0);
+		}
+
+		close(conn);
+	}
+
+	unlink(path);
+	return -1;
+}
@@ -0,0 +1,14 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+
+int run_server(char *socket_path);
+int run_compiler(int argc, char *argv[]);
+
+/* hooks in jmain.c that a compile child sets before run_compiler() */
+extern char *icn_dir;		/* write .icn files here instead of the cwd */
+extern char *source_text;	/* compile this instead of reading the file */
+extern size_t source_len;
+
+#endif
@@ -0,0 +1,502 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * SSA form for the optimizer. to_ssa() gives every def of a private
+ * variable a new R_SSA value, and merges the values that reach a block
+ * from its predecessors with phis, placed on the iterated dominance
+ * frontier of the defs and only where the variable is live (pruned SSA).
+ * A read with no def before it reads the variable itself, which is how a
+ * parameter's value comes in.
+ *
+ * from_ssa() turns the phis back into copies and gives the values frame
+ * slots again. A phi d = phi(a1, ..., an) becomes a new name w, a copy
+ * w = ai at the end of each predecessor and d = w at the top of the
+ * block (Sreedhar's method I, which needs no edge splitting). Then the
+ * names that do not interfere are coalesced: the ends of a copy first,
+ * so the copy goes away, then each value with the variable it came from,
+ * so most of them end up in the slot they had to begin with. A class
+ * left with no slot of its own gets a new one.
+ */
+
+static void *xcalloc(size_t n, size_t size) {
+
+	void *p = calloc(n, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+static void *xrealloc(void *p, size_t size) {
+
+	p = realloc(p, size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+	return p;
+}
+
+/* new_value - a new SSA value renaming the variable at var */
+static struct addr new_value(struct cfg *g, struct addr var) {
+
+	struct addr a;
+
+	if (g->nssa == g->ssa_size) {
+		g->ssa_size = g->ssa_size ? 2 * g->ssa_size : 64;
+		g->ssa_var = xrealloc(g->ssa_var, g->ssa_size * sizeof(struct addr));
+	}
+	g->ssa_var[g->nssa] = var;
+
+	memset(&a, 0, sizeof(a));
+	a.region = R_SSA;
+	a.tag = OFFSET;
+	a.u.offset = g->nssa++;
+	return a;
+}
+
+static void add_frontier(struct block *b, struct block *f) {
+
+	for (int i = 0; i < b->nfrontier; i++) {
+		if (b->frontier[i] == f) return;
+	}
+	b->frontier = xrealloc(b->frontier, (b->nfrontier + 1) * sizeof(struct block *));
+	b->frontier[b->nfrontier++] = f;
+}
+
+/* the dominance frontiers, as Cooper, Harvey and Kennedy find them */
+static void frontiers(struct cfg *g) {
+
+	for (int i = 0; i < g->nblocks; i++) g->blocks[i]->nfrontier = 0;
+
+	for (int i = 0; i < g->nrpo; i++) {
+		struct block *b = g->rpo_order[i];
+
+		if (b->npred < 2) continue;
+		for (int j = 0; j < b->npred; j++) {
+			struct block *runner = b->pred[j];
+
+			while (runner != NULL && runner != b->idom) {
+				add_frontier(runner, b);
+				runner = runner->idom;
+			}
+		}
+	}
+}
+
+static void add_phi(struct block *b, struct cfg *g, int v) {
+
+	struct phi *p;
+
+	if (b->nphis == b->phis_size) {
+		b->phis_size = b->phis_size ? 2 * b->phis_size : 4;
+		b->phis = xrealloc(b->phis, b->phis_size * sizeof(struct phi));
+	}
+	p = &b->phis[b->nphis++];
+	p->dest = g->vars[v].a;
+	p->args = xcalloc(b->npred > 0 ? b->npred : 1, sizeof(struct addr));
+	p->var = v;
+}
+
+static void place_phis(struct cfg *g, int nvars) {
+
+	struct block **work = xcalloc(g->nblocks + 1, sizeof(struct block *));
+	int *has_phi = xcalloc(g->nblocks, sizeof(int));
+	int *queued = xcalloc(g->nblocks, sizeof(int));
+	int v, i, j, top;
+
+	for (v = 0; v < nvars; v++) {
+		if (!g->vars[v].private || g->vars[v].ndefs == 0) continue;
+
+		top = 0;
+		for (i = 0; i < g->nblocks; i++) {
+			struct block *b = g->blocks[i];
+
+			for (j = 0; j < b->ncode; j++) {
+				struct addr *d = instr_def(b->code[j]);
+
+				if (d != NULL && cfg_var(g, d) == v) {
+					queued[b->id] = v + 1;
+					work[top++] = b;
+					break;
+				}
+			}
+		}
+
+		while (top > 0) {
+			struct block *b = work[--top];
+
+			for (i = 0; i < b->nfrontier; i++) {
+				struct block *f = b->frontier[i];
+
+				if (has_phi[f->id] == v + 1 || !live_test(f->live_in, v)) continue;
+				add_phi(f, g, v);
+				has_phi[f->id] = v + 1;
+				if (queued[f->id] != v + 1) {
+					queued[f->id] = v + 1;
+					work[top++] = f;
+				}
+			}
+		}
+	}
+
+	free(work);
+	free(has_phi);
+	free(queued);
+}
+
+struct rename {
+	struct cfg *g;
+	int nvars;
+	struct addr *cur;	/* the current value of each variable */
+	char *has;		/* whether it has one yet */
+	struct undo { int var; struct addr old; char had; } *log;
+	int nlog, log_size;
+};
+
+static void define(struct rename *r, int v, struct addr *d) {
+
+	if (r->nlog == r->log_size) {
+		r->log_size = r->log_size ? 2 * r->log_size : 64;
+		r->log = xrealloc(r->log, r->log_size * sizeof(struct undo));
+	}
+	r->log[r->nlog].var = v;
+	r->log[r->nlog].old = r->cur[v];
+	r->log[r->nlog].had = r->has[v];
+	r->nlog++;
+
+	r->cur[v] = new_value(r->g, r->g->vars[v].a);
+	r->has[v] = 1;
+	*d = r->cur[v];
+}
+
+static void rename_block(struct rename *r, struct block *b) {
+
+	struct cfg *g = r->g;
+	int i, j, k, v;
+
+	for (i = 0; i < b->nphis; i++) define(r, b->phis[i].var, &b->phis[i].dest);
+
+	for (j = 0; j < b->ncode; j++) {
+		struct instr *in = b->code[j];
+		struct addr *uses[2], *d;
+		int n = instr_uses(in, uses);
+
+		for (k = 0; k < n; k++) {
+			v = cfg_var(g, uses[k]);
+			if (v >= 0 && v < r->nvars && r->has[v]) *uses[k] = r->cur[v];
+		}
+		if ((d = instr_def(in)) != NULL && (v = cfg_var(g, d)) >= 0 &&
+			v < r->nvars && g->vars[v].private) {
+			define(r, v, d);
+		}
+	}
+
+	for (i = 0; i < b->nsucc; i++) {
+		struct block *s = b->succ[i];
+
+		for (j = 0; j < s->npred && s->pred[j] != b; j++);
+		for (k = 0; k < s->nphis; k++) {
+			v = s->phis[k].var;
+			s->phis[k].args[j] = r->has[v] ? r->cur[v] : g->vars[v].a;
+		}
+	}
+}
+
+static void unrename(struct rename *r, int mark) {
+
+	while (r->nlog > mark) {
+		struct undo *u = &r->log[--r->nlog];
+
+		r->cur[u->var] = u->old;
+		r->has[u->var] = u->had;
+	}
+}
+
+/*
+ * to_ssa - put the procedure in SSA form. Unreachable blocks are emptied
+ *  first, they have nowhere to get their values from.
+ */
+void to_ssa(struct cfg *g, struct opt_stats *stats) {
+
+	struct rename r;
+	struct block **stack;
+	int *next_kid, *mark, top = 0;
+
+	cfg_dominators(g);
+	stats->removed += cfg_remove_unreachable(g);
+	cfg_liveness(g);
+	frontiers(g);
+	place_phis(g, g->nvars);
+
+	memset(&r, 0, sizeof(r));
+	r.g = g;
+	r.nvars = g->nvars;
+	r.cur = xcalloc(g->nvars + 1, sizeof(struct addr));
+	r.has = xcalloc(g->nvars + 1, 1);
+	stack = xcalloc(g->nblocks + 1, sizeof(struct block *));
+	next_kid = xcalloc(g->nblocks, sizeof(int));
+	mark = xcalloc(g->nblocks, sizeof(int));
+
+	/* down the dominator tree, each block sees the values of its dominators */
+	stack[top++] = g->rpo_order[0];
+	rename_block(&r, g->rpo_order[0]);
+	while (top > 0) {
+		struct block *b = stack[top - 1];
+
+		if (next_kid[b->id] < b->ndom_kids) {
+			struct block *k = b->dom_kids[next_kid[b->id]++];
+
+			mark[k->id] = r.nlog;
+			rename_block(&r, k);
+			stack[top++] = k;
+		} else {
+			unrename(&r, mark[b->id]);
+			top--;
+		}
+	}
+
+	free(r.cur);
+	free(r.has);
+	free(r.log);
+	free(stack);
+	free(next_kid);
+	free(mark);
+}
+
+/* replace each phi by copies, its web of values named by one new value */
+static void lower_phis(struct cfg *g) {
+
+	struct addr none;
+
+	memset(&none, 0, sizeof(none));
+	none.region = R_NONE;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		for (int j = b->nphis - 1; j >= 0; j--) {
+			struct phi *p = &b->phis[j];
+			struct addr w = new_value(g, g->ssa_var[p->dest.u.offset]);
+
+			for (int k = 0; k < b->npred; k++) {
+				struct block *pred = b->pred[k];
+
+				block_insert(pred, block_end(pred), gen(O_ASN, w, p->args[k], none));
+			}
+			block_insert(b, block_start(b), gen(O_ASN, p->dest, w, none));
+			free(p->args);
+		}
+		b->nphis = 0;
+	}
+}
+
+struct coalesce {
+	int n, words;
+	int *parent;
+	int *pinned;		/* per class: the variable live on entry it has, or -1 */
+	unsigned long *adj;	/* per class: the variables it interferes with */
+	unsigned long *members;	/* per class: its variables */
+};
+
+#define ROW(m, c, i) ((m) + (size_t) (i) * (c)->words)
+#define BIT_SET(set, v) ((set)[(v) / (8 * sizeof(long))] |= 1UL << ((v) % (8 * sizeof(long))))
+
+static int find(struct coalesce *c, int v) {
+
+	while (c->parent[v] != v) {
+		c->parent[v] = c->parent[c->parent[v]];
+		v = c->parent[v];
+	}
+	return v;
+}
+
+static void interfere(struct coalesce *c, int a, int b) {
+
+	if (a == b) return;
+	BIT_SET(ROW(c->adj, c, a), b);
+	BIT_SET(ROW(c->adj, c, b), a);
+}
+
+/*
+ * try_merge - put a and b in one class if nothing in one interferes with
+ *  the other, and they are not each pinned to a slot of their own
+ */
+static int try_merge(struct coalesce *c, int a, int b) {
+
+	unsigned long *adj, *mem;
+	int w;
+
+	a = find(c, a);
+	b = find(c, b);
+	if (a == b) return 1;
+	if (c->pinned[a] >= 0 && c->pinned[b] >= 0) return 0;
+
+	adj = ROW(c->adj, c, a);
+	mem = ROW(c->members, c, b);
+	for (w = 0; w < c->words; w++) {
+		if (adj[w] & mem[w]) return 0;
+	}
+
+	c->parent[b] = a;
+	if (c->pinned[a] < 0) c->pinned[a] = c->pinned[b];
+	for (w = 0; w < c->words; w++) {
+		adj[w] |= ROW(c->adj, c, b)[w];
+		ROW(c->members, c, a)[w] |= mem[w];
+	}
+	return 1;
+}
+
+/* the interference graph of the private variables, from their liveness */
+static void build_interference(struct cfg *g, struct coalesce *c) {
+
+	unsigned long *live = xcalloc(c->words, sizeof(long));
+	struct block *entry = g->blocks[0];
+	int i, j, k, v, w;
+
+	for (i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		memcpy(live, b->live_out, c->words * sizeof(long));
+		for (j = b->ncode - 1; j >= 0; j--) {
+			struct instr *in = b->code[j];
+			struct addr *uses[2], *d = instr_def(in);
+			int n = instr_uses(in, uses), copied = -1;
+
+			if (in->opcode == O_ASN) copied = cfg_var(g, &in->src1);
+
+			if (d != NULL && (v = cfg_var(g, d)) >= 0 && g->vars[v].private) {
+				/* a copy's two ends hold the same value, they may share a slot */
+				for (w = 0; w < g->nvars; w++) {
+					if (live_test(live, w) && w != copied) interfere(c, v, w);
+				}
+				live[v / (8 * sizeof(long))] &= ~(1UL << (v % (8 * sizeof(long))));
+			}
+			for (k = 0; k < n; k++) {
+				if ((v = cfg_var(g, uses[k])) >= 0 && g->vars[v].private) BIT_SET(live, v);
+			}
+		}
+	}
+
+	/* what is live on entry, the parameters, all arrives at once */
+	for (v = 0; v < g->nvars; v++) {
+		if (!live_test(entry->live_in, v)) continue;
+		for (w = v + 1; w < g->nvars; w++) {
+			if (live_test(entry->live_in, w)) interfere(c, v, w);
+		}
+	}
+
+	free(live);
+}
+
+/* from_ssa - out of SSA form, every value back in a frame slot */
+void from_ssa(struct cfg *g, struct opt_stats *stats) {
+
+	struct coalesce c;
+	struct addr *slot;
+	int i, j, k, v, nssa;
+
+	lower_phis(g);
+
+	/* number the variables the values came from, so coalescing can find them */
+	nssa = g->nssa;
+	for (i = 0; i < nssa; i++) cfg_var(g, &g->ssa_var[i]);
+	cfg_liveness(g);
+
+	memset(&c, 0, sizeof(c));
+	c.n = g->nvars;
+	c.words = g->live_words;
+	c.parent = xcalloc(c.n, sizeof(int));
+	c.pinned = xcalloc(c.n, sizeof(int));
+	c.adj = xcalloc((size_t) c.n * c.words, sizeof(long));
+	c.members = xcalloc((size_t) c.n * c.words, sizeof(long));
+	for (v = 0; v < c.n; v++) {
+		c.parent[v] = v;
+		BIT_SET(ROW(c.members, &c, v), v);
+
+		/* a parameter, say, whose value is in its slot when the procedure starts */
+		c.pinned[v] = g->vars[v].private && g->vars[v].a.region == R_LOCAL &&
+			live_test(g->blocks[0]->live_in, v) ? v : -1;
+	}
+	build_interference(g, &c);
+
+	for (i = 0; i < g->nblocks; i++) {
+		for (j = 0; j < g->blocks[i]->ncode; j++) {
+			struct instr *in = g->blocks[i]->code[j];
+			int d, s;
+
+			if (in->opcode != O_ASN || in->code_type == DECLARATION) continue;
+			d = cfg_var(g, &in->dest);
+			s = cfg_var(g, &in->src1);
+			if (d >= 0 && s >= 0 && g->vars[d].private && g->vars[s].private) {
+				try_merge(&c, d, s);
+			}
+		}
+	}
+	for (v = 0; v < c.n; v++) {
+		if (g->vars[v].a.region == R_SSA) {
+			int orig = cfg_var(g, &g->ssa_var[g->vars[v].a.u.offset]);
+
+			if (g->vars[orig].private) try_merge(&c, orig, v);
+		}
+	}
+
+	/*
+	 * a class keeps the slot of the variable live on entry it has, else
+	 * a slot one of its variables had, or gets a new one
+	 */
+	slot = xcalloc(c.n, sizeof(struct addr));
+	for (v = 0; v < c.n; v++) {
+		if (find(&c, v) == v && c.pinned[v] >= 0) slot[v] = g->vars[c.pinned[v]].a;
+	}
+	for (v = 0; v < c.n; v++) {
+		int root = find(&c, v);
+
+		if (g->vars[v].private && g->vars[v].a.region == R_LOCAL &&
+			slot[root].region == 0) {
+			slot[root] = g->vars[v].a;
+		}
+	}
+	for (v = 0; v < c.n; v++) {
+		int root = find(&c, v);
+
+		if (g->vars[v].private && slot[root].region == 0) slot[root] = cfg_new_slot(g);
+	}
+
+	for (i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		for (j = 0; j < b->ncode; j++) {
+			struct instr *in = b->code[j];
+			struct addr *uses[2], *d = instr_def(in);
+			int n = instr_uses(in, uses);
+
+			for (k = 0; k < n; k++) {
+				if ((v = cfg_var(g, uses[k])) >= 0 && g->vars[v].private) {
+					*uses[k] = slot[find(&c, v)];
+				}
+			}
+			if (d != NULL && (v = cfg_var(g, d)) >= 0 && g->vars[v].private) {
+				*d = slot[find(&c, v)];
+			}
+
+			if (in->opcode == O_ASN && in->code_type != DECLARATION &&
+				addr_equal(in->dest, in->src1)) {
+				block_remove(b, j--);
+				stats->removed++;
+			}
+		}
+	}
+
+	free(slot);
+	free(c.parent);
+	free(c.pinned);
+	free(c.adj);
+	free(c.members);
+}
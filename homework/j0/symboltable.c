@@ -1,4 +1,7 @@
+#include <limits.h>
+
 #include "symboltable.h"
+#include "index.h"
 
 #define SBufSize 1024               /* initial size of the string buffer */
 
@@ -109,16 +112,11 @@ SymbolTable make_sym_table(int size, char* table_name) {
 
 int hash(SymbolTable st, char *s) {
 
-	register int h = 0;
-	register char c;
-
-	while ((c = *s++)) {
-		h += c & 0377;
-		h *= 37;
-	}
+	unsigned int h = hash_name(s);
 
-	if (h < 0) h = -h;
-		return h % st->nBuckets;
+	/* the bucket the signed hash this used to be would have picked */
+	if (h > INT_MAX) h = -h;
+	return h % st->nBuckets;
 
 }
 
@@ -159,6 +157,11 @@ int insert_symbol(SymbolTable st, char *s, typeptr t) {
    	st->nEntries++;
 	st->byte_words++;
 
+	/* names only go into the scope being filled, its view is the live one */
+	if (flat_scopes && st == current) {
+		st->view = view_insert(st->view, se);
+	}
+
    	return 1;
 }
 
@@ -215,18 +218,33 @@ void printsymbols(SymbolTable st, int level) {
 
 void redeclaration_error(struct token *t) {
 
-	fprintf(stderr, "\n%s:%d: semantic error: Redeclaration of variable: %s \n\n"
-		, t->filename, t->lineno, t->text);
+	char msg[256];
 
-	exit(3);
+	snprintf(msg, sizeof(msg), "Redeclaration of variable: %s", t->text);
+	throw_semantic_error_at(msg, t);
 }
 
 void undeclared_error(struct token *t) {
 
-	fprintf(stderr, "\n%s:%d: semantic error: %s is undeclared \n\n"
-		, t->filename, t->lineno, t->text);
+	char msg[256];
+
+	snprintf(msg, sizeof(msg), "%s is undeclared", t->text);
+	throw_semantic_error_at(msg, t);
+	t->type = error_typeptr;
+}
+
+/*
+ * declare_poisoned - enter an undeclared name into the current scope with
+ * the error type, so the rest of the method neither reports it again nor
+ * type checks expressions built from it.
+ */
+static void declare_poisoned(struct token *t) {
+	insert_symbol(current, t->text, error_typeptr);
+}
 
-	exit(3);
+/* name_token - the first identifier of a Name, qualified or not */
+static struct token *name_token(struct tree *n) {
+	return n->leaf ? n->leaf : n->kids[0]->leaf;
 }
 
 SymbolTableEntry check_if_undeclared(SymbolTable st, char* s) {
@@ -234,7 +252,18 @@ SymbolTableEntry check_if_undeclared(SymbolTable st, char* s) {
 	parent symbol table.
 	continue until symbol is found or there are no more parent tables.*/
 
-	SymbolTableEntry search = lookup_st(st, s);
+	SymbolTableEntry search;
+
+	/*
+	 * The current scope's view is up to date, every scope around it is
+	 * closed to new names until it is. Any other scope's view may be
+	 * missing names its parents got later, so those take the long way.
+	 */
+	if (st->view != NULL && st == current) {
+		return view_lookup(st->view, s);
+	}
+
+	search = lookup_st(st, s);
 
 	if (search != NULL) {
 		//symbol found in current table
@@ -252,10 +281,21 @@ SymbolTableEntry check_if_undeclared(SymbolTable st, char* s) {
 	return search;
 }
 
-void populate_symbol_tables(struct tree * n) {
+/*
+ * resolve_name - the name at leaf t refers to e. Later passes read the
+ *  answer off the tree (t->entry, and t->stab is the scope e is in)
+ *  instead of looking the name up again.
+ */
+static void resolve_name(struct tree *t, SymbolTableEntry e) {
 
-	int i;
-	if (n == NULL) return;
+	if (e == NULL) return;
+
+	t->stab = e->table;
+	t->entry = e;
+	index_use(t->leaf, e);
+}
+
+static int populate_pre(struct tree * n, int depth, void *arg) {
 
 	/* pre-order activity */
 	switch (n->prodrule) {
@@ -377,29 +417,8 @@ void populate_symbol_tables(struct tree * n) {
 					n->stab = current;
 					n->kids[1]->kids[0]->leaf->type = t;
 
-					//Add formal parameter to its method's parameter linked list
-					paramlist param = malloc(sizeof(struct param));
-
-					param->name = n->kids[1]->kids[0]->leaf->text;
-					param->type = t;
-
-					if (current->scope->u.f.has_param) {
-
-						paramlist last_ptr = current->scope->u.f.parameters;
-
-						while (last_ptr->next != NULL) {
-							last_ptr = last_ptr->next;
-						}
-						// printf("** previous param [%s] adding [%s %s] to next\n", last_ptr->name, typename(t), param->name);
-						param->position = last_ptr->position + 1;
-						last_ptr->next = param;
-					} else {
-						// printf("** No initial param, setting initial to [%s %s]\n", typename(t), param->name);
-						param->position = 0;
-						current->scope->u.f.parameters = param;
-						param->next = NULL;
-						current->scope->u.f.has_param = 1;
-					}
+					//Add formal parameter to its method's parameter list
+					add_param(current->scope, n->kids[1]->kids[0]->leaf->text, t);
 				}
 			} else {
 
@@ -415,29 +434,8 @@ void populate_symbol_tables(struct tree * n) {
 					n->stab = current;
 					n->kids[1]->leaf->type = t;
 
-					//Add formal parameter to its method's parameter linked list
-					paramlist param = malloc(sizeof(struct param));
-
-					param->name = n->kids[1]->leaf->text;
-					param->type = t;
-
-					if (current->scope->u.f.has_param) {
-
-						paramlist last_ptr = current->scope->u.f.parameters;
-
-						while (last_ptr->next != NULL) {
-							last_ptr = last_ptr->next;
-						}
-						// printf("** previous param [%s] adding [%s %s] to next\n", last_ptr->name, typename(t), param->name);
-						param->position = last_ptr->position + 1;
-						last_ptr->next = param;
-					} else {
-						// printf("** No initial param, setting initial to [%s %s]\n", typename(t), param->name);
-						param->position = 0;
-						current->scope->u.f.parameters = param;
-						param->next = NULL;
-						current->scope->u.f.has_param = 1;
-					}
+					//Add formal parameter to its method's parameter list
+					add_param(current->scope, n->kids[1]->leaf->text, t);
 			}
 
 			break;
@@ -452,11 +450,13 @@ void populate_symbol_tables(struct tree * n) {
 
 			SymbolTableEntry name_search =
 				check_if_undeclared(traversal, tree_copy->kids[0]->leaf->text);
+			resolve_name(tree_copy->kids[0], name_search);
 
 			// printf("Searched for: %s\n",tree_copy->kids[0]->leaf->text);
 
 			if (name_search == NULL) {
 				undeclared_error(tree_copy->kids[0]->leaf);
+				declare_poisoned(tree_copy->kids[0]->leaf);
 			}
 
 
@@ -469,7 +469,8 @@ void populate_symbol_tables(struct tree * n) {
 
 				if(name_search->type == NULL){ //Need to add types to builtins
 					// printf("Is not a class to dive into\n");
-					undeclared_error(tree_copy->kids[1]->leaf);
+					undeclared_error(name_token(tree_copy->kids[1]));
+					break;
 				}
 
 				switch (name_search->type->basetype) {
@@ -485,6 +486,7 @@ void populate_symbol_tables(struct tree * n) {
 							next_thing = tree_copy->kids[1]->kids[0]->leaf->text;
 							// printf("*Next thing:%s\n", next_thing);
 							name_search = lookup_st(traversal, next_thing);
+							resolve_name(tree_copy->kids[1]->kids[0], name_search);
 
 							if (name_search == NULL) {
 								undeclared_error(tree_copy->kids[1]->kids[0]->leaf);
@@ -496,15 +498,28 @@ void populate_symbol_tables(struct tree * n) {
 							next_thing = tree_copy->kids[1]->leaf->text;
 							// printf("**Next thing:%s\n", next_thing);
 							name_search = lookup_st(traversal, next_thing);
+							resolve_name(tree_copy->kids[1], name_search);
 
 							if (name_search == NULL) {
 								undeclared_error(tree_copy->kids[1]->leaf);
 							}
+							n->entry = name_search;
 
 							end = 1;
 						}
 						break;
 					}
+
+					/* already reported where it was first used */
+					case ERROR_TYPE:
+						end = 1;
+						break;
+
+					/* nothing to look the next name up in */
+					default:
+						undeclared_error(name_token(tree_copy->kids[1]));
+						end = 1;
+						break;
 				}
 				//Break out of while loop if there are no more qualified names
 				if (end) {break;}
@@ -524,8 +539,9 @@ void populate_symbol_tables(struct tree * n) {
 				if (check == NULL) {
 					// printf("%s\n", n->leaf->text);
 					undeclared_error(n->leaf);
+					declare_poisoned(n->leaf);
 				} else {
-					n->stab = check->table;
+					resolve_name(n, check);
 				}
 			}
 			break;
@@ -534,17 +550,11 @@ void populate_symbol_tables(struct tree * n) {
 
 	if (n->stab == NULL) { n->stab = current; }
 
+	/* the names in a qualified name were resolved above, skip its children */
+	return n->prodrule != prodR_QualifiedName;
+}
 
-	/* visit children */
-	switch (n->prodrule) {
-		case prodR_QualifiedName:
-			break;
-		default:
-			for (i = 0; i < n->nkids; i++) {
-				populate_symbol_tables(n->kids[i]);
-			}
-			break;
-	}
+static int populate_post(struct tree * n, int depth, void *arg) {
 
 	/* post-order activity */
 	switch (n->prodrule) {
@@ -556,6 +566,33 @@ void populate_symbol_tables(struct tree * n) {
 			popscope();
 			break;
 	}
+
+	return 1;
+}
+
+/*
+ * view_builtins - start the global scope's view with the builtins. Not
+ *  part of init_globals(), a compile server does that before it knows
+ *  the flags of any compile.
+ */
+static void view_builtins() {
+
+	int i;
+	SymbolTableEntry e;
+
+	for (i = 0; i < builtin_scope.nBuckets; i++) {
+		for (e = builtin_scope.tbl[i]; e != NULL; e = e->next) {
+			globals->view = view_insert(globals->view, e);
+		}
+	}
+}
+
+void populate_symbol_tables(struct tree * n) {
+
+	if (flat_scopes && globals->view == NULL) {
+		view_builtins();
+	}
+	walk_tree(n, populate_pre, populate_post, NULL);
 }
 
 char *checked_alloc(int size) {
@@ -586,7 +623,7 @@ typeptr get_method_return_type(struct tree *n) {
 		}
 	}
 
-	throw_semantic_error("can not determine return type of method\n", n->leaf->lineno);
+	throw_semantic_error("can not determine return type of method\n", n);
 	return NULL;
 }
 
@@ -652,6 +689,7 @@ void enter_newscope(char *s, int typ, struct tree * n) {
 
 	/* insert s into current symbol table */
   	insert_symbol(current, s, t);
+	new_st->view = current->view;
 
 	// SymbolTableEntry testing = malloc(sizeof(SymbolTableEntry));
 	// testing = lookup_st(current, s);
@@ -661,78 +699,25 @@ void enter_newscope(char *s, int typ, struct tree * n) {
 
 }
 
-void load_builtins() {
-
-
-	enter_newscope("String", CLASS_TYPE, NULL);
-
-
-	struct typeinfo *charAt, *equals, *length, *substring, *valueOf, *print, *println, *read, *close;
-
-	 charAt = alctype(FUNC_TYPE);
-		 charAt->u.f.returntype = alctype(CHAR_TYPE);
-		 charAt->u.f.name = "charAt";
-		 charAt->u.f.nparams = 1;
-
-	 equals = alctype(FUNC_TYPE);
-		 equals->u.f.returntype = alctype(BOOL_TYPE);
-		 equals->u.f.name = "equals";
-		 equals->u.f.nparams = 2;
-
-	 length = alctype(FUNC_TYPE);
-		 length->u.f.returntype = alctype(INT_TYPE);
-		 length->u.f.name = "length";
-		 length->u.f.nparams = 0;
-
-	 substring = alctype(FUNC_TYPE);
-		 substring->u.f.returntype = alctype(STRING_TYPE);
-		 substring->u.f.name = "substring";
-		 substring->u.f.nparams = 2;
-
-	 valueOf = alctype(FUNC_TYPE);
-		 valueOf->u.f.returntype = alctype(INT_TYPE);
-		 valueOf->u.f.name = "valueOf";
-		 valueOf->u.f.nparams = 1;
-
-	 print = alctype(FUNC_TYPE);
-		 print->u.f.returntype = alctype(STRING_TYPE);
-		 print->u.f.name = "print";
-		 print->u.f.nparams = 1;
-
-	 println = alctype(FUNC_TYPE);
-		 println->u.f.returntype = alctype(STRING_TYPE);
-		 println->u.f.name = "println";
-		 println->u.f.nparams = 1;
-
-	 read = alctype(FUNC_TYPE);
-		 read->u.f.returntype = alctype(INT_TYPE);
-		 read->u.f.name = "read";
-		 read->u.f.nparams = 0;
-
-	 close = alctype(FUNC_TYPE);
-		 close->u.f.returntype = NULL;
-		 close->u.f.name = "close";
-		 close->u.f.nparams = 0;
-
-	insert_symbol(current, "charAt", charAt);
-	insert_symbol(current, "equals", equals);
-	insert_symbol(current, "length", length);
-	insert_symbol(current, "substring", substring);
-	insert_symbol(current, "valueOf", valueOf);
-	popscope();
-
-	enter_newscope("System", CLASS_TYPE, NULL);
-
-		enter_newscope("out", CLASS_TYPE, NULL);
-		insert_symbol(current, "print", print);
-		insert_symbol(current, "println", println);
-		popscope();
-
-		enter_newscope("in", CLASS_TYPE, NULL);
-		insert_symbol(current, "read", read);
-		insert_symbol(current, "close", close);
-		popscope();
-		popscope();
+/*
+ * init_globals - the global scope with the builtin classes loaded into it.
+ * A compile server does this once and every compile shares the result.
+ */
+void init_globals() {
 
+	globals = make_sym_table(20, "global");
+	current = globals;
+	load_builtins();
+}
 
+/*
+ * load_builtins - make the builtin classes visible from the global scope.
+ * They are a read-only image compiled from builtins.def at build time
+ * (see gen_builtins.c), so there is nothing to allocate, only a parent
+ * link. The builtins still take the first words of the global scope, as
+ * they did when they were inserted into it.
+ */
+void load_builtins() {
+	globals->parent = (SymbolTable) &builtin_scope;
+	globals->byte_words = builtin_scope.byte_words;
 }
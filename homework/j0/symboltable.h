@@ -2,6 +2,7 @@
 #define SYMBOLTABLE_H
 
 #include "type.h"
+#include "scopeview.h"
 
 typedef struct sym_table {
 	char* table_name;
@@ -11,6 +12,7 @@ typedef struct sym_table {
 	struct sym_table *parent;		/* enclosing scope, superclass etc. */
 	struct typeinfo *scope;			/* what type do we belong to? class/method? */
   	struct sym_entry **tbl;
+	const struct view_node *view;	/* with -flatscopes, see scopeview.h */
   	/* more per-scope/per-symbol-table attributes go here */
 } *SymbolTable;
 
@@ -30,6 +32,8 @@ void populate_symbol_tables(struct tree * n);
 
 extern SymbolTable globals;	       /* global symbols */
 extern SymbolTable current;	       /* current */
+extern const struct sym_table builtin_scope;	/* see builtins.def */
+extern int flat_scopes;
 
 void printsymbols(SymbolTable st, int level);
 SymbolTableEntry lookup_st(SymbolTable st, char *s);
@@ -37,6 +41,7 @@ SymbolTableEntry lookup_st(SymbolTable st, char *s);
 void enter_newscope(char *s, int typ, struct tree * n);
 int insert_symbol(SymbolTable st, char *s, typeptr t); //, int address_region
 void load_builtins();
+void init_globals();
 SymbolTableEntry check_if_undeclared(SymbolTable st, char* s);
 
 #define pushscope(stp) do { stp->parent = current; current = stp; } while (0)
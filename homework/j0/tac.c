@@ -3,7 +3,8 @@
 #include <string.h>
 #include "tac.h"
 
-char *regionnames[] = {"global", "loc", "class", "L", "const", "name", "none", "procname"};
+char *regionnames[] = {"global", "loc", "class", "L", "const", "name", "none", "procname",
+   "string", "ssa"};
 char *regionname(int i) { return regionnames[i-R_GLOBAL]; }
 
 char *opcodenames[] = {
@@ -16,7 +17,8 @@ char *opcodename(int i) { return opcodenames[i-O_ADD]; }
 char *pseudonames[] = { "glob","proc", "loc", "lab", "end", "prot" };
 char *pseudoname(int i) { return pseudonames[i-D_GLOB]; }
 
-int labelcounter;
+/* per thread, so a worker numbers the labels of its method from 0 */
+_Thread_local int labelcounter;
 
 struct addr *genlabel() {
 
@@ -77,23 +79,28 @@ struct instr *gen_method(char* method_name, int nparams, struct addr a, int code
 
 struct instr *copylist(struct instr *l) {
 
-	if (l == NULL) return NULL;
+	struct instr *head = NULL;
+	struct instr **tail = &head;
 
-	struct instr *lcopy;
+	for (; l != NULL; l = l->next) {
 
-	if (l->opcode == D_PROC) {
-		lcopy = gen_method(l->name, l->nparams, l->dest, D_PROC);
-		lcopy->code_type = DECLARATION;
-		lcopy->block_bytes = l->block_bytes;
-	} else if(l->opcode == O_CALL) {
-		lcopy = gen_method(l->name, l->nparams, l->dest, O_CALL);
-	} else {
-		lcopy = gen(l->opcode, l->dest, l->src1, l->src2);
-	}
+		struct instr *lcopy;
 
-	lcopy->next = copylist(l->next);
+		if (l->opcode == D_PROC) {
+			lcopy = gen_method(l->name, l->nparams, l->dest, D_PROC);
+			lcopy->block_bytes = l->block_bytes;
+		} else if(l->opcode == O_CALL) {
+			lcopy = gen_method(l->name, l->nparams, l->dest, O_CALL);
+		} else {
+			lcopy = gen(l->opcode, l->dest, l->src1, l->src2);
+		}
+		lcopy->code_type = l->code_type;
+
+		*tail = lcopy;
+		tail = &lcopy->next;
+	}
 
-	return lcopy;
+	return head;
 }
 
 struct instr *append(struct instr *l1, struct instr *l2) {
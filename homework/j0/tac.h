@@ -29,6 +29,7 @@ struct addr {
 #define R_NONE   2007 /* pseudo-region for unused addresses */
 #define R_PROCNAME 2008
 #define R_STRING 2009
+#define R_SSA    2010 /* pseudo-region for SSA values, inside the optimizer only */
 
 struct instr {
    int opcode;
@@ -73,6 +74,8 @@ struct instr {
 #define D_END   3055
 #define D_PROT  3056 /* prototype "declaration" */
 
+extern _Thread_local int labelcounter;
+
 struct instr *gen(int, struct addr, struct addr, struct addr);
 struct instr *gen_method(char* method_name, int nparams, struct addr a, int code);
 struct instr *concat(struct instr *, struct instr *);
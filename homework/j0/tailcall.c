@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * Tail-call elimination for procedures that call themselves. A call
+ *
+ *	PARM an; ... PARM a1; CALL f,n,d; RET d
+ *
+ * in f itself, or one with nothing but labels after it, does the same as
+ *
+ *	ASN p1,a1; ... ASN pn,an; GOTO entry
+ *
+ * where entry is a label put at the top of f, so the recursion becomes a
+ * loop that the passes after this one can work on, and f may be a leaf
+ * for inline_calls(). An argument that is a parameter itself is copied
+ * to a new slot first, so none is overwritten before it is read.
+ */
+
+static int is_decl(struct instr *in, int opcode) {
+	return in->code_type == DECLARATION && in->opcode == opcode;
+}
+
+static int in_proc(struct instr *in) {
+	return in != NULL && !is_decl(in, D_PROC);
+}
+
+static int is_slot(struct addr *a) {
+	return a->region == R_LOCAL && a->tag == OFFSET;
+}
+
+static int is_op(struct instr *in, int opcode) {
+	return in != NULL && in->code_type != DECLARATION && in->opcode == opcode;
+}
+
+/* is_tail - call, in proc, returns what it returns or nothing, past any labels */
+static int is_tail(struct instr *proc, struct instr *call) {
+
+	struct instr *next = call->next;
+
+	if (call->name == NULL || proc->name == NULL || strcmp(call->name, proc->name) != 0 ||
+		call->nparams != proc->nparams) {
+		return 0;
+	}
+	while (next != NULL && is_decl(next, D_LABEL)) next = next->next;
+	if (!in_proc(next)) return 1;
+	return is_op(next, O_RET) && (next->dest.region == 0 || next->dest.region == R_NONE ||
+		addr_equal(next->dest, call->dest));
+}
+
+static struct instr *emit(struct instr ***link, struct instr *in) {
+
+	**link = in;
+	*link = &in->next;
+	return in;
+}
+
+/*
+ * jump_back - the code that replaces a tail call in proc whose PARMs, the
+ *  last argument first, are parms
+ */
+static struct instr *jump_back(struct instr *proc, struct instr **parms, int n, struct addr entry,
+	int *next_slot) {
+
+	struct instr *code = NULL, **link = &code;
+	struct addr none, *args = malloc((n > 0 ? n : 1) * sizeof(struct addr));
+
+	if (args == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+
+	memset(&none, 0, sizeof(none));
+	none.region = R_NONE;
+
+	for (int i = 0; i < n; i++) {
+		args[i] = parms[n - 1 - i]->dest;
+		if (is_slot(&args[i]) && args[i].u.offset < 8 * n && args[i].u.offset != 8 * i) {
+			struct addr t = new_frame_slot(proc, next_slot);
+
+			emit(&link, gen(O_ASN, t, args[i], none));
+			args[i] = t;
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		struct addr param;
+
+		memset(&param, 0, sizeof(param));
+		param.region = R_LOCAL;
+		param.tag = OFFSET;
+		param.u.offset = 8 * i;
+		if (!addr_equal(param, args[i])) emit(&link, gen(O_ASN, param, args[i], none));
+	}
+	emit(&link, gen(O_GOTO, entry, none, none));
+
+	free(args);
+	return code;
+}
+
+/* eliminate - the tail calls proc makes to itself; returns how many */
+static int eliminate(struct instr *proc, int *next_label) {
+
+	struct instr **link = &proc->next, **first_parm = NULL, *parms[64];
+	struct addr entry, none;
+	int nparms = 0, done = 0, next_slot = frame_end(proc);
+
+	memset(&none, 0, sizeof(none));
+	none.region = R_NONE;
+	memset(&entry, 0, sizeof(entry));
+	entry.region = R_LABEL;
+	entry.tag = OFFSET;
+
+	while (in_proc(*link)) {
+		struct instr *in = *link, *rest, *code;
+		int n = in->nparams;
+
+		if (is_op(in, O_PARM)) {
+			if (nparms++ == 0) first_parm = link;
+			link = &in->next;
+			continue;
+		}
+		if (!is_op(in, O_CALL) || n > nparms || n > 64 || !is_tail(proc, in)) {
+			nparms = 0;
+			link = &in->next;
+			continue;
+		}
+
+		if (done++ == 0) {
+			struct instr *label;
+
+			entry.u.offset = (*next_label)++;
+			label = gen(D_LABEL, entry, none, none);
+			label->code_type = DECLARATION;
+			label->next = proc->next;
+			proc->next = label;
+			if (first_parm == &proc->next) first_parm = &label->next;
+			if (link == &proc->next) link = &label->next;
+		}
+
+		if (n == 0) {
+			first_parm = link;
+		} else {
+			for (int i = 0; i < nparms - n; i++) first_parm = &(*first_parm)->next;
+		}
+		for (int i = 0; i < n; i++) parms[i] = i ? parms[i - 1]->next : *first_parm;
+
+		rest = is_op(in->next, O_RET) ? in->next->next : in->next;
+		code = jump_back(proc, parms, n, entry, &next_slot);
+		*first_parm = code;
+		for (link = first_parm; *link != NULL; link = &(*link)->next);
+		*link = rest;
+		nparms = 0;
+	}
+
+	return done;
+}
+
+/*
+ * tail_calls - turn the tail calls of every procedure to itself into
+ *  jumps, see above. Returns how many were.
+ */
+int tail_calls(struct instr *code, struct opt_stats *stats) {
+
+	struct instr *in;
+	int next_label = 0, done = 0;
+
+	for (in = code; in != NULL; in = in->next) {
+		if (is_decl(in, D_LABEL) && in->dest.u.offset >= next_label) {
+			next_label = in->dest.u.offset + 1;
+		}
+	}
+
+	for (in = code; in != NULL; in = in->next) {
+		if (is_decl(in, D_PROC)) done += eliminate(in, &next_label);
+	}
+
+	stats->tail_calls += done;
+	return done;
+}
@@ -0,0 +1,52 @@
+public class Arrays {
+	public static int local(int x) {
+		int [] a;
+		a = new int[3];
+		a[0] = x;
+		a[2] = 5;
+		return a[0] + a[1] + a[2];
+	}
+	public static int [] make() {
+		int [] m;
+		m = new int[2];
+		m[1] = 7;
+		return m;
+	}
+	public static int inloop(int n) {
+		int [] t;
+		int i;
+		int s;
+		s = 0;
+		for (i = 0; i < n; i++) {
+			t = new int[2];
+			t[1] = i;
+			s = s + t[1] + t[0];
+			t[0] = 9;
+		}
+		return s;
+	}
+	public static int indexed(int n) {
+		int [] a;
+		int i;
+		int s;
+		a = new int[4];
+		a[0] = 1;
+		a[1] = 2;
+		a[2] = 3;
+		a[3] = 4;
+		s = 0;
+		for (i = 0; i < n; i++) {
+			s = s + a[i];
+		}
+		return s;
+	}
+	public static void main(String argv[]) {
+		int [] m;
+		System.out.println(local(4));
+		m = make();
+		System.out.println(m[1]);
+		System.out.println(m[0]);
+		System.out.println(inloop(4));
+		System.out.println(indexed(4));
+	}
+}
@@ -0,0 +1,50 @@
+public class Branches {
+	public static int consts(int x) {
+		int a;
+		int b;
+		int c;
+		a = 3;
+		b = a * 4;
+		if (b > 10) {
+			c = b + x;
+		} else {
+			c = 0 - x;
+		}
+		if (a == 4) {
+			c = c * 100;
+		}
+		return c + 0;
+	}
+	public static int identities(int x) {
+		int y;
+		y = x + 0;
+		y = y * 1;
+		y = y - 0;
+		return y * 2;
+	}
+	public static int logic(int a, int b) {
+		int r;
+		r = 0;
+		if (a < b && b < 10) {
+			r = r + 1;
+		}
+		if (a > 5 || b > 5) {
+			r = r + 10;
+		}
+		if (!(a == b)) {
+			r = r + 100;
+		}
+		while (a < b && r < 1000) {
+			r = r + 1000;
+			a = a + 1;
+		}
+		return r;
+	}
+	public static void main(String argv[]) {
+		System.out.println(consts(5));
+		System.out.println(identities(21));
+		System.out.println(logic(1, 3));
+		System.out.println(logic(7, 7));
+		System.out.println(logic(2, 9));
+	}
+}
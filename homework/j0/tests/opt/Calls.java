@@ -0,0 +1,67 @@
+public class Calls {
+	public static int sq(int x) {
+		return x * x;
+	}
+	public static int add3(int a, int b, int c) {
+		return a + b + c;
+	}
+	public static int abs(int x) {
+		if (x < 0) {
+			return 0 - x;
+		}
+		return x;
+	}
+	public static int gcd(int a, int b) {
+		if (b == 0) {
+			return a;
+		}
+		return gcd(b, a % b);
+	}
+	public static int sum(int n, int acc) {
+		if (n == 0) {
+			return acc;
+		}
+		return sum(n - 1, acc + n);
+	}
+	public static int swap(int a, int b, int n) {
+		if (n == 0) {
+			return a - b;
+		}
+		return swap(b, a, n - 1);
+	}
+	public static int fact(int n) {
+		if (n < 2) {
+			return 1;
+		}
+		return n * fact(n - 1);
+	}
+	public static void count(int n) {
+		if (n > 0) {
+			System.out.println(n);
+			count(n - 1);
+		}
+	}
+	public static int pick(int a, int b) {
+		int r;
+		if (sq(a) > sq(b) && abs(a - b) > 1) {
+			r = add3(a, b, sq(a));
+		} else {
+			r = add3(sq(b), abs(a), 1);
+		}
+		if (abs(a) == 3 || sq(b) == 4) {
+			r = r + 1000;
+		}
+		return r;
+	}
+	public static void main(String argv[]) {
+		System.out.println(gcd(12, 18));
+		System.out.println(sum(10, 0));
+		System.out.println(swap(1, 5, 3));
+		System.out.println(swap(1, 5, 4));
+		System.out.println(fact(5));
+		count(3);
+		System.out.println(pick(5, 2));
+		System.out.println(pick(1, 3));
+		System.out.println(pick(0 - 3, 0 - 2));
+	}
+}
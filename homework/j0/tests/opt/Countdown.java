@@ -0,0 +1,24 @@
+public class Countdown {
+	public static int down(int n) {
+		int s;
+		s = 0;
+		while (n > 0) {
+			s = s + n;
+			n--;
+		}
+		return s;
+	}
+	public static void main(String argv[]) {
+		int i;
+		int k;
+		k = 0;
+		for (i = 5; i > 0; i--) {
+			k++;
+			k++;
+			k--;
+		}
+		System.out.println(k);
+		System.out.println(i);
+		System.out.println(down(4));
+	}
+}
@@ -0,0 +1,15 @@
+public class Fields {
+	int a;
+	int i;
+	public static int twice(int x) {
+		return x + x;
+	}
+	public static void main(String argv[]) {
+		a = 4;
+		for (i = 1; i < a; i++) {
+			System.out.println(twice(i));
+			System.out.println(i * 3);
+		}
+		System.out.println(i + a);
+	}
+}
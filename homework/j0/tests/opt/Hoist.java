@@ -0,0 +1,16 @@
+public class Hoist {
+	public static int hot(int a, int b, int n) {
+		int i;
+		int s;
+		int k;
+		s = 0;
+		for (i = 0; i < n; i++) {
+			k = a * b + b * 5;
+			s = s + k - i;
+		}
+		return s;
+	}
+	public static void main(String argv[]) {
+		System.out.println(hot(7, 3, 1000));
+	}
+}
@@ -0,0 +1,74 @@
+public class Loops {
+	public static int invariant(int a, int b, int n) {
+		int i;
+		int s;
+		s = 0;
+		for (i = 0; i < n; i++) {
+			s = s + a * b + i * 8;
+		}
+		return s;
+	}
+	public static int triangle(int n) {
+		int i;
+		int j;
+		int s;
+		s = 0;
+		for (i = 0; i < n; i++) {
+			for (j = 0; j < i; j++) {
+				s = s + j;
+			}
+		}
+		return s;
+	}
+	public static int zero(int n) {
+		int i;
+		int x;
+		x = 7;
+		i = 0;
+		while (i < n) {
+			x = n * 3;
+			i = i + 1;
+		}
+		return x;
+	}
+	public static int down(int n) {
+		int i;
+		int s;
+		s = 0;
+		i = n;
+		while (i > 0) {
+			s = s + i * 3;
+			i = i - 2;
+		}
+		return s + i;
+	}
+	public static int ranges(int n) {
+		int i;
+		int s;
+		s = 0;
+		for (i = 0; i < n; i++) {
+			if (i < 0) {
+				s = s - 100;
+			}
+			if (i >= n) {
+				s = s - 1000;
+			}
+			if (i < 10) {
+				s = s + i;
+			} else {
+				s = s + 1;
+			}
+		}
+		return s;
+	}
+	public static void main(String argv[]) {
+		System.out.println(invariant(3, 4, 5));
+		System.out.println(invariant(3, 4, 0));
+		System.out.println(triangle(5));
+		System.out.println(zero(0));
+		System.out.println(zero(2));
+		System.out.println(down(7));
+		System.out.println(down(6));
+		System.out.println(ranges(12));
+	}
+}
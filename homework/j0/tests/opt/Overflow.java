@@ -0,0 +1,48 @@
+public class Overflow {
+	public static int wrap(int x) {
+		int big;
+		int y;
+		big = 2147483647;
+		y = big + x;
+		if (y < 0) {
+			return 1;
+		}
+		return 2;
+	}
+	public static int mulloop(int n) {
+		int i;
+		int p;
+		p = 1;
+		for (i = 0; i < n; i++) {
+			p = p * 100;
+		}
+		return p;
+	}
+	public static int sumloop(int n) {
+		int i;
+		int s;
+		s = 0;
+		for (i = 0; i < n; i++) {
+			s = s + 1000000000;
+		}
+		return s;
+	}
+	public static int lowest() {
+		int m;
+		m = 0 - 2147483647;
+		m = m - 1;
+		return m;
+	}
+	public static void main(String argv[]) {
+		int m;
+		System.out.println(wrap(1));
+		System.out.println(wrap(0 - 5));
+		System.out.println(mulloop(3));
+		System.out.println(mulloop(5));
+		System.out.println(sumloop(3));
+		m = lowest();
+		System.out.println(0 - m);
+		System.out.println(m / (0 - 1));
+		System.out.println(m - 1);
+	}
+}
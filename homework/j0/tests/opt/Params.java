@@ -0,0 +1,38 @@
+public class Params {
+	public static int m1(int p0) {
+		int v1;
+		int v2;
+		v1 = 5;
+		v2 = v1 * 3;
+		System.out.println(v2);
+		v1 = p0;
+		v2 = v1 % 4;
+		v1 = 0 - v1;
+		return v1 + v2 - p0;
+	}
+	public static int copies(int a, int b) {
+		int x;
+		int y;
+		x = b;
+		y = a;
+		System.out.println(x - y);
+		a = x + 1;
+		return a * 10 + y + b;
+	}
+	public static int loop(int n, int step) {
+		int s;
+		int k;
+		s = step;
+		k = n;
+		while (k > 0) {
+			s = s + step;
+			k = k - 1;
+		}
+		return s + n * 100 + step;
+	}
+	public static void main(String argv[]) {
+		System.out.println(m1(7));
+		System.out.println(copies(2, 9));
+		System.out.println(loop(3, 5));
+	}
+}
@@ -0,0 +1,36 @@
+public class Rotate {
+	public static int fib(int n) {
+		int a;
+		int b;
+		int t;
+		int i;
+		a = 0;
+		b = 1;
+		for (i = 0; i < n; i++) {
+			t = a + b;
+			a = b;
+			b = t;
+		}
+		System.out.println(b);
+		return a;
+	}
+	public static int shift(int n) {
+		int v0;
+		int v1;
+		int v2;
+		v0 = 1;
+		v1 = 2;
+		while (n > 0) {
+			v2 = v0 + v1;
+			v1 = v0;
+			v0 = v2;
+			n = n - 1;
+		}
+		return v0 + v1;
+	}
+	public static void main(String argv[]) {
+		System.out.println(fib(10));
+		System.out.println(shift(0));
+		System.out.println(shift(3));
+	}
+}
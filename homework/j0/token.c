@@ -12,47 +12,49 @@ struct token *allocate_token() {
 
 int handle_token(int category_value) { //need to handle cases where tokens arent required
 
+	/* error tokens are recorded and dropped, the parser never sees them */
 	switch (category_value) {
 
 		case NOT_IN_JZERO_RESERVED:
 
 			throw_lexical_error("not supported in jzero");
-			break;
+			return category_value;
 
 		case INVALID_PUNCTUATION:
 
  			throw_lexical_error("is invalid jzero punctuation");
 
-	  		break;
+	  		return category_value;
 
 		case INVALID_CHARLIT_ESCAPE:
 
  			throw_lexical_error("has invalid char literal escape");
-			break;
+			return category_value;
 
 	    case INVALIDCHARLIT:
 
  			throw_lexical_error("is invalid char literal");
-			break;
+			return category_value;
 
 		case EMPTY_CHARLIT:
 
  			throw_lexical_error("is empty char literal");
-			break;
+			return category_value;
 
 		case OPENENDED_CHARLIT:
 
  			throw_lexical_error("is open-ended char literal");
-			break;
+			return category_value;
 
 		case UNRECOGNIZED_CHARACTER:
 
 			throw_lexical_error("is unrecognized character");
-			break;
+			return category_value;
 
 	}
 
 	yylval.treeptr = create_leaf(category_value, yytext, yylineno, filename);
+	yylval.treeptr->leaf->colno = yycolno;
 
 	//Switch after potential error checking
 	switch (category_value) {
@@ -63,8 +65,7 @@ int handle_token(int category_value) { //need to handle cases where tokens arent
 
 	      	//Validate number with min and max allowed INT in Java
 			if (number > 2147483647 || number < -2147483648) {
-				throw_semantic_error("has invalid int literal range", yylineno);
-				exit(1);
+				throw_semantic_error("has invalid int literal range", yylval.treeptr);
 			}
 
 		  	yylval.treeptr->leaf->ival = number;
@@ -94,8 +95,8 @@ int handle_token(int category_value) { //need to handle cases where tokens arent
 					    case '\\': str_buffer[char_position] = '\\'; break;
 
 					    default:
-						  free(str_buffer);
 						  throw_lexical_error("has invalid escape in String");
+						  str_buffer[char_position] = *current_char;
 				 	}
 
 				  	//Reset has_escape and advance character location
@@ -153,8 +154,7 @@ int handle_token(int category_value) { //need to handle cases where tokens arent
 
 	      // detect range error from errno.h
 	      if (errno == ERANGE) {
-			print_error("has invalid Real literal range");
-			exit(1);
+			throw_lexical_error("has invalid Real literal range");
 	      }
 
 	      yylval.treeptr->leaf->dval = float_value;
@@ -4,6 +4,7 @@ struct tree *allocate_tree() {
 
 	struct tree *tree = malloc(sizeof (struct tree));
 	memset(tree, 0, sizeof(struct tree));
+	tree->kids = tree->kid_space;
 
 	return tree;
 
@@ -51,6 +52,32 @@ struct tree *create_branch(prodrule prodrule, char *symbolname, int nkids, ...)
 
 }
 
+/*
+ * append_kid - add kid to the end of a list node, such as an ArgList,
+ *  whose items are all its kids instead of a chain of nested nodes.
+ *  Past KIDS_INLINE the kids move to a vector that doubles as it fills.
+ */
+struct tree *append_kid(struct tree *list, struct tree *kid) {
+
+	int n = list->nkids;
+
+	if (n == KIDS_INLINE) {
+		list->kids = malloc(2 * n * sizeof(struct tree *));
+		if (list->kids != NULL) {
+			memcpy(list->kids, list->kid_space, n * sizeof(struct tree *));
+		}
+	} else if (n > KIDS_INLINE && (n & (n - 1)) == 0) {
+		list->kids = realloc(list->kids, 2 * n * sizeof(struct tree *));
+	}
+	if (list->kids == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+
+	list->kids[list->nkids++] = kid;
+	return list;
+}
+
 char* humanreadable(prodrule rule) {
 
 	switch (rule) {
@@ -108,28 +135,96 @@ char* humanreadable(prodrule rule) {
 	}
 }
 
-int print_tree(struct tree* tree, int depth) {
+struct walk_frame {
+	struct tree *node;
+	int depth;
+	int next_kid;
+};
+
+/*
+ * walk_tree - depth-first traversal of the tree rooted at root, left to
+ *  right, using an explicit stack instead of the C stack so arbitrarily
+ *  long statement chains and deeply nested expressions can be visited.
+ *  NULL kids (empty productions) are skipped.
+ */
+void walk_tree(struct tree *root, tree_visitor pre, tree_visitor post, void *arg) {
+
+	int size = 64;
+	int top = 0;
+	struct walk_frame *stack;
+
+	if (root == NULL) return;
+	if (pre && !pre(root, 0, arg)) return;
+
+	stack = malloc(size * sizeof(struct walk_frame));
+	if (stack == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(4);
+	}
+
+	stack[top].node = root;
+	stack[top].depth = 0;
+	stack[top].next_kid = 0;
+	top++;
+
+	while (top > 0) {
+
+		struct walk_frame *frame = &stack[top - 1];
+
+		if (frame->next_kid < frame->node->nkids) {
+
+			struct tree *kid = frame->node->kids[frame->next_kid++];
+			int depth = frame->depth + 1;
 
+			if (kid == NULL) continue;
+			if (pre && !pre(kid, depth, arg)) continue;
 
-	if (tree == NULL) {
-		return 0;
+			if (top == size) {
+				size *= 2;
+				stack = realloc(stack, size * sizeof(struct walk_frame));
+				if (stack == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(4);
+				}
+			}
+
+			stack[top].node = kid;
+			stack[top].depth = depth;
+			stack[top].next_kid = 0;
+			top++;
+
+		} else {
+			if (post) post(frame->node, frame->depth, arg);
+			top--;
+		}
 	}
 
+	free(stack);
+}
+
+static int print_node(struct tree* tree, int depth, void *arg) {
+
+	depth += *(int *)arg;
+
 	if (tree->nkids == 0) {
 
 		printf("%*s %s %d: %s\n", depth*4, " ", humanreadable(tree->prodrule),
 		tree->leaf->category, tree->leaf->text);
 
-		return 0;
+		return 1;
 
 	}
 
 	printf("%*s %s: %d\n", depth*4, " ", humanreadable(tree->prodrule),
 	 tree->nkids);
 
-	for(int i = 0; i < tree->nkids; i++) {
-		print_tree(tree->kids[i], depth+1);
-	}
+	return 1;
+
+}
+
+int print_tree(struct tree* tree, int depth) {
+
+	walk_tree(tree, print_node, NULL, &depth);
 
 	return 0;
 
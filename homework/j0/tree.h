@@ -6,32 +6,45 @@
 #include "tac.h"
 #include <stdarg.h>
 
+#define KIDS_INLINE 9	/* kids a node holds without a vector */
+
 struct tree {
    int prodrule;
    char *symbolname;
    int nkids;
-   struct tree *kids[9]; /* if nkids >0 */
+   struct tree **kids;   /* if nkids >0: kid_space, or a vector for a long list */
+   struct tree *kid_space[KIDS_INLINE];
    struct token *leaf;   /* if nkids == 0; NULL for ε productions */
    int is_const;
    struct sym_table *stab;
    struct typeinfo *type;
 
    struct instr *icode;
+   struct instr *icode_tail; /* last instr of icode, cached by list productions */
    struct addr *address;
-   struct addr *first;
    struct addr *follow;
    struct addr *onTrue;
    struct addr *onFalse;
 
+   struct method_unit *unit; /* MethodDecl only, when compiling incrementally */
+   struct sym_entry *entry;  /* what a name or QualifiedName resolved to */
 };
 
+/*
+ * Callback for walk_tree. The return value of a pre-order callback decides
+ * whether the walk descends: 0 prunes the subtree (neither its children nor
+ * the post-order callback are visited). Post-order return values are ignored.
+ */
+typedef int (*tree_visitor)(struct tree *n, int depth, void *arg);
+
 struct tree *allocate_tree();
 struct tree *create_leaf(int category_value, char* yytext, int lineno, char* filename);
 struct tree *create_branch(prodrule prodrule, char *symbolname, int nkids, ...);
+struct tree *append_kid(struct tree *list, struct tree *kid);
 
+void walk_tree(struct tree *root, tree_visitor pre, tree_visitor post, void *arg);
 int print_tree(struct tree* tree, int depth);
 char* humanreadable(prodrule rule);
 int free_tree(struct tree* tree, int depth);
-void genfirst();
 
 #endif
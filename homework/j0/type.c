@@ -1,5 +1,6 @@
 #include "type.h"
 #include "symboltable.h"
+#include "incremental.h"
 
 struct typeinfo integer_type = { INT_TYPE };
 struct typeinfo null_type = { NULL_TYPE };
@@ -11,6 +12,7 @@ struct typeinfo class_type = { CLASS_TYPE };
 struct typeinfo array_type = { ARRAY_TYPE };
 struct typeinfo func_type = { FUNC_TYPE };
 struct typeinfo construct_type = { CONSTRUCT_TYPE };
+struct typeinfo error_type = { ERROR_TYPE };
 
 typeptr null_typeptr = &null_type;
 typeptr integer_typeptr = &integer_type;
@@ -22,11 +24,13 @@ typeptr func_typeptr = &func_type;
 typeptr array_typeptr = &array_type;
 typeptr construct_typeptr = &construct_type;
 typeptr void_typeptr = &void_type;
+typeptr error_typeptr = &error_type;
 
 char *typenam[] =
    {"null", "int", "double", "function", "class", "constructor", "char",
-    "boolean", "String", "name", "float", "void", "array"};
+    "boolean", "String", "name", "float", "void", "array", "<error>"};
 
+/* the error type is left out, it can't be named in a program */
 int typenamSize = 13;
 
 typeptr alctype(int base) {
@@ -38,6 +42,7 @@ typeptr alctype(int base) {
    else if (base == FLOAT_TYPE) return float_typeptr;
    else if (base == CHAR_TYPE) return char_typeptr;
    else if (base == VOID_TYPE) return void_typeptr;
+   else if (base == ERROR_TYPE) return error_typeptr;
    // else if (base == CLASS_TYPE) return class_typeptr;
    // else if (base == FUNC_TYPE) return func_typeptr;
 
@@ -80,6 +85,32 @@ typeptr alcarraytype(typeptr elemtype, int size) {
    return rv;
 }
 
+/*
+ * add_param - the next formal parameter of a method. nparams was counted
+ * off the declaration before its parameters are read, so they go in an
+ * array of that size, and a call's arguments are matched by position.
+ */
+void add_param(typeptr functype, char *name, typeptr t) {
+
+	struct funcinfo *f = &functype->u.f;
+	paramlist p;
+
+	if (f->nparams_added == f->nparams) return;
+
+	if (f->parameters == NULL) {
+		f->parameters = (paramlist) calloc(f->nparams, sizeof(struct param));
+		if (f->parameters == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(4);
+		}
+	}
+
+	p = &f->parameters[f->nparams_added];
+	p->name = name;
+	p->position = f->nparams_added++;
+	p->type = t;
+}
+
 char *typename(typeptr t) {
 
    if (!t) return "(NULL)";
@@ -128,26 +159,6 @@ int conv_to_type(char* type_string) {
 	return NULL_TYPE;
 }
 
-int get_arg_count(struct tree *args) {
-
-	int argument_count = 0;
-
-	if (args->symbolname) {
-
-		if (args->kids[0]->nkids == 0) {
-			argument_count = argument_count + 2;
-		} else {
-			argument_count++;
-			argument_count = argument_count +
-				get_arg_count(args->kids[0]);
-		}
-	} else {
-		argument_count++;
-	}
-
-	return argument_count;
-}
-
 typeptr get_type(struct tree *t) {
 
 	SymbolTableEntry ste;
@@ -156,6 +167,11 @@ typeptr get_type(struct tree *t) {
 		return t->type;
 	}
 
+	/* an untyped interior node, nothing to go on */
+	if (t->leaf == NULL) {
+		return NULL;
+	}
+
 		switch (t->leaf->category) {
 			case INTLIT:
 			case REALLIT:
@@ -168,14 +184,14 @@ typeptr get_type(struct tree *t) {
 
 			case IDENTIFIER: {
 
-				ste = lookup_st(t->stab, t->leaf->text);
+				ste = t->entry ? t->entry : lookup_st(t->stab, t->leaf->text);
 
 				if (ste != NULL) {
 					return ste->type;
 				} else {
-					int line_number = t->leaf->lineno;
 					char* msg = "unable to determine typel\n";
-					throw_semantic_error(msg, line_number);
+					throw_semantic_error(msg, t);
+					return error_typeptr;
 				}
 			}
 		}
@@ -184,73 +200,32 @@ typeptr get_type(struct tree *t) {
 	return NULL;
 }
 
+/* match_param - check one argument against the parameter at arg_index */
 int match_param(typeptr method_info, struct tree *arg, int arg_index) {
 
-	paramlist ptr = method_info->u.f.parameters;
 	typeptr arg_type = get_type(arg);
+	paramlist p;
 
-	// printf("Matching against %d declared parameters\n", method_info->u.f.nparams);
-
-	while (ptr->next != NULL) {
-
-		typeptr ptr_type = ptr->type;
-		// printf("declared[%d] vs submitted[%d]\n", ptr->position, arg_index);
-		if (ptr->position == arg_index) {
-			// printf("index match found\n");
-
-			if (ptr_type->basetype != arg_type->basetype) {
-
-				int line_number = arg->leaf->lineno;
-				char* msg = "incompatible parameter in call\n";
-				throw_semantic_error(msg, line_number);
-			}
-
-			// printf("*** Types match at corresponding index ***\n");
-			return 1;
-		}
-
-		ptr = ptr->next;
-	}
-
-	if (ptr->position == arg_index) {
-		// printf("index match found\n");
-		typeptr ptr_type = ptr->type;
-		if (ptr_type->basetype != arg_type->basetype) {
-
-			int line_number = arg->leaf->lineno;
-			char* msg = "incompatible parameter in call\n";
-			throw_semantic_error(msg, line_number);
-		}
-
-		// printf("*** Types match at corresponding index ***\n");
+	/* the builtins don't declare their parameters */
+	if (arg_type == NULL || arg_type->basetype == ERROR_TYPE ||
+		arg_index >= method_info->u.f.nparams_added) {
 		return 1;
-
 	}
 
-	return 0;
+	p = &method_info->u.f.parameters[arg_index];
+	if (p->type->basetype != arg_type->basetype) {
+		char* msg = "incompatible parameter in call\n";
+		throw_semantic_error(msg, arg);
+	}
 
+	return 1;
 }
 
-void validate_params(struct tree *args, typeptr method_info, int start_index) {
-
-	if (args->symbolname) {
+/* validate_params - check each argument of a call against its parameter */
+void validate_params(struct tree *args, typeptr method_info) {
 
-		if (args->kids[0]->nkids == 0) {
-			// printf("%s %s\n", typename(get_type(args->kids[1])) ,args->kids[1]->leaf->text);
-			match_param(method_info, args->kids[1], 1);
-			// printf("%s %s\n", typename(get_type(args->kids[0])) ,args->kids[0]->leaf->text);
-			match_param(method_info, args->kids[0], 0);
-		} else {
-			// printf("%s %s\n", typename(get_type(args->kids[1])) ,args->kids[1]->leaf->text);
-			match_param(method_info, args->kids[1], start_index);
-			start_index = start_index - 1;
-			validate_params(args->kids[0], method_info, start_index--);
-		}
-
-	} else {
-		// printf("Expr (single)\n");
-		// printf("%s\n", args->leaf->text);
-		match_param(method_info, args, start_index);
+	for (int i = 0; i < args->nkids; i++) {
+		match_param(method_info, args->kids[i], i);
 	}
 }
 
@@ -336,12 +311,22 @@ typeptr type_promotion (typeptr left, typeptr right) {
 	return NULL;
 }
 
-void check_types(struct tree *t) {
+/*
+ * poisoned - true if either operand already carries an error. The node
+ * takes on the error type as well, so a mistake is only reported once.
+ */
+static int poisoned(struct tree *t, typeptr left, typeptr right) {
+
+	if ((left != NULL && left->basetype == ERROR_TYPE) ||
+		(right != NULL && right->basetype == ERROR_TYPE)) {
+		t->type = error_typeptr;
+		return 1;
+	}
 
-	int i;
+	return 0;
+}
 
-	if (t == NULL) return;
-	for (i = 0; i < t->nkids; i++) { check_types(t->kids[i]); }
+static int check_node(struct tree *t, int depth, void *arg) {
 
 	switch(t->prodrule) {
 
@@ -366,9 +351,8 @@ void check_types(struct tree *t) {
 						break;
 					}
 					default: {
-						int line_number = t->kids[3]->leaf->lineno;
 						char* msg = "static field declaration must be assigned a literal\n";
-						throw_semantic_error(msg, line_number);
+						throw_semantic_error(msg, t->kids[3]);
 					}
 				}
 			}
@@ -381,10 +365,18 @@ void check_types(struct tree *t) {
 
 			// printf("L[%s] = R[%s]\n", left, right);
 
+			/* declared with a type name that was already reported */
+			if (poisoned(t, get_type(t->kids[0]), NULL)) {
+				break;
+			}
+
+			if (left == NULL || right == NULL || poisoned(t, left, right)) {
+				break;
+			}
+
 			if (left->basetype != right->basetype) {
-				int line_number = t->kids[1]->leaf->lineno;
 				char* msg = "incompatible types in assignment\n";
-				throw_semantic_error(msg, line_number);
+				throw_semantic_error(msg, t->kids[1]);
 			}
 
 			break;
@@ -394,8 +386,19 @@ void check_types(struct tree *t) {
 
 			// printf("prodR_UnaryAssignment found\n");
 
+			/* the grammar takes x =; as one, AssignOp and all */
+			if (t->kids[1]->leaf->category == '=') {
+				char* msg = "assignment without a value\n";
+				throw_semantic_error(msg, t->kids[1]);
+				break;
+			}
+
 			typeptr left = get_type(t->kids[0]);
 
+			if (left == NULL || poisoned(t, left, NULL)) {
+				break;
+			}
+
 			// printf("L[%s] = R[%s]\n", left, right);
 			switch (left->basetype) {
 				case INT_TYPE:
@@ -403,9 +406,8 @@ void check_types(struct tree *t) {
 				case DOUBLE_TYPE:
 					break;
 				default: {
-					int line_number = t->kids[0]->leaf->lineno;
 					char* msg = "incompatible type for unary assignment\n";
-					throw_semantic_error(msg, line_number);
+					throw_semantic_error(msg, t->kids[0]);
 				}
 			}
 
@@ -418,7 +420,7 @@ void check_types(struct tree *t) {
 			// printf("[0]: %s, [1]: %s\n",t->kids[0]->leaf->text, t->kids[2]->leaf->text);
 			typeptr left = NULL;
 			typeptr right = NULL;
-			int line_number = 0;
+			struct tree *target = NULL;
 
 			if (t->kids[2]->prodrule == prodR_ArrayInstantiation) {
 				// printf("prodR_ArrayInstantiation found\n");
@@ -447,15 +449,19 @@ void check_types(struct tree *t) {
 			}
 
 			if (t->kids[0]->prodrule == prodR_PostBracketArray) {
-				left = get_type(t->kids[0]->kids[0]);
-				line_number = t->kids[0]->kids[0]->leaf->lineno;
+				target = t->kids[0]->kids[0];
 			} else {
-				left = get_type(t->kids[0]);
-				line_number = t->kids[0]->leaf->lineno;
+				target = t->kids[0];
 			}
+			left = get_type(target);
 
 
 			if ((left != NULL) && (right != NULL)) {
+
+				if (poisoned(t, left, right)) {
+					break;
+				}
+
 				typeptr promo = type_promotion(left, right);
 				// printf("Promo1 returned %s\n", typename(promo));
 
@@ -465,7 +471,8 @@ void check_types(struct tree *t) {
 					t->type = promo;
 				} else {
 					char* msg = "incompatible types in assignment\n";
-					throw_semantic_error(msg, line_number);
+					throw_semantic_error(msg, target);
+					t->type = error_typeptr;
 				}
 			}
 
@@ -481,6 +488,10 @@ void check_types(struct tree *t) {
 
 				typeptr type = get_type(t->kids[1]);
 
+				if (type == NULL || poisoned(t, type, NULL)) {
+					break;
+				}
+
 				switch (type->basetype) {
 					case INT_TYPE:
 					case FLOAT_TYPE:
@@ -488,9 +499,9 @@ void check_types(struct tree *t) {
 					case CHAR_TYPE:
 						break;
 					default: {
-						int line_number = t->kids[1]->leaf->lineno;
 						char* msg = "incompatible type in expression (not a number)\n";
-						throw_semantic_error(msg, line_number);
+						throw_semantic_error(msg, t->kids[1]);
+						type = error_typeptr;
 					}
 				}
 
@@ -501,13 +512,17 @@ void check_types(struct tree *t) {
 
 				typeptr type = get_type(t->kids[1]);
 
+				if (type == NULL || poisoned(t, type, NULL)) {
+					break;
+				}
+
 				switch (type->basetype) {
 					case BOOL_TYPE:
 						break;
 					default: {
-						int line_number = t->kids[1]->leaf->lineno;
 						char* msg = "incompatible type in expression (not a boolean)\n";
-						throw_semantic_error(msg, line_number);
+						throw_semantic_error(msg, t->kids[1]);
+						type = error_typeptr;
 					}
 				}
 
@@ -536,15 +551,19 @@ void check_types(struct tree *t) {
 
 			if ((left != NULL) && (right != NULL)) {
 
+				if (poisoned(t, left, right)) {
+					break;
+				}
+
 				int left_correct = (is_number(left) || left->basetype == CHAR_TYPE);
 				int right_correct = (is_number(right) || right->basetype == CHAR_TYPE);
 
 				if (left_correct && right_correct) {
 					t->type = alctype(BOOL_TYPE);
 				} else {
-					int line_number = t->kids[0]->leaf->lineno;
 					char* msg = "incompatible type in expression (not a number)\n";
-					throw_semantic_error(msg, line_number);
+					throw_semantic_error(msg, t->kids[0]);
+					t->type = error_typeptr;
 				}
 			}
 
@@ -564,6 +583,10 @@ void check_types(struct tree *t) {
 
 			if ((left != NULL) && (right != NULL)) {
 
+				if (poisoned(t, left, right)) {
+					break;
+				}
+
 				int left_num = (is_number(left) || left->basetype == CHAR_TYPE);
 				int right_num = (is_number(right) || right->basetype == CHAR_TYPE);
 
@@ -577,9 +600,9 @@ void check_types(struct tree *t) {
 					// printf("BOTH BOOLEAN\n");
 					t->type = alctype(BOOL_TYPE);
 				}else {
-					int line_number = t->kids[0]->leaf->lineno;
 					char* msg = "incompatible types in expression\n";
-					throw_semantic_error(msg, line_number);
+					throw_semantic_error(msg, t->kids[0]);
+					t->type = error_typeptr;
 				}
 			}
 			break;
@@ -600,15 +623,19 @@ void check_types(struct tree *t) {
 
 			if ((left != NULL) && (right != NULL)) {
 
+				if (poisoned(t, left, right)) {
+					break;
+				}
+
 				int left_correct = (left->basetype == BOOL_TYPE);
 				int right_correct = ( right->basetype == BOOL_TYPE);
 
 				if (left_correct && right_correct) {
 					t->type = alctype(BOOL_TYPE);
 				} else {
-					int line_number = t->kids[0]->leaf->lineno;
 					char* msg = "incompatible types in expression (not a boolean)\n";
-					throw_semantic_error(msg, line_number);
+					throw_semantic_error(msg, t->kids[0]);
+					t->type = error_typeptr;
 				}
 			}
 			break;
@@ -620,20 +647,24 @@ void check_types(struct tree *t) {
 			// printf("prodR_MulExpr/prodR_AddExpr found\n");
 
 			typeptr left, right;
-			int line_number;
+			struct tree *culprit;
 
 			if (t->kids[0]->nkids == 2) { //prodrule == prodR_MulExpr
 				left = get_type(t->kids[0]->kids[0]);
-				line_number = t->kids[1]->leaf->lineno;
+				culprit = t->kids[1];
 			} else {
 				left = get_type(t->kids[0]);
-				line_number = t->kids[0]->leaf->lineno;
+				culprit = t->kids[0];
 			}
 
 			right = get_type(t->kids[1]);
 
 			if ((left != NULL) && (right != NULL)) {
 
+				if (poisoned(t, left, right)) {
+					break;
+				}
+
 				if (left->basetype == STRING_TYPE && right->basetype == STRING_TYPE) {
 					t->type = alctype(STRING_TYPE);
 					break;
@@ -641,7 +672,9 @@ void check_types(struct tree *t) {
 
 				if (!(is_number(left) && is_number(right))) {
 					char* msg = "expression requires numerical or String-only values\n";
-					throw_semantic_error(msg, line_number);
+					throw_semantic_error(msg, culprit);
+					t->type = error_typeptr;
+					break;
 				}
 
 				typeptr promo = type_promotion(left, right);
@@ -650,9 +683,9 @@ void check_types(struct tree *t) {
 				if(is_number(promo)) {
 					t->type = type_promotion(left, right);
 				} else {
-					int line_number = t->kids[0]->leaf->lineno;
 					char* msg = "expression requires numerical or String-only values\n";
-					throw_semantic_error(msg, line_number);
+					throw_semantic_error(msg, t->kids[0]);
+					t->type = error_typeptr;
 				}
 			}
 			break;
@@ -680,18 +713,22 @@ void check_types(struct tree *t) {
 
 				}
 				typ = get_type(t->kids[0]);
+
+				if (typ == NULL || poisoned(t, typ, NULL)) {
+					break;
+				}
+
 				int defined_num_args = typ->u.f.nparams;
 
 				if (t->kids[1]) {
 
-					int num_args = get_arg_count(t->kids[1]);
+					int num_args = t->kids[1]->nkids;
 
 					if (num_args == defined_num_args) {
-						validate_params(t->kids[1], typ, num_args - 1);
+						validate_params(t->kids[1], typ);
 					} else {
-						int line_number = t->kids[0]->leaf->lineno;
 						char* msg = "invalid number of arguments to method call\n";
-						throw_semantic_error(msg, line_number);
+						throw_semantic_error(msg, t->kids[0]);
 					}
 
 					t->type = typ->u.f.returntype;
@@ -699,9 +736,8 @@ void check_types(struct tree *t) {
 				} else {
 					// printf("method call with no arguments\n");
 					if (defined_num_args != 0) {
-						int line_number = t->kids[0]->leaf->lineno;
 						char* msg = "invalid number of arguments to method call\n\n";
-						throw_semantic_error(msg, line_number);
+						throw_semantic_error(msg, t->kids[0]);
 					}
 				}
 
@@ -716,18 +752,22 @@ void check_types(struct tree *t) {
 
 				//get last of the qualified name sequence
 				typeptr typ = get_type(t->kids[0]);
+
+				if (typ == NULL || poisoned(t, typ, NULL)) {
+					break;
+				}
+
 				int defined_num_args = typ->u.f.nparams;
 
-				if (t->kids[1]) {
+				if (t->kids[2]) {
 
-					int num_args = get_arg_count(t->kids[1]);
+					int num_args = t->kids[2]->nkids;
 
 					if (num_args == defined_num_args) {
-						validate_params(t->kids[1], typ, num_args - 1);
+						validate_params(t->kids[2], typ);
 					} else {
-						int line_number = t->kids[0]->leaf->lineno;
 						char* msg = "invalid number of arguments to method call\n";
-						throw_semantic_error(msg, line_number);
+						throw_semantic_error(msg, t->kids[0]);
 					}
 
 					t->type = typ->u.f.returntype;
@@ -735,9 +775,8 @@ void check_types(struct tree *t) {
 				} else {
 					// printf("method call with no arguments\n");
 					if (defined_num_args != 0) {
-						int line_number = t->kids[0]->leaf->lineno;
 						char* msg = "invalid number of arguments to method call\n\n";
-						throw_semantic_error(msg, line_number);
+						throw_semantic_error(msg, t->kids[0]);
 					}
 				}
 
@@ -779,4 +818,18 @@ void check_types(struct tree *t) {
 		}
 
 	}
+
+	return 1;
+}
+
+/*
+ * methods spliced in from the cache were checked when they were compiled,
+ * and with -jobs the methods are checked by the worker threads
+ */
+static int check_pre(struct tree *t, int depth, void *arg) {
+	return !method_checked(t);
+}
+
+void check_types(struct tree *t) {
+	walk_tree(t, check_pre, check_node, NULL);
 }
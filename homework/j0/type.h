@@ -7,7 +7,6 @@ typedef struct param {
 	char *name;
 	int position;
 	struct typeinfo *type;
-	struct param *next;
 } *paramlist;
 
 struct field {			/* members (fields) of structs */
@@ -31,8 +30,9 @@ struct field {			/* members (fields) of structs */
 #define FLOAT_TYPE 1000010
 #define VOID_TYPE 1000011
 #define ARRAY_TYPE 1000012
+#define ERROR_TYPE 1000013	/* poison: the expression already has an error */
 
-#define LAST_TYPE    1000012
+#define LAST_TYPE    1000013
 
 typedef struct typeinfo {
 	int basetype;
@@ -49,8 +49,8 @@ typedef struct typeinfo {
 			struct sym_table *st;
 			struct typeinfo *returntype;
 			int nparams;
-			int has_param;
-			struct param *parameters;
+			int nparams_added;	/* so far, while the declaration is read */
+			struct param *parameters;	/* nparams of them, in order */
 		}f;
 		struct classinfo {
 			char *name; /* ? */
@@ -73,6 +73,7 @@ char *typename(typeptr t);
 typeptr alcclasstype(struct sym_table * st);
 typeptr alcfunctype(struct sym_table * st);
 typeptr alcarraytype(typeptr elemtype, int size);
+void add_param(typeptr functype, char *name, typeptr t);
 typeptr determinetype(struct tree *t);
 void check_types(struct tree *t);
 struct tree *get_last_name(struct tree *name_head);
@@ -88,6 +89,7 @@ extern typeptr char_typeptr;
 // extern typeptr class_typeptr;
 // extern typeptr func_typeptr;
 extern typeptr construct_typeptr;
+extern typeptr error_typeptr;
 
 extern char *typenam[];
 
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "optimize.h"
+
+/*
+ * Checks of the code between optimizer passes, so that a pass that breaks
+ * it is caught where it does and not by whatever reads the code next.
+ * They find what no pass should leave behind: operands in no region, SSA
+ * values outside the SSA passes, labels declared twice, branches to ones
+ * never declared, a list that loops back on itself, and a graph whose
+ * edges do not match its code.
+ * Each returns what is wrong, or NULL.
+ */
+
+static char why[128];
+
+static int valid_addr(struct addr *a) {
+	return a->region == R_NONE || (a->region >= R_GLOBAL && a->region <= R_STRING);
+}
+
+static int valid_opcode(struct instr *in) {
+
+	if (in->code_type == DECLARATION) return in->opcode >= D_GLOB && in->opcode <= D_PROT;
+	return in->opcode >= O_ADD && in->opcode <= O_NOT;
+}
+
+/* check_instr - what is wrong with in on its own */
+static char *check_instr(struct instr *in) {
+
+	struct addr *as[3] = {&in->dest, &in->src1, &in->src2};
+
+	if (!valid_opcode(in)) {
+		sprintf(why, "unknown opcode %d", in->opcode);
+		return why;
+	}
+	if (in->code_type == DECLARATION) return NULL;
+
+	for (int k = 0; k < 3; k++) {
+		if (!valid_addr(as[k])) {
+			sprintf(why, "%s has an operand in region %d", opcodename(in->opcode),
+				as[k]->region);
+			return why;
+		}
+	}
+	if (in->opcode == O_CALL && (in->name == NULL || in->nparams < 0)) {
+		return "a CALL without a procedure";
+	}
+	if (is_branch(in) && in->opcode != O_RET && in->dest.region != R_LABEL) {
+		sprintf(why, "%s to no label", opcodename(in->opcode));
+		return why;
+	}
+	return NULL;
+}
+
+/* add_label - n onto the list at *list, of *len, growing it */
+static void add_label(int **list, int *len, int *size, int n) {
+
+	if (*len == *size) {
+		*size = *size ? 2 * *size : 64;
+		*list = realloc(*list, *size * sizeof(int));
+		if (*list == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(4);
+		}
+	}
+	(*list)[(*len)++] = n;
+}
+
+static int has_label(int *labels, int nlabels, int n) {
+
+	for (int i = 0; i < nlabels; i++) {
+		if (labels[i] == n) return 1;
+	}
+	return 0;
+}
+
+/* missing_label - a branch of the procedure to a label it does not declare */
+static char *missing_label(int *labels, int nlabels, int *targets, int ntargets) {
+
+	for (int i = 0; i < ntargets; i++) {
+		if (!has_label(labels, nlabels, targets[i])) {
+			sprintf(why, "a branch to L:%d, which is not declared", targets[i]);
+			return why;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * verify_code - what is wrong with the code from code on: if whole, the
+ *  rest of the program, procedure by procedure, else the one procedure
+ *  whose D_PROC code is
+ */
+char *verify_code(struct instr *code, int whole) {
+
+	struct instr *in, *fast = code;
+	int *labels = NULL, nlabels = 0, size = 0;
+	int *targets = NULL, ntargets = 0, tsize = 0;
+	char *wrong = NULL;
+
+	for (in = code; in != NULL && wrong == NULL; in = in->next) {
+		if (!whole && in != code && in->code_type == DECLARATION && in->opcode == D_PROC) break;
+
+		/* fast goes two at a time, and comes round to in only in a loop */
+		if (fast != NULL) fast = fast->next;
+		if (fast != NULL) fast = fast->next;
+		if (fast != NULL && fast == in) {
+			wrong = "the code goes round in a loop";
+			break;
+		}
+
+		if (in->code_type == DECLARATION && in->opcode == D_PROC) {
+			if ((wrong = missing_label(labels, nlabels, targets, ntargets)) != NULL) break;
+			nlabels = ntargets = 0;
+		}
+		if ((wrong = check_instr(in)) != NULL) break;
+		if (in->code_type != DECLARATION && is_branch(in) && in->dest.region == R_LABEL) {
+			add_label(&targets, &ntargets, &tsize, in->dest.u.offset);
+		}
+		if (in->code_type != DECLARATION || in->opcode != D_LABEL) continue;
+
+		if (has_label(labels, nlabels, in->dest.u.offset)) {
+			sprintf(why, "L:%d declared twice", in->dest.u.offset);
+			wrong = why;
+		}
+		add_label(&labels, &nlabels, &size, in->dest.u.offset);
+	}
+	if (wrong == NULL) wrong = missing_label(labels, nlabels, targets, ntargets);
+
+	free(labels);
+	free(targets);
+	return wrong;
+}
+
+static int has_edge(struct block **blocks, int n, struct block *b) {
+
+	for (int i = 0; i < n; i++) {
+		if (blocks[i] == b) return 1;
+	}
+	return 0;
+}
+
+/* check_edges - what is wrong with the edges out of b, given its code */
+static char *check_edges(struct cfg *g, struct block *b) {
+
+	struct instr *last = b->ncode > 0 ? b->code[b->ncode - 1] : NULL;
+	struct block *next = b->id + 1 < g->nblocks ? g->blocks[b->id + 1] : NULL;
+
+	for (int i = 0; i < b->nsucc; i++) {
+		if (!has_edge(b->succ[i]->pred, b->succ[i]->npred, b)) {
+			sprintf(why, "B%d -> B%d is not a pred edge", b->id, b->succ[i]->id);
+			return why;
+		}
+	}
+	for (int i = 0; i < b->npred; i++) {
+		if (!has_edge(b->pred[i]->succ, b->pred[i]->nsucc, b)) {
+			sprintf(why, "B%d <- B%d is not a succ edge", b->id, b->pred[i]->id);
+			return why;
+		}
+	}
+
+	if (last == NULL || !is_branch(last)) {
+		if (b->nsucc > 1 || (b->nsucc == 1 && b->succ[0] != next)) {
+			sprintf(why, "B%d falls through to other than B%d", b->id, b->id + 1);
+			return why;
+		}
+		return NULL;
+	}
+	if (last->opcode == O_RET && b->nsucc > 0) {
+		sprintf(why, "B%d goes on after its RETURN", b->id);
+		return why;
+	}
+	if (last->opcode == O_GOTO && b->nsucc > 1) {
+		sprintf(why, "B%d ends in a GOTO but has %d successors", b->id, b->nsucc);
+		return why;
+	}
+	for (int i = 0; i < b->nsucc; i++) {
+		struct block *s = b->succ[i];
+		int labelled = s->ncode > 0 && s->code[0]->code_type == DECLARATION &&
+			s->code[0]->opcode == D_LABEL && s->code[0]->dest.u.offset == last->dest.u.offset;
+
+		if (!labelled && (last->opcode == O_GOTO || s != next)) {
+			sprintf(why, "B%d branches to B%d, which is not L:%d", b->id, s->id,
+				last->dest.u.offset);
+			return why;
+		}
+	}
+	return NULL;
+}
+
+/* verify_cfg - what is wrong with the graph of a procedure, between passes */
+char *verify_cfg(struct cfg *g) {
+
+	char *wrong;
+
+	for (int i = 0; i < g->nblocks; i++) {
+		struct block *b = g->blocks[i];
+
+		if (b->id != i) {
+			sprintf(why, "block %d numbered B%d", i, b->id);
+			return why;
+		}
+		if (b->nphis > 0) {
+			sprintf(why, "B%d has phis outside SSA form", b->id);
+			return why;
+		}
+		for (int j = 0; j < b->ncode; j++) {
+			struct instr *in = b->code[j];
+
+			if ((wrong = check_instr(in)) != NULL) return wrong;
+			if (j > 0 && in->code_type == DECLARATION && in->opcode == D_LABEL) {
+				sprintf(why, "B%d has L:%d in the middle", b->id, in->dest.u.offset);
+				return why;
+			}
+			if (j < b->ncode - 1 && is_branch(in)) {
+				sprintf(why, "B%d has a %s in the middle", b->id, opcodename(in->opcode));
+				return why;
+			}
+		}
+		if ((wrong = check_edges(g, b)) != NULL) return wrong;
+	}
+	return NULL;
+}
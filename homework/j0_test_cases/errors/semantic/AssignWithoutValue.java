@@ -0,0 +1,12 @@
+public class hello {
+
+	public static void main(String argv[]) {
+		int x;
+		x = 3;
+
+		// should be an assignment without a value:
+		x =;
+		System.out.println(x);
+	}
+
+}